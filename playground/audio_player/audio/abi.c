@@ -0,0 +1,142 @@
+/*
+ * abi.c - audio 모듈의 C ABI 구현 (audio_abi.h)
+ *
+ * LuaJIT FFI에서 부르면 JIT가 직접 호출로 컴파일함 (Lua C API를 거치지 않음).
+ * 엔진은 audio.c의 것을 같이 씀. 일괄 함수는 핸들 배열을 한 번의 호출로 처리해서
+ * 사운드가 많을 때 호출 횟수를 줄임.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_abi.h"
+#include "miniaudio.h"
+
+// audio.c
+extern ma_engine* audio_engine(void);
+
+struct AudioSound {
+    ma_sound sound;
+    ma_decoder* decoder;  // audio_load_memory로 만든 사운드
+    void* data;           // 디코더가 읽는 데이터 복사본
+};
+
+AUDIO_API int audio_abi_version(void) {
+    return AUDIO_ABI_VERSION;
+}
+
+AUDIO_API int audio_play_file(const char* path) {
+    ma_engine* engine = audio_engine();
+    if (!engine || !path) return 0;
+    return ma_engine_play_sound(engine, path, NULL) == MA_SUCCESS;
+}
+
+AUDIO_API AudioSound* audio_load_file(const char* path) {
+    ma_engine* engine = audio_engine();
+    if (!engine || !path) return NULL;
+
+    AudioSound* sound = (AudioSound*)calloc(1, sizeof(AudioSound));
+    if (!sound) return NULL;
+
+    // bundle:// 경로는 Lua audio.init()이 번들 API를 받아 둔 경우에만 엔진의 VFS가 번들에서 읽음
+    if (ma_sound_init_from_file(engine, path, 0, NULL, NULL, &sound->sound) != MA_SUCCESS) {
+        free(sound);
+        return NULL;
+    }
+    return sound;
+}
+
+AUDIO_API AudioSound* audio_load_memory(const void* data, size_t size) {
+    ma_engine* engine = audio_engine();
+    if (!engine || !data) return NULL;
+
+    AudioSound* sound = (AudioSound*)calloc(1, sizeof(AudioSound));
+    void* copy = malloc(size ? size : 1);
+    ma_decoder* decoder = (ma_decoder*)malloc(sizeof(ma_decoder));
+    if (!sound || !copy || !decoder) goto fail;
+    memcpy(copy, data, size);
+
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    if (ma_decoder_init_memory(copy, size, &config, decoder) != MA_SUCCESS) goto fail;
+    if (ma_sound_init_from_data_source(engine, decoder, 0, NULL, &sound->sound) != MA_SUCCESS) {
+        ma_decoder_uninit(decoder);
+        goto fail;
+    }
+    sound->decoder = decoder;
+    sound->data = copy;
+    return sound;
+
+fail:
+    free(sound);
+    free(copy);
+    free(decoder);
+    return NULL;
+}
+
+AUDIO_API void audio_free(AudioSound* sound) {
+    if (!sound) return;
+    ma_sound_uninit(&sound->sound);
+    if (sound->decoder) {
+        ma_decoder_uninit(sound->decoder);
+        free(sound->decoder);
+    }
+    free(sound->data);
+    free(sound);
+}
+
+AUDIO_API int audio_play(AudioSound* sound) {
+    if (!sound) return 0;
+    return ma_sound_start(&sound->sound) == MA_SUCCESS;
+}
+
+AUDIO_API int audio_stop(AudioSound* sound) {
+    if (!sound) return 0;
+    return ma_sound_stop(&sound->sound) == MA_SUCCESS;
+}
+
+AUDIO_API int audio_set_volume(AudioSound* sound, float volume) {
+    if (!sound) return 0;
+    if (volume < 0.0f) volume = 0.0f;
+    if (volume > 1.0f) volume = 1.0f;
+    ma_sound_set_volume(&sound->sound, volume);
+    return 1;
+}
+
+AUDIO_API int audio_set_looping(AudioSound* sound, int loop) {
+    if (!sound) return 0;
+    ma_sound_set_looping(&sound->sound, loop ? MA_TRUE : MA_FALSE);
+    return 1;
+}
+
+AUDIO_API int audio_is_playing(AudioSound* sound) {
+    if (!sound) return 0;
+    return ma_sound_is_playing(&sound->sound) ? 1 : 0;
+}
+
+AUDIO_API int audio_play_many(AudioSound* const* sounds, int count) {
+    int done = 0;
+    for (int i = 0; i < count; i++) done += audio_play(sounds[i]);
+    return done;
+}
+
+AUDIO_API int audio_stop_many(AudioSound* const* sounds, int count) {
+    int done = 0;
+    for (int i = 0; i < count; i++) done += audio_stop(sounds[i]);
+    return done;
+}
+
+AUDIO_API int audio_set_volume_many(AudioSound* const* sounds, const float* volumes, int count) {
+    int done = 0;
+    for (int i = 0; i < count; i++) done += audio_set_volume(sounds[i], volumes[i]);
+    return done;
+}
+
+// playing[i]에 재생 여부를 채우고 재생 중인 개수를 돌려줌
+AUDIO_API int audio_is_playing_many(AudioSound* const* sounds, unsigned char* playing, int count) {
+    int done = 0;
+    for (int i = 0; i < count; i++) {
+        playing[i] = (unsigned char)audio_is_playing(sounds[i]);
+        done += playing[i];
+    }
+    return done;
+}
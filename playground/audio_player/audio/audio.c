@@ -18,7 +18,9 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "audio_abi.h"
 #include "lauxlib.h"
 #include "lua.h"
 #include "miniaudio.h"
@@ -32,12 +34,35 @@ extern int l_cls(lua_State* L);
 extern int l_beep(lua_State* L);
 extern int l_tick(lua_State* L);
 extern int l_yield(lua_State* L);
+extern int l_now(lua_State* L);
+extern int l_pacer(lua_State* L);
+extern void create_pacer_metatable(lua_State* L);
 extern void create_key_constants(lua_State* L);
 
 // 파일시스템 함수들
 extern int l_scan_music_files(lua_State* L);
 extern int l_file_exists(lua_State* L);
 extern int l_dir_exists(lua_State* L);
+extern int l_stat_many(lua_State* L);
+
+// 작업 풀로 넘기기 (util.c, lua_loader의 loader/pool.c 사용)
+typedef void (*PoolWorkFn)(void* data);
+typedef int (*PoolFinishFn)(lua_State* L, void* data);
+extern int audio_offload(lua_State* L, PoolWorkFn work, PoolFinishFn finish, void* data);
+
+// 타입 있는 버퍼 (buffer.c)
+extern int l_buffer_new(lua_State* L);
+extern void create_buffer_metatable(lua_State* L);
+extern void* audio_check_buffer(lua_State* L, int idx, int* kind, size_t* count);
+extern void audio_push_buffer_view(lua_State* L, void* data, int kind, size_t count, int readonly, int owner_idx);
+
+// 링 버퍼 재생 스트림 (stream.c)
+extern int l_stream_new(lua_State* L);
+extern void create_stream_metatable(lua_State* L);
+
+// 라이브러리 인덱스 (library.c)
+extern int l_library_open(lua_State* L);
+extern void create_library_metatable(lua_State* L);
 
 // 전역 오디오 엔진
 static ma_engine* g_engine = NULL;
@@ -46,9 +71,225 @@ static int g_initialized = 0;
 // 사운드 핸들 구조체 (Lua userdata용)
 typedef struct {
     ma_sound* sound;
+    ma_decoder* decoder;  // 메모리에서 디코드한 사운드 (번들 항목, loadMemory), 아니면 NULL
+    void* owned;          // 압축을 푼 번들 항목 (사운드와 함께 해제)
     int is_valid;
+
+    // samples()용 원본: 파일 경로 (복사본) 또는 인코딩된 데이터 (사운드가 붙잡고 있는 메모리)
+    char* path;
+    const void* memory;
+    size_t memory_size;
+
+    ma_audio_buffer_ref* ref;  // newSoundFromBuffer: 호출자 버퍼를 그대로 읽는 데이터 소스
+    float* pcm;                // samples()가 한 번 디코드해 둔 f32 PCM
+    ma_uint64 frames;
+    ma_uint32 channels;
+    ma_uint32 rate;
 } LuaSound;
 
+// srlua 번들 API (srlua/srglue.h의 BundleApi와 같은 배치, 레지스트리 "srlua.bundle")
+typedef struct {
+    int version;
+    int (*find)(const char* name, size_t len, const void** data, size_t* size, size_t* rawsize, int* packed);
+    int (*unpack)(const void* data, size_t size, void* out, size_t rawsize);
+} BundleApi;
+
+#define BUNDLE_PREFIX "bundle://"
+#define BUNDLE_PREFIX_LEN (sizeof(BUNDLE_PREFIX) - 1)
+
+static const BundleApi* g_bundle = NULL;
+
+static int is_bundle_path(const char* path) {
+    return strncmp(path, BUNDLE_PREFIX, BUNDLE_PREFIX_LEN) == 0;
+}
+
+// bundle://name 항목 찾기: 압축 안 된 항목은 매핑을 그대로 가리키고 (복사 없음),
+// 압축된 항목은 새 버퍼에 풀어서 *owned로 넘김
+static ma_result bundle_open_entry(const char* path, const void** data, size_t* size, void** owned) {
+    const char* name = path + BUNDLE_PREFIX_LEN;
+    const void* stored;
+    size_t stored_size, rawsize;
+    int packed;
+
+    *owned = NULL;
+    if (!g_bundle || !g_bundle->find(name, strlen(name), &stored, &stored_size, &rawsize, &packed)) {
+        return MA_DOES_NOT_EXIST;
+    }
+    if (!packed) {
+        *data = stored;
+        *size = stored_size;
+        return MA_SUCCESS;
+    }
+
+    void* buffer = malloc(rawsize ? rawsize : 1);
+    if (!buffer) return MA_OUT_OF_MEMORY;
+    if (g_bundle->unpack(stored, stored_size, buffer, rawsize) != 0) {
+        free(buffer);
+        return MA_INVALID_FILE;
+    }
+    *data = buffer;
+    *size = rawsize;
+    *owned = buffer;
+    return MA_SUCCESS;
+}
+
+// 엔진 리소스 매니저용 VFS: bundle:// 경로는 번들 메모리에서 읽고 (시스템 콜 없음),
+// 나머지는 기본 VFS로 넘김
+typedef struct {
+    ma_vfs_callbacks cb;
+    ma_default_vfs fallback;
+} BundleVfs;
+
+typedef struct {
+    ma_vfs_file inner;  // 일반 파일의 기본 VFS 핸들 (번들 항목이면 NULL)
+    const unsigned char* data;
+    size_t size;
+    size_t cursor;
+    void* owned;
+} BundleVfsFile;
+
+static BundleVfs g_vfs;
+
+static ma_result vfs_open(ma_vfs* pVFS, const char* path, ma_uint32 mode, ma_vfs_file* pFile) {
+    BundleVfs* vfs = (BundleVfs*)pVFS;
+    BundleVfsFile* file = (BundleVfsFile*)calloc(1, sizeof(BundleVfsFile));
+    if (!file) return MA_OUT_OF_MEMORY;
+
+    ma_result result;
+    if (is_bundle_path(path)) {
+        const void* data = NULL;
+        size_t size = 0;
+        result = (mode & MA_OPEN_MODE_WRITE) ? MA_ACCESS_DENIED : bundle_open_entry(path, &data, &size, &file->owned);
+        file->data = (const unsigned char*)data;
+        file->size = size;
+    } else {
+        result = ma_vfs_open(&vfs->fallback, path, mode, &file->inner);
+    }
+
+    if (result != MA_SUCCESS) {
+        free(file);
+        return result;
+    }
+    *pFile = file;
+    return MA_SUCCESS;
+}
+
+static ma_result vfs_open_w(ma_vfs* pVFS, const wchar_t* path, ma_uint32 mode, ma_vfs_file* pFile) {
+    BundleVfs* vfs = (BundleVfs*)pVFS;
+    BundleVfsFile* file = (BundleVfsFile*)calloc(1, sizeof(BundleVfsFile));
+    if (!file) return MA_OUT_OF_MEMORY;
+
+    ma_result result = ma_vfs_open_w(&vfs->fallback, path, mode, &file->inner);
+    if (result != MA_SUCCESS) {
+        free(file);
+        return result;
+    }
+    *pFile = file;
+    return MA_SUCCESS;
+}
+
+static ma_result vfs_close(ma_vfs* pVFS, ma_vfs_file handle) {
+    BundleVfsFile* file = (BundleVfsFile*)handle;
+    ma_result result = MA_SUCCESS;
+    if (file->inner) result = ma_vfs_close(&((BundleVfs*)pVFS)->fallback, file->inner);
+    free(file->owned);
+    free(file);
+    return result;
+}
+
+static ma_result vfs_read(ma_vfs* pVFS, ma_vfs_file handle, void* dst, size_t bytes, size_t* read) {
+    BundleVfsFile* file = (BundleVfsFile*)handle;
+    if (file->inner) return ma_vfs_read(&((BundleVfs*)pVFS)->fallback, file->inner, dst, bytes, read);
+
+    size_t n = file->size - file->cursor;
+    if (n > bytes) n = bytes;
+    memcpy(dst, file->data + file->cursor, n);
+    file->cursor += n;
+    if (read) *read = n;
+    return (n == 0 && bytes > 0) ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result vfs_write(ma_vfs* pVFS, ma_vfs_file handle, const void* src, size_t bytes, size_t* written) {
+    BundleVfsFile* file = (BundleVfsFile*)handle;
+    if (file->inner) return ma_vfs_write(&((BundleVfs*)pVFS)->fallback, file->inner, src, bytes, written);
+    return MA_ACCESS_DENIED;
+}
+
+static ma_result vfs_seek(ma_vfs* pVFS, ma_vfs_file handle, ma_int64 offset, ma_seek_origin origin) {
+    BundleVfsFile* file = (BundleVfsFile*)handle;
+    if (file->inner) return ma_vfs_seek(&((BundleVfs*)pVFS)->fallback, file->inner, offset, origin);
+
+    ma_int64 base = origin == ma_seek_origin_current ? (ma_int64)file->cursor
+                  : origin == ma_seek_origin_end     ? (ma_int64)file->size
+                                                     : 0;
+    if (base + offset < 0 || base + offset > (ma_int64)file->size) return MA_BAD_SEEK;
+    file->cursor = (size_t)(base + offset);
+    return MA_SUCCESS;
+}
+
+static ma_result vfs_tell(ma_vfs* pVFS, ma_vfs_file handle, ma_int64* cursor) {
+    BundleVfsFile* file = (BundleVfsFile*)handle;
+    if (file->inner) return ma_vfs_tell(&((BundleVfs*)pVFS)->fallback, file->inner, cursor);
+    *cursor = (ma_int64)file->cursor;
+    return MA_SUCCESS;
+}
+
+static ma_result vfs_info(ma_vfs* pVFS, ma_vfs_file handle, ma_file_info* info) {
+    BundleVfsFile* file = (BundleVfsFile*)handle;
+    if (file->inner) return ma_vfs_info(&((BundleVfs*)pVFS)->fallback, file->inner, info);
+    info->sizeInBytes = file->size;
+    return MA_SUCCESS;
+}
+
+static ma_result vfs_init(BundleVfs* vfs) {
+    vfs->cb.onOpen = vfs_open;
+    vfs->cb.onOpenW = vfs_open_w;
+    vfs->cb.onClose = vfs_close;
+    vfs->cb.onRead = vfs_read;
+    vfs->cb.onWrite = vfs_write;
+    vfs->cb.onSeek = vfs_seek;
+    vfs->cb.onTell = vfs_tell;
+    vfs->cb.onInfo = vfs_info;
+    return ma_default_vfs_init(&vfs->fallback, NULL);
+}
+
+// 엔진 시작: 실패하면 이유를 돌려줌 (Lua audio.init과 C ABI audio_init이 같이 씀)
+static const char* engine_start(void) {
+    if (g_initialized) return NULL;
+
+    g_engine = malloc(sizeof(ma_engine));
+    if (!g_engine) return "Memory allocation failed";
+
+    ma_engine_config config = ma_engine_config_init();
+    config.pResourceManagerVFS = &g_vfs;
+    if (vfs_init(&g_vfs) != MA_SUCCESS || ma_engine_init(&config, g_engine) != MA_SUCCESS) {
+        free(g_engine);
+        g_engine = NULL;
+        return "Audio engine init failed";
+    }
+
+    g_initialized = 1;
+    return NULL;
+}
+
+// abi.c에서 쓰는 엔진 (초기화 전이면 NULL)
+ma_engine* audio_engine(void) {
+    return g_initialized ? g_engine : NULL;
+}
+
+AUDIO_API int audio_init(void) {
+    return engine_start() == NULL;
+}
+
+AUDIO_API void audio_shutdown(void) {
+    if (g_initialized && g_engine) {
+        ma_engine_uninit(g_engine);
+        free(g_engine);
+        g_engine = NULL;
+        g_initialized = 0;
+    }
+}
+
 // 오디오 시스템 초기화
 static int l_audio_init(lua_State* L) {
     if (g_initialized) {
@@ -56,74 +297,219 @@ static int l_audio_init(lua_State* L) {
         return 1;
     }
 
-    g_engine = malloc(sizeof(ma_engine));
-    if (!g_engine) {
-        lua_pushboolean(L, 0);
-        lua_pushstring(L, "Memory allocation failed");
-        return 2;
-    }
+    // srlua로 묶인 실행 파일이면 번들 API가 레지스트리에 있음
+    lua_getfield(L, LUA_REGISTRYINDEX, "srlua.bundle");
+    const BundleApi* bundle = (const BundleApi*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    g_bundle = (bundle && bundle->version == 1) ? bundle : NULL;
 
-    if (ma_engine_init(NULL, g_engine) != MA_SUCCESS) {
-        free(g_engine);
-        g_engine = NULL;
+    const char* error = engine_start();
+    if (error) {
         lua_pushboolean(L, 0);
-        lua_pushstring(L, "Audio engine init failed");
+        lua_pushstring(L, error);
         return 2;
     }
 
-    g_initialized = 1;
     lua_pushboolean(L, 1);
     return 1;
 }
 
 // 오디오 시스템 종료
 static int l_audio_shutdown(lua_State* L) {
-    if (g_initialized && g_engine) {
-        ma_engine_uninit(g_engine);
-        free(g_engine);
-        g_engine = NULL;
-        g_initialized = 0;
-    }
+    (void)L;
+    audio_shutdown();
     return 0;
 }
 
-// 음악 파일 로드
-static int l_audio_load(lua_State* L) {
-    const char* filename = luaL_checkstring(L, 1);
+// 로드 작업 (워커 스레드에서 디코더 초기화)
+typedef struct {
+    const char* filename;  // 인자 문자열 (코루틴 스택에 남아 있음)
+    const void* memory;    // 메모리에서 디코드 (번들 항목, loadMemory 문자열), 파일이면 NULL
+    size_t memory_size;
+    void* owned;           // 압축을 푼 번들 항목
+    int keep_arg;          // 첫 인자 (Lua 문자열)를 사운드가 참조로 잡아 둠
+    ma_uint32 flags;       // 파일 사운드의 MA_SOUND_FLAG_* (load(path, true)면 DECODE)
+    ma_sound* sound;
+    ma_decoder* decoder;
+    ma_result result;
+} LoadJob;
+
+static void load_work(void* data) {
+    LoadJob* job = (LoadJob*)data;
+    if (!job->memory) {
+        job->result = ma_sound_init_from_file(g_engine, job->filename, job->flags, NULL, NULL, job->sound);
+        return;
+    }
 
-    if (!g_initialized) {
+    // 메모리를 그대로 읽는 디코더 (복사 없음), 엔진 형식인 f32로 변환
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    job->result = ma_decoder_init_memory(job->memory, job->memory_size, &config, job->decoder);
+    if (job->result != MA_SUCCESS) return;
+    job->result = ma_sound_init_from_data_source(g_engine, job->decoder, 0, NULL, job->sound);
+    if (job->result != MA_SUCCESS) ma_decoder_uninit(job->decoder);
+}
+
+static int load_finish(lua_State* L, void* data) {
+    LoadJob* job = (LoadJob*)data;
+    ma_sound* sound = job->sound;
+    ma_decoder* decoder = job->decoder;
+    void* owned = job->owned;
+    const void* memory = job->memory;
+    size_t memory_size = job->memory_size;
+    int keep_arg = job->keep_arg;
+    ma_result result = job->result;
+    free(job);
+
+    if (result != MA_SUCCESS) {
+        free(sound);
+        free(decoder);
+        free(owned);
         lua_pushnil(L);
-        lua_pushstring(L, "Audio system not initialized");
+        if (keep_arg) {
+            lua_pushstring(L, "Failed to decode audio data");
+        } else {
+            lua_pushfstring(L, "Failed to load: %s", lua_tostring(L, 1));
+        }
         return 2;
     }
 
     // LuaSound userdata 생성
     LuaSound* lua_sound = (LuaSound*)lua_newuserdata(L, sizeof(LuaSound));
-    lua_sound->sound = NULL;
-    lua_sound->is_valid = 0;
+    memset(lua_sound, 0, sizeof(LuaSound));
+    lua_sound->sound = sound;
+    lua_sound->decoder = decoder;
+    lua_sound->owned = owned;
+    lua_sound->is_valid = 1;
+    lua_sound->memory = memory;
+    lua_sound->memory_size = memory_size;
+    if (!memory) lua_sound->path = strdup(lua_tostring(L, 1));
+
+    // 디코더가 읽는 문자열이 사운드보다 먼저 수거되지 않도록 붙잡아 둠
+    if (keep_arg) {
+        lua_pushvalue(L, 1);
+        lua_setuservalue(L, -2);
+    }
 
     // 메타테이블 설정
     luaL_getmetatable(L, "LuaSound");
     lua_setmetatable(L, -2);
+    return 1;
+}
+
+// 디코더는 메모리에서 읽을 때만 (with_decoder)
+static LoadJob* new_load_job(lua_State* L, int with_decoder) {
+    LoadJob* job = (LoadJob*)calloc(1, sizeof(LoadJob));
+    ma_sound* sound = (ma_sound*)malloc(sizeof(ma_sound));
+    ma_decoder* decoder = with_decoder ? (ma_decoder*)malloc(sizeof(ma_decoder)) : NULL;
+    if (!job || !sound || (with_decoder && !decoder)) {
+        free(job);
+        free(sound);
+        free(decoder);
+        luaL_error(L, "Memory allocation failed");
+        return NULL;
+    }
+    job->sound = sound;
+    job->decoder = decoder;
+    job->result = MA_ERROR;
+    return job;
+}
+
+// 음악 파일 로드: load(path [, decode]) ("bundle://이름"이면 srlua 번들 항목을 메모리에서 바로 디코드)
+// decode가 참이면 로드할 때 전체를 f32 PCM으로 디코드해 둠 (재생 중 디코드 없음, samples()가 그 PCM을 그대로 보여 줌)
+// lua_loader의 loop 태스크 안에서 호출하면 작업 풀에서 로드하고 그동안 다른 태스크가 실행됨
+static int l_audio_load(lua_State* L) {
+    const char* filename = luaL_checkstring(L, 1);
+    int decode = lua_toboolean(L, 2);
 
-    // ma_sound 생성
-    lua_sound->sound = malloc(sizeof(ma_sound));
-    if (!lua_sound->sound) {
+    if (!g_initialized) {
         lua_pushnil(L);
-        lua_pushstring(L, "Memory allocation failed");
+        lua_pushstring(L, "Audio system not initialized");
         return 2;
     }
 
-    // 파일 로드
-    if (ma_sound_init_from_file(g_engine, filename, 0, NULL, NULL, lua_sound->sound) != MA_SUCCESS) {
-        free(lua_sound->sound);
-        lua_sound->sound = NULL;
+    LoadJob* job = new_load_job(L, is_bundle_path(filename));
+    job->filename = filename;
+    job->flags = decode ? MA_SOUND_FLAG_DECODE : 0;
+    if (job->decoder) {
+        ma_result result = bundle_open_entry(filename, &job->memory, &job->memory_size, &job->owned);
+        if (result != MA_SUCCESS) {
+            job->memory = NULL;
+            job->result = result;
+            return load_finish(L, job);
+        }
+    }
+    return audio_offload(L, load_work, load_finish, job);
+}
+
+// 메모리(문자열)에 든 인코딩된 오디오 (wav/flac/mp3/ogg) 로드, 문자열은 복사하지 않음
+static int l_audio_load_memory(lua_State* L) {
+    size_t size;
+    const char* data = luaL_checklstring(L, 1, &size);
+
+    if (!g_initialized) {
         lua_pushnil(L);
-        lua_pushfstring(L, "Failed to load: %s", filename);
+        lua_pushstring(L, "Audio system not initialized");
         return 2;
     }
 
+    LoadJob* job = new_load_job(L, 1);
+    job->memory = data;
+    job->memory_size = size;
+    job->keep_arg = 1;
+    return audio_offload(L, load_work, load_finish, job);
+}
+
+// 호출자가 만든 PCM 버퍼 재생: newSoundFromBuffer(buffer, rate, channels)
+// 버퍼 메모리를 그대로 읽음 (복사 없음). 버퍼는 사운드가 붙잡아 두고, 재생 중에 고친 값도 들림
+static int l_audio_new_sound_from_buffer(lua_State* L) {
+    int kind;
+    size_t count;
+    void* data = audio_check_buffer(L, 1, &kind, &count);
+    lua_Integer rate = luaL_checkinteger(L, 2);
+    lua_Integer channels = luaL_optinteger(L, 3, 1);
+    luaL_argcheck(L, rate > 0 && rate <= ma_standard_sample_rate_max, 2, "invalid sample rate");
+    luaL_argcheck(L, channels > 0 && channels <= MA_MAX_CHANNELS, 3, "invalid channel count");
+    luaL_argcheck(L, count % (size_t)channels == 0, 1, "buffer size is not a multiple of channels");
+
+    if (!g_initialized) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Audio system not initialized");
+        return 2;
+    }
+
+    ma_sound* sound = (ma_sound*)malloc(sizeof(ma_sound));
+    ma_audio_buffer_ref* ref = (ma_audio_buffer_ref*)malloc(sizeof(ma_audio_buffer_ref));
+    if (!sound || !ref) {
+        free(sound);
+        free(ref);
+        return luaL_error(L, "Memory allocation failed");
+    }
+
+    ma_result result = ma_audio_buffer_ref_init((ma_format)kind, (ma_uint32)channels, data, count / (size_t)channels, ref);
+    if (result == MA_SUCCESS) {
+        ref->sampleRate = (ma_uint32)rate;  // 0이면 엔진 레이트로 취급되므로 직접 설정
+        result = ma_sound_init_from_data_source(g_engine, ref, 0, NULL, sound);
+        if (result != MA_SUCCESS) ma_audio_buffer_ref_uninit(ref);
+    }
+    if (result != MA_SUCCESS) {
+        free(sound);
+        free(ref);
+        lua_pushnil(L);
+        lua_pushstring(L, "Failed to create sound from buffer");
+        return 2;
+    }
+
+    LuaSound* lua_sound = (LuaSound*)lua_newuserdata(L, sizeof(LuaSound));
+    memset(lua_sound, 0, sizeof(LuaSound));
+    lua_sound->sound = sound;
+    lua_sound->ref = ref;
     lua_sound->is_valid = 1;
+
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+
+    luaL_getmetatable(L, "LuaSound");
+    lua_setmetatable(L, -2);
     return 1;
 }
 
@@ -217,6 +603,115 @@ static int l_sound_set_looping(lua_State* L) {
     return 1;
 }
 
+// PCM 디코드 작업 (워커 스레드, samples())
+typedef struct {
+    const char* path;
+    const void* memory;
+    size_t memory_size;
+    float* pcm;
+    ma_uint64 frames;
+    ma_uint32 channels;
+    ma_uint32 rate;
+    ma_result result;
+} SamplesJob;
+
+static void samples_work(void* data) {
+    SamplesJob* job = (SamplesJob*)data;
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    void* pcm = NULL;
+    if (job->memory) {
+        job->result = ma_decode_memory(job->memory, job->memory_size, &config, &job->frames, &pcm);
+    } else {
+        job->result = ma_decode_file(job->path, &config, &job->frames, &pcm);
+    }
+    job->pcm = (float*)pcm;
+    job->channels = config.channels;
+    job->rate = config.sampleRate;
+}
+
+// 디코드한 PCM 위의 읽기 전용 f32 뷰, 채널 수, 샘플 레이트 (뷰가 사운드를 붙잡아 둠)
+static int push_samples(lua_State* L, LuaSound* lua_sound) {
+    audio_push_buffer_view(L, lua_sound->pcm, ma_format_f32, (size_t)(lua_sound->frames * lua_sound->channels), 1, 1);
+    lua_pushinteger(L, lua_sound->channels);
+    lua_pushinteger(L, lua_sound->rate);
+    return 3;
+}
+
+// load(path, true)로 디코드해 둔 파일 사운드면 리소스 매니저의 PCM 위의 뷰를 넣고 1
+// (같은 파일이 먼저 decode 없이 로드돼 있으면 노드를 같이 써서 인코딩된 채라 0)
+static int push_decoded_samples(lua_State* L, LuaSound* lua_sound) {
+    ma_resource_manager_data_source* source = lua_sound->sound ? lua_sound->sound->pResourceManagerDataSource : NULL;
+    if (!source || (source->flags & MA_RESOURCE_MANAGER_DATA_SOURCE_FLAG_STREAM)) return 0;
+    ma_resource_manager_data_buffer_node* node = source->backend.buffer.pNode;
+    if (!node || ma_resource_manager_data_buffer_node_result(node) != MA_SUCCESS) return 0;
+    if (ma_resource_manager_data_buffer_node_get_data_supply_type(node) != ma_resource_manager_data_supply_type_decoded) return 0;
+    if (node->data.backend.decoded.format != ma_format_f32) return 0;
+
+    ma_uint32 channels = node->data.backend.decoded.channels;
+    audio_push_buffer_view(L, (void*)node->data.backend.decoded.pData, ma_format_f32,
+                           (size_t)(node->data.backend.decoded.decodedFrameCount * channels), 1, 1);
+    lua_pushinteger(L, channels);
+    lua_pushinteger(L, node->data.backend.decoded.sampleRate);
+    return 1;
+}
+
+static int samples_finish(lua_State* L, void* data) {
+    SamplesJob* job = (SamplesJob*)data;
+    SamplesJob done = *job;
+    free(job);
+
+    LuaSound* lua_sound = (LuaSound*)lua_touserdata(L, 1);
+    if (done.result != MA_SUCCESS) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Failed to decode samples");
+        return 2;
+    }
+
+    // 같은 사운드에 samples()가 겹쳐 불렸으면 먼저 끝난 쪽을 씀
+    if (lua_sound->pcm) {
+        ma_free(done.pcm, NULL);
+    } else {
+        lua_sound->pcm = done.pcm;
+        lua_sound->frames = done.frames;
+        lua_sound->channels = done.channels;
+        lua_sound->rate = done.rate;
+    }
+    return push_samples(L, lua_sound);
+}
+
+// 사운드의 PCM: view, channels, rate
+// load(path, true) 사운드는 리소스 매니저가 디코드해 둔 PCM, newSoundFromBuffer 사운드는 원래 버퍼 위의 뷰 (복사 없음).
+// 그 밖의 사운드는 재생용 디코더와 따로 원본 전체를 f32로 한 번 더 디코드해서 사운드에 둠
+// (loop 태스크 안이면 작업 풀에서). 그만큼 디코드 시간이 들고 메모리는 프레임 × 채널 × 4바이트 더 씀
+static int l_sound_samples(lua_State* L) {
+    LuaSound* lua_sound = (LuaSound*)luaL_checkudata(L, 1, "LuaSound");
+    lua_settop(L, 1);
+
+    if (lua_sound->ref) {
+        ma_audio_buffer_ref* ref = lua_sound->ref;
+        audio_push_buffer_view(L, (void*)ref->pData, ref->format, (size_t)(ref->sizeInFrames * ref->channels), 1, 1);
+        lua_pushinteger(L, ref->channels);
+        lua_pushinteger(L, ref->sampleRate);
+        return 3;
+    }
+    if (lua_sound->pcm) return push_samples(L, lua_sound);
+    if (push_decoded_samples(L, lua_sound)) return 3;
+
+    if (!lua_sound->memory && !lua_sound->path) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Sound has no source to decode");
+        return 2;
+    }
+
+    SamplesJob* job = (SamplesJob*)calloc(1, sizeof(SamplesJob));
+    if (!job) return luaL_error(L, "Memory allocation failed");
+    job->path = lua_sound->path;
+    job->memory = lua_sound->memory;
+    job->memory_size = lua_sound->memory_size;
+    job->result = MA_ERROR;
+    return audio_offload(L, samples_work, samples_finish, job);
+}
+
 // LuaSound 가비지 컬렉션
 static int l_sound_gc(lua_State* L) {
     LuaSound* lua_sound = (LuaSound*)luaL_checkudata(L, 1, "LuaSound");
@@ -227,6 +722,22 @@ static int l_sound_gc(lua_State* L) {
         lua_sound->sound = NULL;
         lua_sound->is_valid = 0;
     }
+    if (lua_sound->decoder) {
+        ma_decoder_uninit(lua_sound->decoder);
+        free(lua_sound->decoder);
+        lua_sound->decoder = NULL;
+    }
+    if (lua_sound->ref) {
+        ma_audio_buffer_ref_uninit(lua_sound->ref);
+        free(lua_sound->ref);
+        lua_sound->ref = NULL;
+    }
+    free(lua_sound->owned);
+    lua_sound->owned = NULL;
+    ma_free(lua_sound->pcm, NULL);
+    lua_sound->pcm = NULL;
+    free(lua_sound->path);
+    lua_sound->path = NULL;
 
     return 0;
 }
@@ -249,6 +760,9 @@ static const luaL_Reg audiolib[] = {
     {"init", l_audio_init},
     {"shutdown", l_audio_shutdown},
     {"load", l_audio_load},
+    {"loadMemory", l_audio_load_memory},
+    {"newSoundFromBuffer", l_audio_new_sound_from_buffer},  // PCM 버퍼 재생 (복사 없음)
+    {"newStream", l_stream_new},                            // 스크립트가 채우는 링 버퍼 스트림
     {"playFile", l_audio_play_file},
 
     // Util 함수들 (util.c에서 가져옴)
@@ -260,11 +774,16 @@ static const luaL_Reg audiolib[] = {
     {"beep", l_beep},
     {"tick", l_tick},
     {"yield", l_yield},
+    {"now", l_now},                          // 단조 시계 (나노초)
+    {"pacer", l_pacer},                      // 프레임 페이서
 
     // 파일시스템 함수들
     {"scanMusicFiles", l_scan_music_files},  // 음악 파일 스캔
     {"fileExists", l_file_exists},           // 파일 존재 확인
     {"dirExists", l_dir_exists},             // 디렉토리 존재 확인
+    {"statMany", l_stat_many},               // 여러 경로 일괄 stat
+    {"openLibrary", l_library_open},         // 라이브러리 인덱스 열기
+    {"newBuffer", l_buffer_new},             // 타입 있는 연속 배열
 
     {NULL, NULL}};
 
@@ -275,6 +794,7 @@ static const luaL_Reg sound_meta[] = {
     {"setVolume", l_sound_set_volume},
     {"isPlaying", l_sound_is_playing},
     {"setLooping", l_sound_set_looping},
+    {"samples", l_sound_samples},
     {"__gc", l_sound_gc},
     {"__tostring", l_sound_tostring},
     {NULL, NULL}};
@@ -294,6 +814,18 @@ luaopen_audio(lua_State* L) {
     luaL_setfuncs(L, sound_meta, 0);
     lua_pop(L, 1);
 
+    // LuaLibrary 메타테이블 생성 (library.c)
+    create_library_metatable(L);
+
+    // LuaPacer 메타테이블 생성 (util.c)
+    create_pacer_metatable(L);
+
+    // LuaBuffer 메타테이블 생성 (buffer.c)
+    create_buffer_metatable(L);
+
+    // LuaStream 메타테이블 생성 (stream.c)
+    create_stream_metatable(L);
+
     // 오디오 모듈 테이블 생성 (util 함수들도 포함)
     luaL_newlib(L, audiolib);
 
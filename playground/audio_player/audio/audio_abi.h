@@ -0,0 +1,53 @@
+/*
+ * audio_abi.h - audio 모듈의 C ABI (LuaJIT FFI, C 프로그램용)
+ *
+ * Lua C 함수(audio.load, sound:play ...)와 같은 엔진을 씀. audio.init()을
+ * Lua에서 부르든 audio_init()을 FFI로 부르든 엔진은 하나.
+ *
+ * 규칙:
+ * - 핸들(AudioSound*)은 불투명 포인터. NULL 핸들을 넘기면 실패(0)로 처리
+ * - 성공 1 / 실패 0, 일괄(*_many) 함수는 성공한 개수를 돌려줌
+ * - 함수를 추가할 때는 AUDIO_ABI_VERSION을 올리고 기존 시그니처는 바꾸지 않음
+ * - 아래 선언부는 audio_ffi.lua의 ffi.cdef와 같아야 함 (전처리 지시문 없이 유지)
+ */
+
+#ifndef AUDIO_ABI_H
+#define AUDIO_ABI_H
+
+#include <stddef.h>
+
+#define AUDIO_ABI_VERSION 1
+
+#if defined(_WIN32)
+#define AUDIO_API __declspec(dllexport)
+#else
+#define AUDIO_API __attribute__((visibility("default")))
+#endif
+
+typedef struct AudioSound AudioSound;
+
+AUDIO_API int audio_abi_version(void);
+
+// 엔진
+AUDIO_API int audio_init(void);
+AUDIO_API void audio_shutdown(void);
+AUDIO_API int audio_play_file(const char* path);
+
+// 사운드 (파일 경로. "bundle://이름"은 srlua 번들 API를 레지스트리에서 받는 Lua audio.init()을
+// 거쳐야 쓸 수 있음. audio_init()만 부르는 프로그램에서는 열리지 않음)
+AUDIO_API AudioSound* audio_load_file(const char* path);
+AUDIO_API AudioSound* audio_load_memory(const void* data, size_t size);  // data는 복사됨
+AUDIO_API void audio_free(AudioSound* sound);
+AUDIO_API int audio_play(AudioSound* sound);
+AUDIO_API int audio_stop(AudioSound* sound);
+AUDIO_API int audio_set_volume(AudioSound* sound, float volume);
+AUDIO_API int audio_set_looping(AudioSound* sound, int loop);
+AUDIO_API int audio_is_playing(AudioSound* sound);
+
+// 일괄 처리 (핸들 배열 하나로 한 번에)
+AUDIO_API int audio_play_many(AudioSound* const* sounds, int count);
+AUDIO_API int audio_stop_many(AudioSound* const* sounds, int count);
+AUDIO_API int audio_set_volume_many(AudioSound* const* sounds, const float* volumes, int count);
+AUDIO_API int audio_is_playing_many(AudioSound* const* sounds, unsigned char* playing, int count);
+
+#endif
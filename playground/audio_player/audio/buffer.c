@@ -0,0 +1,376 @@
+/*
+ * buffer.c - 타입이 있는 연속 배열 userdata (audio, util 함수들이 같이 씀)
+ *
+ * Lua 사용법:
+ * local buf = audio.newBuffer("f32", 1024)        -- 0으로 채워진 1024개
+ * local pcm = audio.newBuffer("s16", {1, 2, 3})   -- 테이블에서
+ * local raw = audio.newBuffer("u8", bytes)        -- 문자열 바이트 그대로
+ * buf[1] = 0.5; print(buf[1], #buf, buf:kind())
+ * local half = buf:view(1, 512)                   -- 메모리 공유 (복사 없음)
+ * half:fill(0.25)
+ * pcm:copy(buf)                                   -- 값 복사 (종류가 다르면 값 변환, 범위로 자름)
+ * local s16 = buf:convert("s16")                  -- PCM 샘플 변환 (f32 ±1.0 <-> s16 ±32767)
+ * local bytes = buf:bytes()                       -- 원소 메모리를 문자열로
+ *
+ * 종류: "u8", "s16", "i32", "f32" (원소 1/2/4/4바이트). 종류 번호는 miniaudio의 ma_format과
+ * 같아서 PCM을 다루는 C 코드가 그대로 넘길 수 있음. 저장소는 64바이트 정렬.
+ * 뷰는 부모 저장소를 가리키고 원래 버퍼를 user value로 붙잡아 둠.
+ * 원소 인덱스는 Lua처럼 1부터.
+ */
+
+#include "lua.h"
+#include "lauxlib.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "miniaudio.h"
+
+#define BUFFER_META "LuaBuffer"
+#define BUFFER_ALIGN 64
+
+typedef struct {
+    void* data;     // 첫 원소 (뷰면 부모 저장소 안)
+    size_t count;   // 원소 수
+    int kind;       // ma_format_u8 / s16 / s32 / f32
+    int readonly;
+    void* storage;  // 소유한 저장소 (malloc 주소), 뷰면 NULL
+} LuaBuffer;
+
+static const char* const kind_names[] = {"u8", "s16", "i32", "f32", NULL};
+static const int kind_formats[] = {ma_format_u8, ma_format_s16, ma_format_s32, ma_format_f32};
+
+static size_t kind_size(int kind) {
+    return kind == ma_format_u8 ? 1 : kind == ma_format_s16 ? 2 : 4;
+}
+
+static const char* kind_name(int kind) {
+    for (int i = 0; kind_names[i]; i++) {
+        if (kind_formats[i] == kind) return kind_names[i];
+    }
+    return "?";
+}
+
+static int check_kind(lua_State* L, int idx) {
+    return kind_formats[luaL_checkoption(L, idx, NULL, kind_names)];
+}
+
+static LuaBuffer* check_buffer(lua_State* L, int idx) {
+    return (LuaBuffer*)luaL_checkudata(L, idx, BUFFER_META);
+}
+
+static LuaBuffer* check_writable(lua_State* L, int idx) {
+    LuaBuffer* buf = check_buffer(L, idx);
+    if (buf->readonly) luaL_error(L, "buffer is read-only");
+    return buf;
+}
+
+static double clamp_round(double v, double lo, double hi) {
+    if (v != v) return 0.0;  // NaN
+    v = floor(v + 0.5);
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// 원소 하나 쓰기 (정수 종류는 반올림 후 범위로 자름)
+void audio_buffer_store(void* data, int kind, size_t i, double v) {
+    switch (kind) {
+        case ma_format_u8: ((uint8_t*)data)[i] = (uint8_t)clamp_round(v, 0, 255); break;
+        case ma_format_s16: ((int16_t*)data)[i] = (int16_t)clamp_round(v, -32768, 32767); break;
+        case ma_format_s32: ((int32_t*)data)[i] = (int32_t)clamp_round(v, -2147483648.0, 2147483647.0); break;
+        default: ((float*)data)[i] = (float)v; break;
+    }
+}
+
+static double buffer_load(const void* data, int kind, size_t i) {
+    switch (kind) {
+        case ma_format_u8: return ((const uint8_t*)data)[i];
+        case ma_format_s16: return ((const int16_t*)data)[i];
+        case ma_format_s32: return ((const int32_t*)data)[i];
+        default: return ((const float*)data)[i];
+    }
+}
+
+static void push_element(lua_State* L, const LuaBuffer* buf, size_t i) {
+    if (buf->kind == ma_format_f32) {
+        lua_pushnumber(L, ((const float*)buf->data)[i]);
+    } else {
+        lua_pushinteger(L, (lua_Integer)buffer_load(buf->data, buf->kind, i));
+    }
+}
+
+// 0으로 채운 새 버퍼를 스택에 올림
+static LuaBuffer* push_new(lua_State* L, int kind, size_t count) {
+    size_t esize = kind_size(kind);
+    if (count > (SIZE_MAX - BUFFER_ALIGN) / esize) luaL_error(L, "buffer too large");
+
+    LuaBuffer* buf = (LuaBuffer*)lua_newuserdata(L, sizeof(LuaBuffer));
+    memset(buf, 0, sizeof(*buf));
+    luaL_getmetatable(L, BUFFER_META);
+    lua_setmetatable(L, -2);
+
+    buf->storage = calloc(1, count * esize + BUFFER_ALIGN);
+    if (!buf->storage) luaL_error(L, "Memory allocation failed");
+    buf->data = (void*)(((uintptr_t)buf->storage + BUFFER_ALIGN - 1) & ~(uintptr_t)(BUFFER_ALIGN - 1));
+    buf->count = count;
+    buf->kind = kind;
+    return buf;
+}
+
+// C 모듈용: idx가 버퍼면 원소 포인터 (복사 없음), 종류(ma_format), 원소 수. 아니면 Lua 오류
+void* audio_check_buffer(lua_State* L, int idx, int* kind, size_t* count) {
+    LuaBuffer* buf = check_buffer(L, idx);
+    if (kind) *kind = buf->kind;
+    if (count) *count = buf->count;
+    return buf->data;
+}
+
+// C 모듈용: 쓰기용으로 확인 (읽기 전용 뷰면 Lua 오류)
+void* audio_check_buffer_writable(lua_State* L, int idx, int* kind, size_t* count) {
+    check_writable(L, idx);
+    return audio_check_buffer(L, idx, kind, count);
+}
+
+// C 모듈용: 남의 메모리 위의 뷰. owner_idx의 값(0이면 없음)이 살아 있는 동안 data가 유효해야 함
+void audio_push_buffer_view(lua_State* L, void* data, int kind, size_t count, int readonly, int owner_idx) {
+    if (owner_idx) owner_idx = lua_absindex(L, owner_idx);
+    LuaBuffer* view = (LuaBuffer*)lua_newuserdata(L, sizeof(LuaBuffer));
+    memset(view, 0, sizeof(*view));
+    view->data = data;
+    view->count = count;
+    view->kind = kind;
+    view->readonly = readonly;
+    luaL_getmetatable(L, BUFFER_META);
+    lua_setmetatable(L, -2);
+    if (owner_idx) {
+        lua_pushvalue(L, owner_idx);
+        lua_setuservalue(L, -2);
+    }
+}
+
+// newBuffer(kind, count | table | string)
+int l_buffer_new(lua_State* L) {
+    int kind = check_kind(L, 1);
+
+    if (lua_type(L, 2) == LUA_TTABLE) {
+        size_t count = (size_t)lua_rawlen(L, 2);
+        LuaBuffer* buf = push_new(L, kind, count);
+        for (size_t i = 0; i < count; i++) {
+            lua_rawgeti(L, 2, (lua_Integer)i + 1);
+            audio_buffer_store(buf->data, kind, i, lua_tonumber(L, -1));
+            lua_pop(L, 1);
+        }
+        return 1;
+    }
+
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        size_t len;
+        const char* bytes = lua_tolstring(L, 2, &len);
+        size_t esize = kind_size(kind);
+        luaL_argcheck(L, len % esize == 0, 2, "string length is not a multiple of the element size");
+        LuaBuffer* buf = push_new(L, kind, len / esize);
+        memcpy(buf->data, bytes, len);
+        return 1;
+    }
+
+    lua_Integer count = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, count >= 0, 2, "count must not be negative");
+    push_new(L, kind, (size_t)count);
+    return 1;
+}
+
+// buf[i] 또는 메서드
+static int l_buffer_index(lua_State* L) {
+    LuaBuffer* buf = check_buffer(L, 1);
+    int isnum;
+    lua_Integer i = lua_tointegerx(L, 2, &isnum);
+    if (isnum) {
+        if (i < 1 || (size_t)i > buf->count) {
+            lua_pushnil(L);
+        } else {
+            push_element(L, buf, (size_t)i - 1);
+        }
+        return 1;
+    }
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    return 1;
+}
+
+static int l_buffer_newindex(lua_State* L) {
+    LuaBuffer* buf = check_writable(L, 1);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, i >= 1 && (size_t)i <= buf->count, 2, "index out of range");
+    audio_buffer_store(buf->data, buf->kind, (size_t)i - 1, luaL_checknumber(L, 3));
+    return 0;
+}
+
+static int l_buffer_len(lua_State* L) {
+    lua_pushinteger(L, (lua_Integer)check_buffer(L, 1)->count);
+    return 1;
+}
+
+// [i, j] 범위 확인 (기본값은 전체), 0 기반 시작과 개수로
+static void check_range(lua_State* L, const LuaBuffer* buf, int idx, size_t* first, size_t* n) {
+    lua_Integer i = luaL_optinteger(L, idx, 1);
+    lua_Integer j = luaL_optinteger(L, idx + 1, (lua_Integer)buf->count);
+    luaL_argcheck(L, i >= 1 && (size_t)i <= buf->count + 1, idx, "start out of range");
+    luaL_argcheck(L, j >= i - 1 && (size_t)j <= buf->count, idx + 1, "end out of range");
+    *first = (size_t)i - 1;
+    *n = (size_t)(j - i + 1);
+}
+
+static int l_buffer_kind(lua_State* L) {
+    lua_pushstring(L, kind_name(check_buffer(L, 1)->kind));
+    return 1;
+}
+
+// 바이트 크기
+static int l_buffer_size(lua_State* L) {
+    LuaBuffer* buf = check_buffer(L, 1);
+    lua_pushinteger(L, (lua_Integer)(buf->count * kind_size(buf->kind)));
+    return 1;
+}
+
+// view(i [, j]): 같은 메모리를 보는 부분 버퍼
+static int l_buffer_view(lua_State* L) {
+    LuaBuffer* buf = check_buffer(L, 1);
+    size_t first, n;
+    check_range(L, buf, 2, &first, &n);
+
+    // 원래 버퍼(저장소를 가진 쪽)를 붙잡아 둠
+    if (buf->storage) {
+        lua_pushvalue(L, 1);
+    } else {
+        lua_getuservalue(L, 1);
+    }
+    audio_push_buffer_view(L, (char*)buf->data + first * kind_size(buf->kind), buf->kind, n, buf->readonly, -1);
+    return 1;
+}
+
+// fill(value [, i, j])
+static int l_buffer_fill(lua_State* L) {
+    LuaBuffer* buf = check_writable(L, 1);
+    double value = luaL_checknumber(L, 2);
+    size_t first, n;
+    check_range(L, buf, 3, &first, &n);
+    if (n == 0) return 0;
+
+    audio_buffer_store(buf->data, buf->kind, first, value);
+    size_t esize = kind_size(buf->kind);
+    char* p = (char*)buf->data + first * esize;
+    // 채운 앞부분을 두 배씩 늘려 가며 복사
+    for (size_t done = 1; done < n;) {
+        size_t chunk = done < n - done ? done : n - done;
+        memcpy(p + done * esize, p, chunk * esize);
+        done += chunk;
+    }
+    return 0;
+}
+
+// copy(src [, at]): src 전체를 at(기본 1)부터 복사, 종류가 다르면 값 변환
+static int l_buffer_copy(lua_State* L) {
+    LuaBuffer* dst = check_writable(L, 1);
+    LuaBuffer* src = check_buffer(L, 2);
+    lua_Integer at = luaL_optinteger(L, 3, 1);
+    luaL_argcheck(L, at >= 1 && (size_t)at - 1 <= dst->count && src->count <= dst->count - ((size_t)at - 1), 3,
+                  "source does not fit");
+
+    size_t first = (size_t)at - 1;
+    if (src->kind == dst->kind) {
+        size_t esize = kind_size(dst->kind);
+        memmove((char*)dst->data + first * esize, src->data, src->count * esize);
+    } else {
+        for (size_t i = 0; i < src->count; i++) {
+            audio_buffer_store(dst->data, dst->kind, first + i, buffer_load(src->data, src->kind, i));
+        }
+    }
+    return 0;
+}
+
+// convert(kind [, dst]): PCM 샘플 변환 (miniaudio). dst가 없으면 새 버퍼
+static int l_buffer_convert(lua_State* L) {
+    LuaBuffer* src = check_buffer(L, 1);
+    int kind = check_kind(L, 2);
+    LuaBuffer* dst;
+
+    if (lua_isnoneornil(L, 3)) {
+        dst = push_new(L, kind, src->count);
+    } else {
+        dst = check_writable(L, 3);
+        luaL_argcheck(L, dst->kind == kind, 3, "buffer kind does not match");
+        luaL_argcheck(L, dst->count >= src->count, 3, "buffer too small");
+        lua_pushvalue(L, 3);
+    }
+    ma_pcm_convert(dst->data, (ma_format)kind, src->data, (ma_format)src->kind, src->count, ma_dither_mode_none);
+    return 1;
+}
+
+// bytes([i, j]): 원소 메모리를 문자열로
+static int l_buffer_bytes(lua_State* L) {
+    LuaBuffer* buf = check_buffer(L, 1);
+    size_t first, n;
+    check_range(L, buf, 2, &first, &n);
+    size_t esize = kind_size(buf->kind);
+    lua_pushlstring(L, (const char*)buf->data + first * esize, n * esize);
+    return 1;
+}
+
+// table([i, j]): Lua 테이블로
+static int l_buffer_table(lua_State* L) {
+    LuaBuffer* buf = check_buffer(L, 1);
+    size_t first, n;
+    check_range(L, buf, 2, &first, &n);
+    lua_createtable(L, n > INT32_MAX ? 0 : (int)n, 0);
+    for (size_t i = 0; i < n; i++) {
+        push_element(L, buf, first + i);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    return 1;
+}
+
+static int l_buffer_gc(lua_State* L) {
+    LuaBuffer* buf = check_buffer(L, 1);
+    free(buf->storage);
+    buf->storage = NULL;
+    buf->data = NULL;
+    buf->count = 0;
+    return 0;
+}
+
+static int l_buffer_tostring(lua_State* L) {
+    LuaBuffer* buf = check_buffer(L, 1);
+    lua_pushfstring(L, "LuaBuffer(%s, %d%s)", kind_name(buf->kind), (int)buf->count,
+                    buf->readonly ? ", read-only" : "");
+    return 1;
+}
+
+static const luaL_Reg buffer_methods[] = {
+    {"kind", l_buffer_kind},
+    {"size", l_buffer_size},
+    {"view", l_buffer_view},
+    {"fill", l_buffer_fill},
+    {"copy", l_buffer_copy},
+    {"convert", l_buffer_convert},
+    {"bytes", l_buffer_bytes},
+    {"table", l_buffer_table},
+    {NULL, NULL}};
+
+static const luaL_Reg buffer_meta[] = {
+    {"__newindex", l_buffer_newindex},
+    {"__len", l_buffer_len},
+    {"__gc", l_buffer_gc},
+    {"__tostring", l_buffer_tostring},
+    {NULL, NULL}};
+
+// LuaBuffer 메타테이블 생성
+void create_buffer_metatable(lua_State* L) {
+    luaL_newmetatable(L, BUFFER_META);
+    luaL_setfuncs(L, buffer_meta, 0);
+
+    // __index: 정수면 원소, 아니면 메서드 테이블
+    luaL_newlib(L, buffer_methods);
+    lua_pushcclosure(L, l_buffer_index, 1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+}
@@ -0,0 +1,1007 @@
+/*
+ * library.c - 음악 라이브러리 인덱스 (audio 모듈에서 사용)
+ *
+ * 기능:
+ * - openLibrary(indexPath, rootDir [, opts]) - 인덱스 파일 로드 + 변경분만 재스캔
+ * - lib:refresh() - 디렉토리 mtime 비교로 바뀐 디렉토리만 다시 스캔
+ * - lib:update() - inotify 이벤트 반영 (opts.watch 사용 시)
+ * - lib:files([withInfo]) - 파일 목록 (withInfo면 크기/시간/메타데이터 포함)
+ * - lib:save() / lib:close() / lib:stats() / lib:fd()
+ *
+ * 인덱스 파일은 헤더 + 디렉토리 레코드 + 파일 레코드 + 문자열 테이블로 구성되고
+ * 시작 시 mmap으로 읽어서 문자열을 복사하지 않고 그대로 가리킴.
+ * 디렉토리 mtime이 같으면 그 안의 파일은 stat하지 않음 (파일 내용만 바뀐 경우는
+ * 실행 중 inotify로 잡음).
+ */
+
+#include "lua.h"
+#include "lauxlib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "miniaudio.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#endif
+
+// util.c
+extern int has_music_extension(const char* filename);
+
+#define LIBRARY_META "LuaLibrary"
+
+#ifndef _WIN32
+
+#define LIB_MAGIC   "MLIX"
+#define LIB_VERSION 1
+#define LIB_NONE    UINT32_MAX
+
+#define LIB_FILE_PROBED  0x1
+
+// 인덱스 파일 레코드 (호스트 엔디안, 버전이 다르면 전체 재스캔)
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t dirCount;
+    uint32_t fileCount;
+    uint32_t stringSize;
+    uint32_t root;         // 루트 경로 문자열 오프셋
+} LibHeader;
+
+typedef struct {
+    uint32_t parent;
+    uint32_t path;         // 전체 경로 문자열 오프셋
+    int64_t mtime;         // 나노초
+} LibDirRecord;
+
+typedef struct {
+    uint32_t dir;
+    uint32_t name;         // 파일 이름 문자열 오프셋
+    uint64_t size;
+    int64_t mtime;         // 나노초
+    uint32_t durationMs;
+    uint32_t sampleRate;
+    uint16_t channels;
+    uint16_t flags;
+    uint32_t reserved;
+} LibFileRecord;
+
+// 메모리 내 표현 (문자열은 mmap 영역을 가리키거나 직접 할당)
+typedef struct {
+    const char* path;
+    int ownsPath;
+    uint32_t parent;
+    int64_t mtime;
+    uint32_t firstFile;
+    int wd;                // inotify watch descriptor (-1이면 없음)
+    int removed;
+    int dirty;
+} LibDir;
+
+typedef struct {
+    const char* name;
+    int ownsName;
+    uint32_t dir;
+    uint32_t nextInDir;
+    uint64_t size;
+    int64_t mtime;
+    uint32_t durationMs;
+    uint32_t sampleRate;
+    uint16_t channels;
+    uint16_t flags;
+    int removed;
+} LibFile;
+
+typedef struct {
+    char* indexPath;
+    char* root;
+    int probe;
+    int recursive;
+
+    void* map;
+    size_t mapSize;
+
+    LibDir* dirs;
+    uint32_t dirCount;
+    uint32_t dirCap;
+    LibFile* files;
+    uint32_t fileCount;
+    uint32_t fileCap;
+    uint32_t liveFiles;
+
+    // 경로 -> 디렉토리 인덱스 (오픈 어드레싱)
+    uint32_t* dirHash;
+    uint32_t dirHashCap;
+
+    int inotifyFd;
+    uint32_t* wdDir;       // wd -> 디렉토리 인덱스
+    int wdCap;
+
+    int modified;
+    int closed;
+
+    // 통계
+    int loadedFromIndex;
+    lua_Integer statCalls;
+    lua_Integer rescannedDirs;
+    lua_Integer probedFiles;
+} LuaLibrary;
+
+static int64_t lib_mtime_ns(const struct stat* st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+static uint32_t lib_hash_string(const char* s) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int lib_hash_insert(LuaLibrary* lib, uint32_t index);
+
+static int lib_hash_grow(LuaLibrary* lib) {
+    uint32_t newCap = lib->dirHashCap ? lib->dirHashCap * 2 : 256;
+    uint32_t* table = malloc(sizeof(uint32_t) * newCap);
+    if (!table) return 0;
+    for (uint32_t i = 0; i < newCap; i++) table[i] = LIB_NONE;
+
+    free(lib->dirHash);
+    lib->dirHash = table;
+    lib->dirHashCap = newCap;
+    for (uint32_t i = 0; i < lib->dirCount; i++) {
+        if (!lib->dirs[i].removed) lib_hash_insert(lib, i);
+    }
+    return 1;
+}
+
+static int lib_hash_insert(LuaLibrary* lib, uint32_t index) {
+    uint32_t mask = lib->dirHashCap - 1;
+    uint32_t slot = lib_hash_string(lib->dirs[index].path) & mask;
+    while (lib->dirHash[slot] != LIB_NONE) slot = (slot + 1) & mask;
+    lib->dirHash[slot] = index;
+    return 1;
+}
+
+// 살아있는 디렉토리만 찾음 (지워진 디렉토리는 슬롯만 차지)
+static uint32_t lib_find_dir(LuaLibrary* lib, const char* path) {
+    if (lib->dirHashCap == 0) return LIB_NONE;
+    uint32_t mask = lib->dirHashCap - 1;
+    uint32_t slot = lib_hash_string(path) & mask;
+    while (lib->dirHash[slot] != LIB_NONE) {
+        LibDir* d = &lib->dirs[lib->dirHash[slot]];
+        if (!d->removed && strcmp(d->path, path) == 0) return lib->dirHash[slot];
+        slot = (slot + 1) & mask;
+    }
+    return LIB_NONE;
+}
+
+static uint32_t lib_add_dir(LuaLibrary* lib, const char* path, int ownsPath, uint32_t parent, int64_t mtime) {
+    if (lib->dirCount == lib->dirCap) {
+        uint32_t newCap = lib->dirCap ? lib->dirCap * 2 : 64;
+        LibDir* grown = realloc(lib->dirs, sizeof(LibDir) * newCap);
+        if (!grown) return LIB_NONE;
+        lib->dirs = grown;
+        lib->dirCap = newCap;
+    }
+    // 해시 테이블은 절반 이하로 유지
+    if ((lib->dirCount + 1) * 2 > lib->dirHashCap && !lib_hash_grow(lib)) return LIB_NONE;
+
+    uint32_t index = lib->dirCount++;
+    LibDir* d = &lib->dirs[index];
+    d->path = path;
+    d->ownsPath = ownsPath;
+    d->parent = parent;
+    d->mtime = mtime;
+    d->firstFile = LIB_NONE;
+    d->wd = -1;
+    d->removed = 0;
+    d->dirty = 0;
+    lib_hash_insert(lib, index);
+    return index;
+}
+
+static uint32_t lib_add_file(LuaLibrary* lib, uint32_t dir, const char* name, int ownsName) {
+    if (lib->fileCount == lib->fileCap) {
+        uint32_t newCap = lib->fileCap ? lib->fileCap * 2 : 256;
+        LibFile* grown = realloc(lib->files, sizeof(LibFile) * newCap);
+        if (!grown) return LIB_NONE;
+        lib->files = grown;
+        lib->fileCap = newCap;
+    }
+
+    uint32_t index = lib->fileCount++;
+    LibFile* f = &lib->files[index];
+    memset(f, 0, sizeof(*f));
+    f->name = name;
+    f->ownsName = ownsName;
+    f->dir = dir;
+    f->nextInDir = lib->dirs[dir].firstFile;
+    lib->dirs[dir].firstFile = index;
+    lib->liveFiles++;
+    return index;
+}
+
+static void lib_remove_file(LuaLibrary* lib, uint32_t index) {
+    LibFile* f = &lib->files[index];
+    if (f->removed) return;
+    f->removed = 1;
+    if (f->ownsName) free((char*)f->name);
+    f->name = NULL;
+    f->ownsName = 0;
+    lib->liveFiles--;
+    lib->modified = 1;
+}
+
+static char* lib_join(const char* dir, const char* name) {
+    size_t dirLen = strlen(dir);
+    size_t nameLen = strlen(name);
+    char* path = malloc(dirLen + nameLen + 2);
+    if (!path) return NULL;
+    memcpy(path, dir, dirLen);
+    if (dirLen > 0 && dir[dirLen - 1] != '/') path[dirLen++] = '/';
+    memcpy(path + dirLen, name, nameLen + 1);
+    return path;
+}
+
+static void lib_remove_dir(LuaLibrary* lib, uint32_t index);
+
+static void lib_watch_dir(LuaLibrary* lib, uint32_t index) {
+    if (lib->inotifyFd < 0) return;
+    int wd = inotify_add_watch(lib->inotifyFd, lib->dirs[index].path,
+                               IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                               IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if (wd < 0) return;
+
+    // 같은 wd가 돌아오면 감시 중인 디렉토리가 트리 안에서 이름이 바뀐 것 (inode 기준).
+    // 옛 경로의 항목은 감시를 넘겨받은 뒤 제거 (wd는 지우지 않음)
+    if (wd < lib->wdCap && lib->wdDir[wd] != LIB_NONE && lib->wdDir[wd] != index) {
+        uint32_t old = lib->wdDir[wd];
+        lib->wdDir[wd] = index;
+        lib->dirs[old].wd = -1;
+        lib_remove_dir(lib, old);
+    }
+
+    if (wd >= lib->wdCap) {
+        int newCap = lib->wdCap ? lib->wdCap : 64;
+        while (newCap <= wd) newCap *= 2;
+        uint32_t* grown = realloc(lib->wdDir, sizeof(uint32_t) * newCap);
+        if (!grown) {
+            inotify_rm_watch(lib->inotifyFd, wd);
+            return;
+        }
+        for (int i = lib->wdCap; i < newCap; i++) grown[i] = LIB_NONE;
+        lib->wdDir = grown;
+        lib->wdCap = newCap;
+    }
+    lib->wdDir[wd] = index;
+    lib->dirs[index].wd = wd;
+}
+
+// 디렉토리와 그 파일들을 인덱스에서 제거 (하위 디렉토리도 함께)
+static void lib_remove_dir(LuaLibrary* lib, uint32_t index) {
+    LibDir* d = &lib->dirs[index];
+    if (d->removed) return;
+
+    for (uint32_t f = d->firstFile; f != LIB_NONE; f = lib->files[f].nextInDir) {
+        lib_remove_file(lib, f);
+    }
+    d->firstFile = LIB_NONE;
+    d->removed = 1;
+    // wd가 이미 다른 항목(이름이 바뀐 디렉토리)으로 넘어갔으면 감시를 지우지 않음
+    if (d->wd >= 0 && lib->inotifyFd >= 0 && d->wd < lib->wdCap && lib->wdDir[d->wd] == index) {
+        inotify_rm_watch(lib->inotifyFd, d->wd);
+        lib->wdDir[d->wd] = LIB_NONE;
+    }
+    d->wd = -1;
+    lib->modified = 1;
+
+    // 부모는 항상 자식보다 앞에 있으므로 한 번 훑으면 하위 디렉토리가 모두 지워짐
+    for (uint32_t i = index + 1; i < lib->dirCount; i++) {
+        LibDir* child = &lib->dirs[i];
+        if (!child->removed && child->parent != LIB_NONE && lib->dirs[child->parent].removed) {
+            lib_remove_dir(lib, i);
+        }
+    }
+}
+
+// 메타데이터 조사 (디코더 헤더만 읽음)
+static void lib_probe_file(LuaLibrary* lib, LibFile* f, const char* path) {
+    ma_decoder decoder;
+    ma_format format;
+    ma_uint32 channels = 0;
+    ma_uint32 sampleRate = 0;
+    ma_uint64 frames = 0;
+
+    f->flags |= LIB_FILE_PROBED;
+    f->durationMs = 0;
+    f->sampleRate = 0;
+    f->channels = 0;
+    lib->probedFiles++;
+
+    if (ma_decoder_init_file(path, NULL, &decoder) != MA_SUCCESS) return;
+    if (ma_decoder_get_data_format(&decoder, &format, &channels, &sampleRate, NULL, 0) == MA_SUCCESS) {
+        f->sampleRate = sampleRate;
+        f->channels = (uint16_t)channels;
+        if (sampleRate > 0 && ma_decoder_get_length_in_pcm_frames(&decoder, &frames) == MA_SUCCESS) {
+            f->durationMs = (uint32_t)(frames * 1000 / sampleRate);
+        }
+    }
+    ma_decoder_uninit(&decoder);
+}
+
+// 디렉토리 재스캔 시 기존 파일 이진 탐색용
+typedef struct {
+    const char* name;
+    uint32_t index;
+    int seen;
+} LibKnownFile;
+
+static int lib_compare_known(const void* a, const void* b) {
+    return strcmp(((const LibKnownFile*)a)->name, ((const LibKnownFile*)b)->name);
+}
+
+// 디렉토리 하나를 다시 읽어서 파일 추가/삭제/변경을 반영. 바뀐 파일 수 반환
+static int lib_scan_dir(LuaLibrary* lib, uint32_t index, int64_t mtime) {
+    int changed = 0;
+    const char* dirPath = lib->dirs[index].path;
+
+    lib->rescannedDirs++;
+    lib->dirs[index].mtime = mtime;
+    lib->dirs[index].dirty = 0;
+    lib->modified = 1;
+
+    // 기존 파일을 이름순으로 정렬해서 이진 탐색
+    uint32_t known = 0;
+    for (uint32_t f = lib->dirs[index].firstFile; f != LIB_NONE; f = lib->files[f].nextInDir) known++;
+    LibKnownFile* sorted = known ? malloc(sizeof(LibKnownFile) * known) : NULL;
+    if (known && !sorted) return 0;
+    known = 0;
+    for (uint32_t f = lib->dirs[index].firstFile; f != LIB_NONE; f = lib->files[f].nextInDir) {
+        sorted[known].name = lib->files[f].name;
+        sorted[known].index = f;
+        sorted[known++].seen = 0;
+    }
+    if (known > 1) qsort(sorted, known, sizeof(LibKnownFile), lib_compare_known);
+
+    int fd = open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dir) {
+        if (fd >= 0) close(fd);
+        free(sorted);
+        lib_remove_dir(lib, index);
+        return (int)known;
+    }
+
+    // 새로 발견한 하위 디렉토리 (스캔은 readdir을 닫은 뒤에)
+    char** subdirs = NULL;
+    int64_t* subMtimes = NULL;
+    size_t subCount = 0;
+    size_t subCap = 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        // d_type으로 걸러낼 수 있는 항목은 stat 전에 건너뜀
+        if (entry->d_type == DT_DIR) {
+            if (!lib->recursive) continue;
+        } else if (entry->d_type == DT_REG) {
+            if (!has_music_extension(entry->d_name)) continue;
+        } else if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            if (!lib->recursive && !has_music_extension(entry->d_name)) continue;
+        } else {
+            continue;
+        }
+
+        struct stat st;
+        lib->statCalls++;
+        if (fstatat(fd, entry->d_name, &st, 0) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            // 심볼릭 링크 디렉토리는 따라가지 않음
+            if (!lib->recursive || entry->d_type == DT_LNK) continue;
+            char* sub = lib_join(dirPath, entry->d_name);
+            if (!sub) continue;
+            if (lib_find_dir(lib, sub) != LIB_NONE) {
+                free(sub);
+                continue;
+            }
+            if (subCount == subCap) {
+                size_t newCap = subCap ? subCap * 2 : 8;
+                char** grownDirs = realloc(subdirs, sizeof(char*) * newCap);
+                if (grownDirs) subdirs = grownDirs;
+                int64_t* grownTimes = realloc(subMtimes, sizeof(int64_t) * newCap);
+                if (grownTimes) subMtimes = grownTimes;
+                if (!grownDirs || !grownTimes) {
+                    free(sub);
+                    continue;
+                }
+                subCap = newCap;
+            }
+            subdirs[subCount] = sub;
+            subMtimes[subCount++] = lib_mtime_ns(&st);
+            continue;
+        }
+
+        if (!S_ISREG(st.st_mode) || !has_music_extension(entry->d_name)) continue;
+
+        // 기존 항목 찾기
+        uint32_t fileIndex = LIB_NONE;
+        uint32_t lo = 0, hi = known;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            int cmp = strcmp(entry->d_name, sorted[mid].name);
+            if (cmp == 0) {
+                fileIndex = sorted[mid].index;
+                sorted[mid].seen = 1;
+                break;
+            }
+            if (cmp < 0) hi = mid; else lo = mid + 1;
+        }
+
+        int64_t fileMtime = lib_mtime_ns(&st);
+        LibFile* f;
+        if (fileIndex == LIB_NONE) {
+            char* name = strdup(entry->d_name);
+            if (!name) continue;
+            fileIndex = lib_add_file(lib, index, name, 1);
+            if (fileIndex == LIB_NONE) {
+                free(name);
+                continue;
+            }
+            f = &lib->files[fileIndex];
+        } else {
+            f = &lib->files[fileIndex];
+            if (f->size == (uint64_t)st.st_size && f->mtime == fileMtime) continue;
+            f->flags &= ~LIB_FILE_PROBED;  // 내용이 바뀌었으면 다시 조사
+        }
+
+        f->size = (uint64_t)st.st_size;
+        f->mtime = fileMtime;
+        changed++;
+
+        if (lib->probe) {
+            char* fullPath = lib_join(dirPath, f->name);
+            if (fullPath) {
+                lib_probe_file(lib, f, fullPath);
+                free(fullPath);
+            }
+        }
+    }
+    closedir(dir);
+
+    // 사라진 파일 제거 후 디렉토리 파일 목록 재구성
+    for (uint32_t i = 0; i < known; i++) {
+        if (!sorted[i].seen) {
+            lib_remove_file(lib, sorted[i].index);
+            changed++;
+        }
+    }
+    uint32_t head = LIB_NONE;
+    for (uint32_t f = lib->dirs[index].firstFile; f != LIB_NONE;) {
+        uint32_t next = lib->files[f].nextInDir;
+        if (!lib->files[f].removed) {
+            lib->files[f].nextInDir = head;
+            head = f;
+        }
+        f = next;
+    }
+    lib->dirs[index].firstFile = head;
+    free(sorted);
+
+    for (size_t i = 0; i < subCount; i++) {
+        uint32_t sub = lib_add_dir(lib, subdirs[i], 1, index, 0);
+        if (sub == LIB_NONE) {
+            free(subdirs[i]);
+            continue;
+        }
+        lib_watch_dir(lib, sub);
+        changed += lib_scan_dir(lib, sub, subMtimes[i]);
+    }
+    free(subdirs);
+    free(subMtimes);
+
+    return changed;
+}
+
+// 알려진 디렉토리들의 mtime만 확인하고 바뀐 곳만 재스캔
+static int lib_refresh(LuaLibrary* lib) {
+    int changed = 0;
+    // 재스캔 중 새 디렉토리가 추가되므로 시작 시점 개수까지만 확인 (새 것은 이미 스캔됨)
+    uint32_t count = lib->dirCount;
+    for (uint32_t i = 0; i < count; i++) {
+        LibDir* d = &lib->dirs[i];
+        if (d->removed) continue;
+
+        struct stat st;
+        lib->statCalls++;
+        if (stat(d->path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            for (uint32_t f = d->firstFile; f != LIB_NONE; f = lib->files[f].nextInDir) changed++;
+            lib_remove_dir(lib, i);
+            continue;
+        }
+        if (d->dirty || lib_mtime_ns(&st) != d->mtime) {
+            changed += lib_scan_dir(lib, i, lib_mtime_ns(&st));
+        }
+    }
+    return changed;
+}
+
+// 인덱스 파일 mmap 후 구조 복원. 실패하거나 루트가 다르면 0 반환
+static int lib_load_index(LuaLibrary* lib) {
+    int fd = open(lib->indexPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LibHeader)) {
+        close(fd);
+        return 0;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    const LibHeader* h = map;
+    size_t size = (size_t)st.st_size;
+    size_t dirsSize = (size_t)h->dirCount * sizeof(LibDirRecord);
+    size_t filesSize = (size_t)h->fileCount * sizeof(LibFileRecord);
+    size_t expected = sizeof(LibHeader) + dirsSize + filesSize + h->stringSize;
+    const char* strings = (const char*)map + sizeof(LibHeader) + dirsSize + filesSize;
+
+    if (memcmp(h->magic, LIB_MAGIC, 4) != 0 || h->version != LIB_VERSION || expected != size ||
+        h->stringSize == 0 || strings[h->stringSize - 1] != '\0' || h->root >= h->stringSize ||
+        strcmp(strings + h->root, lib->root) != 0) {
+        munmap(map, size);
+        return 0;
+    }
+
+    const LibDirRecord* dirs = (const LibDirRecord*)((const char*)map + sizeof(LibHeader));
+    const LibFileRecord* files = (const LibFileRecord*)((const char*)dirs + dirsSize);
+
+    for (uint32_t i = 0; i < h->dirCount; i++) {
+        if (dirs[i].path >= h->stringSize || (dirs[i].parent != LIB_NONE && dirs[i].parent >= i)) break;
+        if (lib_add_dir(lib, strings + dirs[i].path, 0, dirs[i].parent, dirs[i].mtime) == LIB_NONE) break;
+    }
+    for (uint32_t i = 0; i < h->fileCount; i++) {
+        const LibFileRecord* r = &files[i];
+        if (r->dir >= lib->dirCount || r->name >= h->stringSize) continue;
+        uint32_t index = lib_add_file(lib, r->dir, strings + r->name, 0);
+        if (index == LIB_NONE) break;
+        LibFile* f = &lib->files[index];
+        f->size = r->size;
+        f->mtime = r->mtime;
+        f->durationMs = r->durationMs;
+        f->sampleRate = r->sampleRate;
+        f->channels = r->channels;
+        f->flags = r->flags;
+    }
+
+    lib->map = map;
+    lib->mapSize = size;
+    lib->loadedFromIndex = 1;
+    return lib->dirCount > 0;
+}
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t cap;
+} LibStrings;
+
+static uint32_t lib_strings_add(LibStrings* s, const char* str) {
+    size_t len = strlen(str) + 1;
+    if (s->size + len > s->cap) {
+        size_t newCap = s->cap ? s->cap * 2 : 4096;
+        while (newCap < s->size + len) newCap *= 2;
+        char* grown = realloc(s->data, newCap);
+        if (!grown) return LIB_NONE;
+        s->data = grown;
+        s->cap = newCap;
+    }
+    uint32_t offset = (uint32_t)s->size;
+    memcpy(s->data + s->size, str, len);
+    s->size += len;
+    return offset;
+}
+
+// 살아있는 항목만 모아서 새 인덱스 파일 작성 (임시 파일 + rename)
+static int lib_save_index(LuaLibrary* lib) {
+    LibStrings strings = {NULL, 0, 0};
+    uint32_t* dirMap = malloc(sizeof(uint32_t) * (lib->dirCount ? lib->dirCount : 1));
+    LibDirRecord* dirs = malloc(sizeof(LibDirRecord) * (lib->dirCount ? lib->dirCount : 1));
+    LibFileRecord* files = malloc(sizeof(LibFileRecord) * (lib->liveFiles ? lib->liveFiles : 1));
+    LibHeader h;
+    int ok = 0;
+
+    if (!dirMap || !dirs || !files) goto done;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LIB_MAGIC, 4);
+    h.version = LIB_VERSION;
+    h.root = lib_strings_add(&strings, lib->root);
+    if (h.root == LIB_NONE) goto done;
+
+    for (uint32_t i = 0; i < lib->dirCount; i++) {
+        LibDir* d = &lib->dirs[i];
+        dirMap[i] = LIB_NONE;
+        if (d->removed) continue;
+        LibDirRecord* r = &dirs[h.dirCount];
+        r->parent = d->parent == LIB_NONE ? LIB_NONE : dirMap[d->parent];
+        r->path = lib_strings_add(&strings, d->path);
+        r->mtime = d->mtime;
+        if (r->path == LIB_NONE) goto done;
+        dirMap[i] = h.dirCount++;
+    }
+    for (uint32_t i = 0; i < lib->fileCount; i++) {
+        LibFile* f = &lib->files[i];
+        if (f->removed || dirMap[f->dir] == LIB_NONE) continue;
+        LibFileRecord* r = &files[h.fileCount++];
+        memset(r, 0, sizeof(*r));
+        r->dir = dirMap[f->dir];
+        r->name = lib_strings_add(&strings, f->name);
+        r->size = f->size;
+        r->mtime = f->mtime;
+        r->durationMs = f->durationMs;
+        r->sampleRate = f->sampleRate;
+        r->channels = f->channels;
+        r->flags = f->flags;
+        if (r->name == LIB_NONE) goto done;
+    }
+    h.stringSize = (uint32_t)strings.size;
+
+    size_t tmpLen = strlen(lib->indexPath) + 5;
+    char* tmpPath = malloc(tmpLen);
+    if (!tmpPath) goto done;
+    snprintf(tmpPath, tmpLen, "%s.tmp", lib->indexPath);
+
+    FILE* out = fopen(tmpPath, "wb");
+    if (out) {
+        ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+             (h.dirCount == 0 || fwrite(dirs, sizeof(LibDirRecord), h.dirCount, out) == h.dirCount) &&
+             (h.fileCount == 0 || fwrite(files, sizeof(LibFileRecord), h.fileCount, out) == h.fileCount) &&
+             fwrite(strings.data, 1, strings.size, out) == strings.size;
+        ok = (fclose(out) == 0) && ok;
+        // 기존 mmap은 옛 inode를 계속 가리키므로 rename 후에도 안전
+        ok = ok && rename(tmpPath, lib->indexPath) == 0;
+        if (!ok) remove(tmpPath);
+    }
+    free(tmpPath);
+    if (ok) lib->modified = 0;
+
+done:
+    free(strings.data);
+    free(dirMap);
+    free(dirs);
+    free(files);
+    return ok;
+}
+
+// inotify 이벤트를 읽어서 해당 디렉토리를 dirty로 표시
+static int lib_drain_events(LuaLibrary* lib) {
+    int events = 0;
+    if (lib->inotifyFd < 0) return 0;
+
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(lib->inotifyFd, buf, sizeof(buf));
+        if (n <= 0) break;
+
+        for (char* p = buf; p < buf + n;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // 이벤트 유실 -> 전체 디렉토리 재확인
+                for (uint32_t i = 0; i < lib->dirCount; i++) lib->dirs[i].dirty = 1;
+                events++;
+                continue;
+            }
+            if (ev->wd < 0 || ev->wd >= lib->wdCap || lib->wdDir[ev->wd] == LIB_NONE) continue;
+            lib->dirs[lib->wdDir[ev->wd]].dirty = 1;
+            events++;
+        }
+    }
+    return events;
+}
+
+static void lib_free(LuaLibrary* lib) {
+    if (lib->closed) return;
+    lib->closed = 1;
+
+    for (uint32_t i = 0; i < lib->fileCount; i++) {
+        if (lib->files[i].ownsName) free((char*)lib->files[i].name);
+    }
+    for (uint32_t i = 0; i < lib->dirCount; i++) {
+        if (lib->dirs[i].ownsPath) free((char*)lib->dirs[i].path);
+    }
+    free(lib->files);
+    free(lib->dirs);
+    free(lib->dirHash);
+    free(lib->wdDir);
+    if (lib->inotifyFd >= 0) close(lib->inotifyFd);
+    if (lib->map) munmap(lib->map, lib->mapSize);
+    free(lib->indexPath);
+    free(lib->root);
+    memset(lib, 0, sizeof(*lib));
+    lib->closed = 1;
+    lib->inotifyFd = -1;
+}
+
+static LuaLibrary* check_library(lua_State* L) {
+    LuaLibrary* lib = (LuaLibrary*)luaL_checkudata(L, 1, LIBRARY_META);
+    if (lib->closed) luaL_error(L, "library is closed");
+    return lib;
+}
+
+// 라이브러리 열기
+// openLibrary(indexPath, rootDir [, opts])
+//   opts.recursive - 하위 디렉토리 포함 (기본 true)
+//   opts.probe     - 샘플레이트/채널/길이 조사 (기본 false)
+//   opts.watch     - inotify로 변경 감시, lib:update()로 반영 (기본 false)
+int l_library_open(lua_State* L) {
+    const char* indexPath = luaL_checkstring(L, 1);
+    const char* rootArg = luaL_checkstring(L, 2);
+    int recursive = 1;
+    int probe = 0;
+    int watch = 0;
+
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "recursive");
+        if (!lua_isnil(L, -1)) recursive = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "probe");
+        probe = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "watch");
+        watch = lua_toboolean(L, -1);
+        lua_pop(L, 3);
+    }
+
+    struct stat rootStat;
+    if (stat(rootArg, &rootStat) != 0 || !S_ISDIR(rootStat.st_mode)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Directory not found or access denied");
+        return 2;
+    }
+
+    LuaLibrary* lib = (LuaLibrary*)lua_newuserdata(L, sizeof(LuaLibrary));
+    memset(lib, 0, sizeof(*lib));
+    lib->inotifyFd = -1;
+    lib->closed = 1;  // 초기화가 끝날 때까지 __gc가 건드리지 않도록
+    luaL_getmetatable(L, LIBRARY_META);
+    lua_setmetatable(L, -2);
+
+    lib->indexPath = strdup(indexPath);
+    lib->root = strdup(rootArg);
+    if (!lib->indexPath || !lib->root) {
+        free(lib->indexPath);
+        free(lib->root);
+        lua_pushnil(L);
+        lua_pushstring(L, "Memory allocation failed");
+        return 2;
+    }
+    lib->closed = 0;
+    lib->probe = probe;
+    lib->recursive = recursive;
+
+    if (watch) {
+        lib->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+
+    if (lib_load_index(lib)) {
+        for (uint32_t i = 0; i < lib->dirCount; i++) lib_watch_dir(lib, i);
+        lib_refresh(lib);
+    } else {
+        // 인덱스가 없거나 맞지 않음 -> 전체 스캔
+        char* root = strdup(lib->root);
+        uint32_t index = root ? lib_add_dir(lib, root, 1, LIB_NONE, 0) : LIB_NONE;
+        if (index == LIB_NONE) {
+            free(root);
+            lib_free(lib);
+            lua_pushnil(L);
+            lua_pushstring(L, "Memory allocation failed");
+            return 2;
+        }
+        lib_watch_dir(lib, index);
+        lib_scan_dir(lib, index, lib_mtime_ns(&rootStat));
+    }
+
+    if (lib->modified) lib_save_index(lib);
+    return 1;
+}
+
+// 변경된 디렉토리 재스캔 (바뀐 파일 수 반환)
+static int l_library_refresh(lua_State* L) {
+    LuaLibrary* lib = check_library(L);
+    lua_pushinteger(L, lib_refresh(lib));
+    return 1;
+}
+
+// inotify 이벤트 반영 (바뀐 파일 수 반환)
+static int l_library_update(lua_State* L) {
+    LuaLibrary* lib = check_library(L);
+    if (lib_drain_events(lib) == 0) {
+        lua_pushinteger(L, 0);
+        return 1;
+    }
+
+    int changed = 0;
+    uint32_t count = lib->dirCount;
+    for (uint32_t i = 0; i < count; i++) {
+        LibDir* d = &lib->dirs[i];
+        if (d->removed || !d->dirty) continue;
+
+        struct stat st;
+        lib->statCalls++;
+        if (stat(d->path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            for (uint32_t f = d->firstFile; f != LIB_NONE; f = lib->files[f].nextInDir) changed++;
+            lib_remove_dir(lib, i);
+            continue;
+        }
+        changed += lib_scan_dir(lib, i, lib_mtime_ns(&st));
+    }
+    lua_pushinteger(L, changed);
+    return 1;
+}
+
+// 파일 목록
+static int l_library_files(lua_State* L) {
+    LuaLibrary* lib = check_library(L);
+    int withInfo = lua_toboolean(L, 2);
+    lua_Integer n = 0;
+
+    lua_createtable(L, (int)lib->liveFiles, 0);
+    for (uint32_t i = 0; i < lib->fileCount; i++) {
+        LibFile* f = &lib->files[i];
+        if (f->removed) continue;
+
+        char* path = lib_join(lib->dirs[f->dir].path, f->name);
+        if (!path) continue;
+
+        if (withInfo) {
+            lua_createtable(L, 0, 6);
+            lua_pushstring(L, path);
+            lua_setfield(L, -2, "path");
+            lua_pushinteger(L, (lua_Integer)f->size);
+            lua_setfield(L, -2, "size");
+            lua_pushnumber(L, (lua_Number)f->mtime / 1e9);
+            lua_setfield(L, -2, "mtime");
+            if (f->flags & LIB_FILE_PROBED) {
+                lua_pushnumber(L, f->durationMs / 1000.0);
+                lua_setfield(L, -2, "duration");
+                lua_pushinteger(L, f->sampleRate);
+                lua_setfield(L, -2, "sampleRate");
+                lua_pushinteger(L, f->channels);
+                lua_setfield(L, -2, "channels");
+            }
+        } else {
+            lua_pushstring(L, path);
+        }
+        free(path);
+        lua_rawseti(L, -2, ++n);
+    }
+    return 1;
+}
+
+static int l_library_count(lua_State* L) {
+    LuaLibrary* lib = check_library(L);
+    lua_pushinteger(L, lib->liveFiles);
+    return 1;
+}
+
+static int l_library_save(lua_State* L) {
+    LuaLibrary* lib = check_library(L);
+    if (!lib_save_index(lib)) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "Failed to write index: %s", lib->indexPath);
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// inotify fd (이벤트 루프에 등록용, 감시 안 하면 nil)
+static int l_library_fd(lua_State* L) {
+    LuaLibrary* lib = check_library(L);
+    if (lib->inotifyFd < 0) {
+        lua_pushnil(L);
+    } else {
+        lua_pushinteger(L, lib->inotifyFd);
+    }
+    return 1;
+}
+
+static int l_library_stats(lua_State* L) {
+    LuaLibrary* lib = check_library(L);
+    uint32_t dirs = 0;
+    for (uint32_t i = 0; i < lib->dirCount; i++) dirs += !lib->dirs[i].removed;
+
+    lua_createtable(L, 0, 7);
+    lua_pushinteger(L, dirs);
+    lua_setfield(L, -2, "dirs");
+    lua_pushinteger(L, lib->liveFiles);
+    lua_setfield(L, -2, "files");
+    lua_pushboolean(L, lib->loadedFromIndex);
+    lua_setfield(L, -2, "loadedFromIndex");
+    lua_pushinteger(L, lib->statCalls);
+    lua_setfield(L, -2, "statCalls");
+    lua_pushinteger(L, lib->rescannedDirs);
+    lua_setfield(L, -2, "rescannedDirs");
+    lua_pushinteger(L, lib->probedFiles);
+    lua_setfield(L, -2, "probedFiles");
+    lua_pushboolean(L, lib->inotifyFd >= 0);
+    lua_setfield(L, -2, "watching");
+    return 1;
+}
+
+// 변경 사항이 있으면 저장 후 닫기
+static int l_library_close(lua_State* L) {
+    LuaLibrary* lib = (LuaLibrary*)luaL_checkudata(L, 1, LIBRARY_META);
+    int ok = 1;
+    if (!lib->closed && lib->modified) ok = lib_save_index(lib);
+    lib_free(lib);
+    lua_pushboolean(L, ok);
+    return 1;
+}
+
+static int l_library_gc(lua_State* L) {
+    LuaLibrary* lib = (LuaLibrary*)luaL_checkudata(L, 1, LIBRARY_META);
+    lib_free(lib);
+    return 0;
+}
+
+static int l_library_tostring(lua_State* L) {
+    LuaLibrary* lib = (LuaLibrary*)luaL_checkudata(L, 1, LIBRARY_META);
+    if (lib->closed) {
+        lua_pushstring(L, "LuaLibrary(closed)");
+    } else {
+        lua_pushfstring(L, "LuaLibrary(%s, %d files)", lib->root, (int)lib->liveFiles);
+    }
+    return 1;
+}
+
+static const luaL_Reg library_meta[] = {
+    {"refresh", l_library_refresh},
+    {"update", l_library_update},
+    {"files", l_library_files},
+    {"count", l_library_count},
+    {"save", l_library_save},
+    {"fd", l_library_fd},
+    {"stats", l_library_stats},
+    {"close", l_library_close},
+    {"__gc", l_library_gc},
+    {"__tostring", l_library_tostring},
+    {NULL, NULL}};
+
+#else
+
+// 윈도우: mmap/inotify 기반 인덱스는 아직 지원하지 않음
+int l_library_open(lua_State* L) {
+    lua_pushnil(L);
+    lua_pushstring(L, "Library index is not supported on this platform");
+    return 2;
+}
+
+static const luaL_Reg library_meta[] = {
+    {NULL, NULL}};
+
+#endif
+
+// LuaLibrary 메타테이블 생성
+void create_library_metatable(lua_State* L) {
+    luaL_newmetatable(L, LIBRARY_META);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, library_meta, 0);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,432 @@
+/*
+ * stream.c - 스크립트가 PCM 블록을 계속 밀어 넣는 재생 스트림 (audio.newStream)
+ *
+ * Lua 사용법:
+ * local loop = require("loop")
+ * local stream = audio.newStream{channels = 2, rate = 48000, capacityFrames = 4800}
+ * local block = audio.newBuffer("f32", 480 * 2)   -- 블록 버퍼는 하나를 계속 재사용
+ * stream:write(block); stream:play()
+ * loop.spawn(function()
+ *     while true do
+ *         loop.event(stream:fd())                     -- 빈 공간이 생길 때까지 대기
+ *         while stream:writable() >= 480 do
+ *             render(block)                          -- 다음 블록 채우기
+ *             stream:write(block)
+ *         end
+ *     end
+ * end)
+ *
+ * ma_pcm_rb(f32) 링 버퍼를 엔진 그래프의 데이터 소스로 씀. 쓰는 쪽은 Lua 스레드 하나,
+ * 읽는 쪽은 오디오 스레드 하나라서 락 없이 동작하고, 블록마다 할당하지 않음.
+ * 데이터가 모자라면 무음으로 채우고 언더런으로 셈.
+ * fd()는 빈 공간이 signalFrames 이상이면 읽을 수 있게 되는 eventfd
+ * (다른 POSIX는 파이프, 윈도우는 자동 리셋 이벤트 핸들). 만든 직후와 언더런 때도 포함되고,
+ * write/writable을 부른 뒤에도 공간이 남아 있으면 바로 다시 신호가 걸림.
+ * close()는 기다리던 loop.event를 깨우고(이후 write 등은 "stream is closed" 에러),
+ * fd 자체는 __gc에서 닫음: 대기 중에 닫으면 epoll이 감시를 조용히 잃어 태스크가 깨어나지 않음.
+ */
+
+#include "lua.h"
+#include "lauxlib.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#include "miniaudio.h"
+
+#define STREAM_META "LuaStream"
+
+// audio.c
+extern ma_engine* audio_engine(void);
+
+// buffer.c
+extern void* audio_check_buffer(lua_State* L, int idx, int* kind, size_t* count);
+
+typedef struct {
+    ma_data_source_base base;  // 첫 멤버 (엔진이 데이터 소스로 읽음)
+    ma_pcm_rb rb;              // f32, 생산자 Lua / 소비자 오디오 스레드
+    ma_sound sound;
+    int sound_ready;
+    ma_uint32 signal_frames;   // 빈 공간이 이만큼 되면 신호
+    atomic_int signaled;       // 신호를 보냈고 아직 write/writable이 안 불림
+    atomic_ullong underruns;   // 데이터가 모자랐던 콜백 수
+    atomic_ullong silent;      // 무음으로 채운 프레임 수
+#ifdef _WIN32
+    HANDLE notify_event;       // 자동 리셋, 없으면 NULL
+#else
+    int notify_fd[2];          // [0] 읽는 쪽 (eventfd면 둘이 같음), 없으면 -1
+#endif
+} Stream;
+
+typedef struct {
+    Stream* stream;
+    int closed;                // close()로 재생은 끝났고 fd만 __gc까지 남음
+} LuaStream;
+
+// 알림 fd를 읽을 수 있게 만듦
+static void stream_notify(Stream* s) {
+#ifdef _WIN32
+    if (s->notify_event) SetEvent(s->notify_event);
+#else
+    if (s->notify_fd[1] < 0) return;
+    uint64_t one = 1;
+    ssize_t n = write(s->notify_fd[1], &one, sizeof(one));  // loop.event가 8바이트 카운터로 읽음
+    (void)n;
+#endif
+}
+
+// 오디오 스레드/Lua 스레드: 빈 공간이 충분하면 한 번만 알림
+static void stream_signal(Stream* s) {
+    if (ma_pcm_rb_available_write(&s->rb) < s->signal_frames) return;
+    if (atomic_exchange(&s->signaled, 1)) return;
+    stream_notify(s);
+}
+
+// write/writable 뒤: 다음 신호를 다시 걸고, 공간이 아직 충분하면 바로 알림
+static void stream_rearm(Stream* s) {
+    atomic_store(&s->signaled, 0);
+    stream_signal(s);
+}
+
+static ma_result stream_read(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead) {
+    Stream* s = (Stream*)pDataSource;
+    ma_uint32 channels = s->rb.channels;
+    float* out = (float*)pFramesOut;
+    ma_uint64 done = 0;
+
+    // 링 버퍼 끝에서 한 번 끊길 수 있어서 반복
+    while (done < frameCount) {
+        ma_uint64 want = frameCount - done;
+        ma_uint32 n = want > 0xFFFFFFFF ? 0xFFFFFFFF : (ma_uint32)want;
+        void* src;
+        if (ma_pcm_rb_acquire_read(&s->rb, &n, &src) != MA_SUCCESS || n == 0) break;
+        memcpy(out + done * channels, src, (size_t)n * channels * sizeof(float));
+        ma_pcm_rb_commit_read(&s->rb, n);
+        done += n;
+    }
+
+    // 끝(MA_AT_END)이 없는 소스라서 모자란 만큼 무음을 채워 항상 요청한 만큼 돌려줌
+    if (done < frameCount) {
+        memset(out + done * channels, 0, (size_t)(frameCount - done) * channels * sizeof(float));
+        atomic_fetch_add(&s->underruns, 1);
+        atomic_fetch_add(&s->silent, frameCount - done);
+    }
+    *pFramesRead = frameCount;
+
+    // 언더런(done == 0)이어도 공간은 비어 있으므로 알림
+    stream_signal(s);
+    return MA_SUCCESS;
+}
+
+static ma_result stream_seek(ma_data_source* pDataSource, ma_uint64 frameIndex) {
+    (void)pDataSource;
+    (void)frameIndex;
+    return MA_NOT_IMPLEMENTED;
+}
+
+static ma_result stream_get_data_format(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels,
+                                        ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap) {
+    Stream* s = (Stream*)pDataSource;
+    *pFormat = ma_format_f32;
+    *pChannels = s->rb.channels;
+    *pSampleRate = ma_pcm_rb_get_sample_rate(&s->rb);
+    ma_channel_map_init_standard(ma_standard_channel_map_default, pChannelMap, channelMapCap, s->rb.channels);
+    return MA_SUCCESS;
+}
+
+static ma_data_source_vtable stream_vtable = {
+    stream_read,
+    stream_seek,
+    stream_get_data_format,
+    NULL,  // 커서, 길이 없음
+    NULL,
+    NULL,
+    0};
+
+// 재생 자원 해제 (알림 fd는 남김)
+static void stream_release(Stream* s) {
+    if (s->sound_ready) ma_sound_uninit(&s->sound);  // 이후로 오디오 스레드가 읽지 않음
+    s->sound_ready = 0;
+    ma_data_source_uninit(&s->base);
+    ma_pcm_rb_uninit(&s->rb);
+}
+
+static void stream_free(Stream* s) {
+#ifdef _WIN32
+    if (s->notify_event) CloseHandle(s->notify_event);
+#else
+    if (s->notify_fd[0] >= 0) close(s->notify_fd[0]);
+    if (s->notify_fd[1] >= 0 && s->notify_fd[1] != s->notify_fd[0]) close(s->notify_fd[1]);
+#endif
+    free(s);
+}
+
+static int open_notify(Stream* s) {
+#if defined(_WIN32)
+    s->notify_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+    return s->notify_event != NULL;
+#elif defined(__linux__)
+    s->notify_fd[0] = s->notify_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return s->notify_fd[0] >= 0;
+#else
+    s->notify_fd[0] = s->notify_fd[1] = -1;
+    if (pipe(s->notify_fd) != 0) return 0;
+    for (int i = 0; i < 2; i++) {
+        fcntl(s->notify_fd[i], F_SETFL, fcntl(s->notify_fd[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(s->notify_fd[i], F_SETFD, FD_CLOEXEC);
+    }
+    return 1;
+#endif
+}
+
+static lua_Integer opt_field(lua_State* L, int idx, const char* name, lua_Integer def) {
+    lua_getfield(L, idx, name);
+    lua_Integer v = lua_isnil(L, -1) ? def : luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+    return v;
+}
+
+// newStream{channels = 2, rate = 엔진 레이트, capacityFrames = rate / 10, signalFrames = capacityFrames / 2}
+int l_stream_new(lua_State* L) {
+    ma_engine* engine = audio_engine();
+    if (lua_isnoneornil(L, 1)) {
+        lua_settop(L, 0);
+        lua_newtable(L);
+    }
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    if (!engine) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Audio system not initialized");
+        return 2;
+    }
+
+    lua_Integer channels = opt_field(L, 1, "channels", 2);
+    lua_Integer rate = opt_field(L, 1, "rate", ma_engine_get_sample_rate(engine));
+    luaL_argcheck(L, channels > 0 && channels <= MA_MAX_CHANNELS, 1, "invalid channel count");
+    luaL_argcheck(L, rate > 0 && rate <= ma_standard_sample_rate_max, 1, "invalid sample rate");
+    lua_Integer capacity = opt_field(L, 1, "capacityFrames", rate / 10);
+    luaL_argcheck(L, capacity > 0 && capacity <= 0x7FFFFFFF / channels, 1, "invalid capacityFrames");
+    lua_Integer signal_frames = opt_field(L, 1, "signalFrames", capacity / 2 > 0 ? capacity / 2 : 1);
+    luaL_argcheck(L, signal_frames > 0 && signal_frames <= capacity, 1, "signalFrames must be in 1..capacityFrames");
+
+    LuaStream* lua_stream = (LuaStream*)lua_newuserdata(L, sizeof(LuaStream));
+    lua_stream->stream = NULL;
+    lua_stream->closed = 0;
+    luaL_getmetatable(L, STREAM_META);
+    lua_setmetatable(L, -2);
+
+    Stream* s = (Stream*)calloc(1, sizeof(Stream));
+    if (!s) return luaL_error(L, "Memory allocation failed");
+    s->signal_frames = (ma_uint32)signal_frames;
+    atomic_init(&s->signaled, 0);
+    atomic_init(&s->underruns, 0);
+    atomic_init(&s->silent, 0);
+
+    ma_data_source_config config = ma_data_source_config_init();
+    config.vtable = &stream_vtable;
+    if (ma_pcm_rb_init(ma_format_f32, (ma_uint32)channels, (ma_uint32)capacity, NULL, NULL, &s->rb) != MA_SUCCESS) {
+        free(s);
+        return luaL_error(L, "Memory allocation failed");
+    }
+    ma_pcm_rb_set_sample_rate(&s->rb, (ma_uint32)rate);
+
+    const char* error = NULL;
+    if (ma_data_source_init(&config, &s->base) != MA_SUCCESS) {
+        ma_pcm_rb_uninit(&s->rb);
+        free(s);
+        return luaL_error(L, "Failed to create stream");
+    }
+    if (!open_notify(s)) {
+        error = "Failed to create stream notification fd";
+    } else if (ma_sound_init_from_data_source(engine, s, 0, NULL, &s->sound) != MA_SUCCESS) {
+        error = "Failed to create stream sound";
+    } else {
+        s->sound_ready = 1;
+    }
+    if (error) {
+        stream_release(s);
+        stream_free(s);
+        lua_pushnil(L);
+        lua_pushstring(L, error);
+        return 2;
+    }
+
+    lua_stream->stream = s;
+    stream_signal(s);  // 비어 있으니 처음부터 쓸 수 있음
+    return 1;
+}
+
+static Stream* check_stream(lua_State* L, int idx) {
+    LuaStream* lua_stream = (LuaStream*)luaL_checkudata(L, idx, STREAM_META);
+    if (!lua_stream->stream || lua_stream->closed) luaL_error(L, "stream is closed");
+    return lua_stream->stream;
+}
+
+// write(buffer [, fromFrame]): 들어가는 만큼 쓰고 쓴 프레임 수를 돌려줌 (막히지 않음)
+// 버퍼 종류는 아무거나 (f32가 아니면 쓰면서 변환), 원소 수는 채널 수의 배수
+static int l_stream_write(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+    int kind;
+    size_t count;
+    const char* src = (const char*)audio_check_buffer(L, 2, &kind, &count);
+    ma_uint32 channels = s->rb.channels;
+    luaL_argcheck(L, count % channels == 0, 2, "buffer size is not a multiple of channels");
+
+    ma_uint64 frames = count / channels;
+    lua_Integer from = luaL_optinteger(L, 3, 1);
+    luaL_argcheck(L, from >= 1 && (ma_uint64)from <= frames + 1, 3, "frame index out of range");
+    size_t frame_bytes = (size_t)channels * ma_get_bytes_per_sample((ma_format)kind);
+    src += (size_t)(from - 1) * frame_bytes;
+    frames -= (ma_uint64)(from - 1);
+
+    ma_uint64 done = 0;
+    while (done < frames) {
+        ma_uint64 want = frames - done;
+        ma_uint32 n = want > 0xFFFFFFFF ? 0xFFFFFFFF : (ma_uint32)want;
+        void* dst;
+        if (ma_pcm_rb_acquire_write(&s->rb, &n, &dst) != MA_SUCCESS || n == 0) break;
+        ma_pcm_convert(dst, ma_format_f32, src + done * frame_bytes, (ma_format)kind, (ma_uint64)n * channels, ma_dither_mode_none);
+        ma_pcm_rb_commit_write(&s->rb, n);
+        done += n;
+    }
+
+    stream_rearm(s);
+    lua_pushinteger(L, (lua_Integer)done);
+    return 1;
+}
+
+// 지금 쓸 수 있는 프레임 수
+static int l_stream_writable(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+    ma_uint32 frames = ma_pcm_rb_available_write(&s->rb);
+    stream_rearm(s);
+    lua_pushinteger(L, frames);
+    return 1;
+}
+
+// 쓰고 아직 재생되지 않은 프레임 수 (지연 시간)
+static int l_stream_queued(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+    lua_pushinteger(L, ma_pcm_rb_available_read(&s->rb));
+    return 1;
+}
+
+// 언더런 횟수, 무음으로 채운 프레임 수
+static int l_stream_underruns(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+    lua_pushinteger(L, (lua_Integer)atomic_load(&s->underruns));
+    lua_pushinteger(L, (lua_Integer)atomic_load(&s->silent));
+    return 2;
+}
+
+// 빈 공간 알림 fd (loop.event에 넘김), 지원하지 않으면 nil
+static int l_stream_fd(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+#ifdef _WIN32
+    lua_pushinteger(L, (lua_Integer)(intptr_t)s->notify_event);  // loop.event는 윈도우에서 이벤트 핸들을 받음
+#else
+    if (s->notify_fd[0] < 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushinteger(L, s->notify_fd[0]);
+#endif
+    return 1;
+}
+
+static int l_stream_play(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+    lua_pushboolean(L, ma_sound_start(&s->sound) == MA_SUCCESS);
+    return 1;
+}
+
+static int l_stream_stop(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+    lua_pushboolean(L, ma_sound_stop(&s->sound) == MA_SUCCESS);
+    return 1;
+}
+
+static int l_stream_set_volume(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+    float volume = (float)luaL_checknumber(L, 2);
+    if (volume < 0.0f) volume = 0.0f;
+    if (volume > 1.0f) volume = 1.0f;
+    ma_sound_set_volume(&s->sound, volume);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int l_stream_is_playing(lua_State* L) {
+    Stream* s = check_stream(L, 1);
+    lua_pushboolean(L, ma_sound_is_playing(&s->sound));
+    return 1;
+}
+
+// 재생을 멈추고 링 버퍼를 해제. fd를 기다리던 loop.event는 깨어남 (fd는 __gc에서 닫음)
+static int l_stream_close(lua_State* L) {
+    LuaStream* lua_stream = (LuaStream*)luaL_checkudata(L, 1, STREAM_META);
+    if (lua_stream->stream && !lua_stream->closed) {
+        stream_release(lua_stream->stream);
+        stream_notify(lua_stream->stream);
+        lua_stream->closed = 1;
+    }
+    return 0;
+}
+
+static int l_stream_gc(lua_State* L) {
+    LuaStream* lua_stream = (LuaStream*)luaL_checkudata(L, 1, STREAM_META);
+    l_stream_close(L);
+    if (lua_stream->stream) {
+        stream_free(lua_stream->stream);
+        lua_stream->stream = NULL;
+    }
+    return 0;
+}
+
+static int l_stream_tostring(lua_State* L) {
+    LuaStream* lua_stream = (LuaStream*)luaL_checkudata(L, 1, STREAM_META);
+    Stream* s = lua_stream->stream;
+    if (!s || lua_stream->closed) {
+        lua_pushstring(L, "LuaStream(closed)");
+        return 1;
+    }
+    lua_pushfstring(L, "LuaStream(%d ch, %d Hz, %d frames)", (int)s->rb.channels,
+                    (int)ma_pcm_rb_get_sample_rate(&s->rb), (int)ma_pcm_rb_get_subbuffer_size(&s->rb));
+    return 1;
+}
+
+static const luaL_Reg stream_meta[] = {
+    {"write", l_stream_write},
+    {"writable", l_stream_writable},
+    {"queued", l_stream_queued},
+    {"underruns", l_stream_underruns},
+    {"fd", l_stream_fd},
+    {"play", l_stream_play},
+    {"stop", l_stream_stop},
+    {"setVolume", l_stream_set_volume},
+    {"isPlaying", l_stream_is_playing},
+    {"close", l_stream_close},
+    {"__gc", l_stream_gc},
+    {"__tostring", l_stream_tostring},
+    {NULL, NULL}};
+
+// LuaStream 메타테이블 생성
+void create_stream_metatable(lua_State* L) {
+    luaL_newmetatable(L, STREAM_META);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, stream_meta, 0);
+    lua_pop(L, 1);
+}
@@ -8,9 +8,12 @@
  * - getch() - 키 입력 받기
  * - cls() - 화면 지우기
  * - beep() - 비프음
- * - scanMusicFiles() - 음악 파일 스캔
- * - fileExists() - 파일 존재 확인
- * - dirExists() - 디렉토리 존재 확인
+ * - scanMusicFiles(dir [, opts]) - 음악 파일 스캔 (재귀/병렬/배치 콜백 지원)
+ * - fileExists() - 파일 존재 확인 (lua_loader의 loop 태스크 안에서는 작업 풀에서 실행)
+ * - dirExists() - 디렉토리 존재 확인 (위와 같음)
+ * - statMany(paths) - 여러 경로 일괄 stat (리눅스: io_uring, 미지원 시 스레드 풀)
+ * - now() - 단조 증가 시계 (나노초)
+ * - pacer(hz [, spinMicros]) - 절대 데드라인 기반 프레임 페이서
  */
 
 #include "lua.h"
@@ -18,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -34,6 +38,22 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <strings.h>   // strcasecmp용
+#include <pthread.h>   // 디렉토리 스캔 스레드 풀용
+#include <stdatomic.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// IORING_OP_STATX는 5.6 헤더부터 있음
+#ifdef IORING_FEAT_RW_CUR_POS
+#define STAT_HAVE_IO_URING
+#include <linux/stat.h>  // struct statx, STATX_*
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
 #endif
 
 // 크로스플랫폼 대소문자 무관 문자열 비교
@@ -45,8 +65,8 @@ static int stricmp_cross(const char* s1, const char* s2) {
 #endif
 }
 
-// 파일 확장자 확인 함수
-static int has_music_extension(const char* filename) {
+// 파일 확장자 확인 함수 (library.c에서도 사용)
+int has_music_extension(const char* filename) {
     const char* ext = strrchr(filename, '.');
     if (!ext) return 0;
     
@@ -209,6 +229,7 @@ int l_getch(lua_State* L) {
 
 // 화면 지우기
 int l_cls(lua_State* L) {
+    (void)L;
 #ifdef _WIN32
     int ret = system("cls");
     (void)ret;  // 반환값 사용하지 않음을 명시
@@ -240,7 +261,7 @@ int l_beep(lua_State* L) {
 // 현재 시간 (밀리초)
 int l_tick(lua_State* L) {
 #ifdef _WIN32
-    lua_pushinteger(L, GetTickCount());
+    lua_pushinteger(L, (lua_Integer)GetTickCount64());  // 32비트 GetTickCount는 49일마다 되돌아감
 #else
     struct timespec ts;
     if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
@@ -253,8 +274,229 @@ int l_tick(lua_State* L) {
     return 1;
 }
 
+// 단조 증가 시계 (나노초)
+static long long now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    // counter * 1e9 / freq는 오버플로우되므로 나눠서 계산
+    long long seconds = counter.QuadPart / freq.QuadPart;
+    long long rest = counter.QuadPart % freq.QuadPart;
+    return seconds * 1000000000LL + rest * 1000000000LL / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// 현재 시간 (나노초)
+int l_now(lua_State* L) {
+    lua_pushinteger(L, now_ns());
+    return 1;
+}
+
+// 프레임 페이서 (Lua userdata용)
+typedef struct {
+    long long period;       // 프레임 간격 (ns)
+    long long deadline;     // 다음 깨어날 절대 시각 (ns)
+    long long spin;         // 데드라인 직전 바쁜 대기 구간 (ns)
+    lua_Integer frames;
+    lua_Integer missed;     // 한 프레임 이상 늦어서 데드라인을 다시 잡은 횟수
+    double lateSum;         // 지터 통계 (ns)
+    double lateSqSum;
+    long long lateMax;
+#ifdef _WIN32
+    HANDLE timer;           // 고해상도 대기 타이머, 만들 수 없으면 NULL (Sleep + timeBeginPeriod)
+#endif
+} LuaPacer;
+
+#define PACER_META "LuaPacer"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// deadline 까지 잠들었다가 마지막 spin 구간은 바쁜 대기
+static void pacer_sleep_until(LuaPacer* pacer, long long deadline, long long spin) {
+    long long wake = deadline - spin;
+#ifdef _WIN32
+    // Sleep은 타이머 틱(기본 15.6ms) 단위로만 깨므로 고해상도 타이머로 기다림
+    long long remaining = wake - now_ns();
+    if (pacer->timer && remaining >= 100) {
+        LARGE_INTEGER due;
+        due.QuadPart = -(remaining / 100);  // 음수는 상대 시간, 100ns 단위
+        if (SetWaitableTimer(pacer->timer, &due, 0, NULL, NULL, FALSE)) WaitForSingleObject(pacer->timer, INFINITE);
+    } else if (remaining > 1000000LL) {
+        timeBeginPeriod(1);
+        Sleep((DWORD)(remaining / 1000000LL));
+        timeEndPeriod(1);
+    }
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)(wake / 1000000000LL);
+    ts.tv_nsec = (long)(wake % 1000000000LL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+    (void)pacer;  // 타이머 핸들은 윈도우 전용
+#endif
+    while (now_ns() < deadline) {
+    }
+}
+
+// hz의 주기 (ns). 0ns가 되거나 long long을 넘는 주기는 거부
+static long long check_period(lua_State* L, int idx) {
+    double hz = luaL_checknumber(L, idx);
+    double period = hz > 0 ? 1e9 / hz : 0;
+    luaL_argcheck(L, period >= 1.0 && period <= 1e18, idx, "rate must be in 1e-9..1e9 Hz");
+    return (long long)period;
+}
+
+// 페이서 생성: pacer(hz [, spinMicros])
+int l_pacer(lua_State* L) {
+    long long period = check_period(L, 1);
+    double spinMicros = luaL_optnumber(L, 2, 0);
+    luaL_argcheck(L, spinMicros >= 0, 2, "spin must not be negative");
+
+    LuaPacer* pacer = (LuaPacer*)lua_newuserdata(L, sizeof(LuaPacer));
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->period = period;
+    pacer->spin = (long long)(spinMicros * 1000.0);
+    pacer->deadline = now_ns() + pacer->period;
+#ifdef _WIN32
+    // Windows 10 1803 이전에는 실패함
+    pacer->timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+
+    luaL_getmetatable(L, PACER_META);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+// 다음 데드라인까지 대기. 늦은 시간(초) 반환
+static int l_pacer_wait(lua_State* L) {
+    LuaPacer* pacer = (LuaPacer*)luaL_checkudata(L, 1, PACER_META);
+
+    long long now = now_ns();
+    if (now < pacer->deadline) {
+        pacer_sleep_until(pacer, pacer->deadline, pacer->spin);
+        now = now_ns();
+    }
+
+    long long late = now - pacer->deadline;
+    pacer->frames++;
+    pacer->lateSum += (double)late;
+    pacer->lateSqSum += (double)late * (double)late;
+    if (late > pacer->lateMax) pacer->lateMax = late;
+
+    if (late >= pacer->period) {
+        // 한 프레임 이상 밀렸으면 몰아서 따라잡지 않고 지금부터 다시 시작
+        pacer->missed++;
+        pacer->deadline = now + pacer->period;
+    } else {
+        pacer->deadline += pacer->period;
+    }
+
+    lua_pushnumber(L, late / 1e9);
+    return 1;
+}
+
+// 지터 통계 (초 단위)
+static int l_pacer_stats(lua_State* L) {
+    LuaPacer* pacer = (LuaPacer*)luaL_checkudata(L, 1, PACER_META);
+    double mean = 0.0;
+    double stddev = 0.0;
+
+    if (pacer->frames > 0) {
+        mean = pacer->lateSum / (double)pacer->frames;
+        double variance = pacer->lateSqSum / (double)pacer->frames - mean * mean;
+        stddev = variance > 0.0 ? sqrt(variance) : 0.0;
+    }
+
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, pacer->frames);
+    lua_setfield(L, -2, "frames");
+    lua_pushinteger(L, pacer->missed);
+    lua_setfield(L, -2, "missed");
+    lua_pushnumber(L, pacer->period / 1e9);
+    lua_setfield(L, -2, "period");
+    lua_pushnumber(L, mean / 1e9);
+    lua_setfield(L, -2, "jitterMean");
+    lua_pushnumber(L, stddev / 1e9);
+    lua_setfield(L, -2, "jitterStd");
+    lua_pushnumber(L, pacer->lateMax / 1e9);
+    lua_setfield(L, -2, "jitterMax");
+    return 1;
+}
+
+// 통계 초기화 및 데드라인 재설정
+static int l_pacer_reset(lua_State* L) {
+    LuaPacer* pacer = (LuaPacer*)luaL_checkudata(L, 1, PACER_META);
+    long long period = pacer->period;
+    long long spin = pacer->spin;
+#ifdef _WIN32
+    HANDLE timer = pacer->timer;
+#endif
+
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->period = period;
+    pacer->spin = spin;
+    pacer->deadline = now_ns() + period;
+#ifdef _WIN32
+    pacer->timer = timer;
+#endif
+    return 0;
+}
+
+// 주기 변경 (다음 프레임부터 적용)
+static int l_pacer_set_rate(lua_State* L) {
+    LuaPacer* pacer = (LuaPacer*)luaL_checkudata(L, 1, PACER_META);
+    long long period = check_period(L, 2);
+    pacer->deadline += period - pacer->period;
+    pacer->period = period;
+    return 0;
+}
+
+static int l_pacer_tostring(lua_State* L) {
+    LuaPacer* pacer = (LuaPacer*)luaL_checkudata(L, 1, PACER_META);
+    lua_pushfstring(L, "LuaPacer(%f Hz)", 1e9 / (double)pacer->period);
+    return 1;
+}
+
+static int l_pacer_gc(lua_State* L) {
+    LuaPacer* pacer = (LuaPacer*)luaL_checkudata(L, 1, PACER_META);
+#ifdef _WIN32
+    if (pacer->timer) CloseHandle(pacer->timer);
+    pacer->timer = NULL;
+#else
+    (void)pacer;
+#endif
+    return 0;
+}
+
+static const luaL_Reg pacer_meta[] = {
+    {"wait", l_pacer_wait},
+    {"stats", l_pacer_stats},
+    {"reset", l_pacer_reset},
+    {"setRate", l_pacer_set_rate},
+    {"__gc", l_pacer_gc},
+    {"__tostring", l_pacer_tostring},
+    {NULL, NULL}};
+
+// LuaPacer 메타테이블 생성
+void create_pacer_metatable(lua_State* L) {
+    luaL_newmetatable(L, PACER_META);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, pacer_meta, 0);
+    lua_pop(L, 1);
+}
+
 // CPU 사용량 최소화 대기
 int l_yield(lua_State* L) {
+    (void)L;
 #ifdef _WIN32
     Sleep(0);  // 다른 스레드에게 시간 양보
 #else
@@ -263,163 +505,1102 @@ int l_yield(lua_State* L) {
     return 0;
 }
 
-// 디렉토리에서 음악 파일 목록을 가져와서 Lua 테이블로 반환
-int l_scan_music_files(lua_State* L) {
-    const char* directory = luaL_checkstring(L, 1);
-    
-    lua_newtable(L);  // 결과 테이블 생성
-    int index = 1;
-    
+// 스캔 결과 전달용 (테이블에 누적하거나 콜백으로 배치 전달)
+typedef struct {
+    lua_State* L;
+    int callback;        // 콜백 함수 스택 인덱스 (0이면 테이블 모드)
+    int table;           // 결과 테이블 스택 인덱스 (테이블 모드)
+    lua_Integer count;   // 지금까지 전달한 파일 수
+    int stopped;         // 콜백이 false를 반환하면 1
+} ScanSink;
+
+typedef struct {
+    ScanSink* sink;
+    char** paths;
+    int n;
+} ScanDelivery;
+
+// scan_sink_deliver의 보호 모드 본체: 1 = 결과 테이블 또는 콜백, 2 = ScanDelivery
+static int scan_deliver_batch(lua_State* L) {
+    ScanDelivery* d = (ScanDelivery*)lua_touserdata(L, 2);
+
+    if (d->sink->callback == 0) {
+        for (int i = 0; i < d->n; i++) {
+            lua_pushstring(L, d->paths[i]);
+            lua_rawseti(L, 1, ++d->sink->count);
+        }
+        return 0;
+    }
+
+    lua_pushvalue(L, 1);
+    lua_createtable(L, d->n, 0);
+    for (int i = 0; i < d->n; i++) {
+        lua_pushstring(L, d->paths[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    d->sink->count += d->n;
+    lua_call(L, 1, 1);
+    return 1;
+}
+
+// 경로 배치를 Lua로 전달. 콜백 에러 시 에러 메시지를 스택에 남기고 0이 아닌 값 반환
+// 스캔 워커가 살아 있는 동안 불리므로 할당은 전부 lua_pcall 안에서 함:
+// 메모리 에러가 longjmp로 빠져나가면 워커들이 해제된 풀을 계속 쓰게 됨.
+// 바깥에서 쌓는 3칸은 C 함수에 보장된 LUA_MINSTACK 안이라 스택을 늘리지 않음
+static int scan_sink_deliver(ScanSink* sink, char** paths, int n) {
+    lua_State* L = sink->L;
+    ScanDelivery delivery = {sink, paths, n};
+
+    lua_pushcfunction(L, scan_deliver_batch);
+    lua_pushvalue(L, sink->callback != 0 ? sink->callback : sink->table);
+    lua_pushlightuserdata(L, &delivery);
+    int status = lua_pcall(L, 2, 1, 0);
+    if (status != LUA_OK) return status;
+
+    // 콜백이 명시적으로 false를 반환하면 스캔 중단
+    if (sink->callback != 0 && lua_isboolean(L, -1) && !lua_toboolean(L, -1)) sink->stopped = 1;
+    lua_pop(L, 1);
+    return LUA_OK;
+}
+
+// "dir" + 구분자 + "name" 경로를 새로 할당해서 반환
+static char* scan_join_path(const char* dir, const char* name, char sep) {
+    size_t dirLen = strlen(dir);
+    size_t nameLen = strlen(name);
+    char* path = malloc(dirLen + nameLen + 2);
+    if (!path) return NULL;
+
+    memcpy(path, dir, dirLen);
+    // 루트("/")처럼 이미 구분자로 끝나면 추가하지 않음
+    if (dirLen > 0 && dir[dirLen - 1] != sep) path[dirLen++] = sep;
+    memcpy(path + dirLen, name, nameLen + 1);
+    return path;
+}
+
 #ifdef _WIN32
-    // 윈도우: FindFirstFile/FindNextFile 사용
-    WIN32_FIND_DATAW findData;
-    HANDLE hFind;
-    
-    // 검색 패턴 생성 (directory\*.*)
-    size_t pathLen = strlen(directory);
-    char* searchPath = malloc(pathLen + 10);
-    if (!searchPath) {
-        lua_pushnil(L);
+// 윈도우: FindFirstFile/FindNextFile 기반 순차 스캔 (하위 디렉토리는 명시적 스택으로 순회)
+static int scan_walk(ScanSink* sink, const char* directory, int recursive, int batchSize) {
+    lua_State* L = sink->L;
+    char** batch = malloc(sizeof(char*) * batchSize);
+    char** stack = malloc(sizeof(char*) * 16);
+    int stackCap = 16;
+    int stackTop = 0;
+    int batchCount = 0;
+    int status = LUA_OK;
+
+    if (!batch || !stack) {
+        free(batch);
+        free(stack);
         lua_pushstring(L, "Memory allocation failed");
-        return 2;
+        return LUA_ERRMEM;
     }
-    sprintf(searchPath, "%s\\*.*", directory);
-    
-    // UTF-8을 UTF-16으로 변환
-    wchar_t* wSearchPath = utf8_to_utf16(searchPath);
-    free(searchPath);
-    
-    if (!wSearchPath) {
-        lua_pushnil(L);
-        lua_pushstring(L, "Path encoding conversion failed");
-        return 2;
+
+    stack[stackTop++] = _strdup(directory);
+    int isRoot = 1;
+
+    while (stackTop > 0 && status == LUA_OK && !sink->stopped) {
+        char* dirPath = stack[--stackTop];
+        if (!dirPath) continue;
+
+        // 검색 패턴 생성 (directory\*.*)
+        char* searchPath = scan_join_path(dirPath, "*.*", '\\');
+        wchar_t* wSearchPath = searchPath ? utf8_to_utf16(searchPath) : NULL;
+        free(searchPath);
+
+        WIN32_FIND_DATAW findData;
+        HANDLE hFind = wSearchPath ? FindFirstFileW(wSearchPath, &findData) : INVALID_HANDLE_VALUE;
+        free(wSearchPath);
+
+        if (hFind == INVALID_HANDLE_VALUE) {
+            free(dirPath);
+            if (isRoot) {
+                lua_pushstring(L, "Directory not found or access denied");
+                status = LUA_ERRFILE;
+            }
+            continue;
+        }
+        isRoot = 0;
+
+        do {
+            // UTF-16을 UTF-8로 변환
+            char* filename = utf16_to_utf8(findData.cFileName);
+            if (!filename) continue;
+
+            // 숨김 파일과 ".", ".." 건너뛰기
+            if (filename[0] == '.') {
+                free(filename);
+                continue;
+            }
+
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                if (recursive) {
+                    if (stackTop == stackCap) {
+                        char** grown = realloc(stack, sizeof(char*) * stackCap * 2);
+                        if (grown) {
+                            stack = grown;
+                            stackCap *= 2;
+                        }
+                    }
+                    if (stackTop < stackCap) stack[stackTop++] = scan_join_path(dirPath, filename, '\\');
+                }
+            } else if (has_music_extension(filename)) {
+                char* fullPath = scan_join_path(dirPath, filename, '\\');
+                if (fullPath) batch[batchCount++] = fullPath;
+            }
+
+            free(filename);
+
+            if (batchCount == batchSize) {
+                status = scan_sink_deliver(sink, batch, batchCount);
+                for (int i = 0; i < batchCount; i++) free(batch[i]);
+                batchCount = 0;
+            }
+        } while (status == LUA_OK && !sink->stopped && FindNextFileW(hFind, &findData));
+
+        FindClose(hFind);
+        free(dirPath);
     }
-    
-    hFind = FindFirstFileW(wSearchPath, &findData);
-    free(wSearchPath);
-    
-    if (hFind == INVALID_HANDLE_VALUE) {
-        lua_pushnil(L);
-        lua_pushstring(L, "Directory not found or access denied");
-        return 2;
+
+    if (status == LUA_OK && batchCount > 0 && !sink->stopped) {
+        status = scan_sink_deliver(sink, batch, batchCount);
     }
-    
-    do {
-        // 디렉토리는 건너뛰기
-        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            continue;
+    for (int i = 0; i < batchCount; i++) free(batch[i]);
+    while (stackTop > 0) free(stack[--stackTop]);
+    free(stack);
+    free(batch);
+    return status;
+}
+#else
+/*
+ * 리눅스/Unix: 워크 스틸링 스레드 풀 기반 병렬 스캔
+ *
+ * - 워커마다 디렉토리 덱(deque)을 가짐. 자기 덱은 뒤에서 꺼내고(깊이 우선),
+ *   일이 없으면 다른 워커 덱의 앞에서 훔쳐옴
+ * - readdir의 d_type을 우선 사용하고, DT_UNKNOWN/DT_LNK일 때만 fstatat 호출
+ * - 찾은 파일은 배치 단위로 결과 큐에 넣고, Lua 스레드(호출자)가 꺼내서 전달
+ */
+#define SCAN_MAX_THREADS 16
+#define SCAN_MAX_QUEUED_BATCHES 64
+
+typedef struct ScanBatch {
+    struct ScanBatch* next;
+    int count;
+    char* paths[];
+} ScanBatch;
+
+typedef struct {
+    pthread_mutex_t lock;
+    char** items;
+    size_t head;   // 도둑은 앞(head)에서 가져감
+    size_t tail;   // 소유자는 뒤(tail)에서 넣고 꺼냄
+    size_t cap;
+} ScanDeque;
+
+typedef struct ScanPool ScanPool;
+
+typedef struct {
+    ScanPool* pool;
+    int id;
+    ScanDeque deque;
+    ScanBatch* batch;   // 채우는 중인 결과 배치
+} ScanWorker;
+
+struct ScanPool {
+    ScanWorker* workers;
+    int workerCount;
+    int recursive;
+    int batchSize;
+
+    atomic_long pending;     // 아직 처리되지 않은 디렉토리 수
+    atomic_ulong workSeq;    // 덱에 작업이 추가될 때마다 증가
+    atomic_int idleCount;
+    atomic_int cancelled;
+    pthread_mutex_t idleLock;
+    pthread_cond_t idleCond;
+
+    // 결과 배치 큐 (워커 -> Lua 스레드)
+    pthread_mutex_t resultLock;
+    pthread_cond_t resultReady;
+    pthread_cond_t resultSpace;
+    ScanBatch* resultHead;
+    ScanBatch* resultTail;
+    int resultQueued;
+    int workersRunning;
+};
+
+static int scan_deque_push(ScanDeque* dq, char* path) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->cap) {
+        // 앞쪽 빈 공간을 먼저 회수하고, 그래도 부족하면 확장
+        if (dq->head > 0) {
+            memmove(dq->items, dq->items + dq->head, (dq->tail - dq->head) * sizeof(char*));
+            dq->tail -= dq->head;
+            dq->head = 0;
         }
-        
-        // UTF-16을 UTF-8로 변환
-        char* filename = utf16_to_utf8(findData.cFileName);
-        if (!filename) continue;
-        
-        // 음악 파일 확장자 확인
-        if (has_music_extension(filename)) {
-            // 전체 경로 생성
-            size_t fullPathLen = strlen(directory) + strlen(filename) + 2;
-            char* fullPath = malloc(fullPathLen);
-            if (fullPath) {
-                sprintf(fullPath, "%s\\%s", directory, filename);
-                
-                // Lua 테이블에 추가
-                lua_pushstring(L, fullPath);
-                lua_rawseti(L, -2, index++);
-                
-                free(fullPath);
+        if (dq->tail == dq->cap) {
+            size_t newCap = dq->cap ? dq->cap * 2 : 64;
+            char** grown = realloc(dq->items, newCap * sizeof(char*));
+            if (!grown) {
+                pthread_mutex_unlock(&dq->lock);
+                return 0;
             }
+            dq->items = grown;
+            dq->cap = newCap;
         }
-        
-        free(filename);
-    } while (FindNextFileW(hFind, &findData));
-    
-    FindClose(hFind);
-    
-#else
-    // 리눅스/Unix: opendir/readdir 사용
-    DIR* dir = opendir(directory);
+    }
+    dq->items[dq->tail++] = path;
+    pthread_mutex_unlock(&dq->lock);
+    return 1;
+}
+
+static char* scan_deque_pop(ScanDeque* dq) {
+    char* path = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) path = dq->items[--dq->tail];
+    pthread_mutex_unlock(&dq->lock);
+    return path;
+}
+
+static char* scan_deque_steal(ScanDeque* dq) {
+    char* path = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) path = dq->items[dq->head++];
+    pthread_mutex_unlock(&dq->lock);
+    return path;
+}
+
+// 결과 배치를 큐에 넣음. Lua 쪽이 밀려 있으면 공간이 날 때까지 대기
+static void scan_publish_batch(ScanWorker* w) {
+    ScanPool* pool = w->pool;
+    ScanBatch* batch = w->batch;
+    if (!batch || batch->count == 0) return;
+    w->batch = NULL;
+
+    pthread_mutex_lock(&pool->resultLock);
+    while (pool->resultQueued >= SCAN_MAX_QUEUED_BATCHES && !atomic_load(&pool->cancelled)) {
+        pthread_cond_wait(&pool->resultSpace, &pool->resultLock);
+    }
+    batch->next = NULL;
+    if (pool->resultTail) {
+        pool->resultTail->next = batch;
+    } else {
+        pool->resultHead = batch;
+    }
+    pool->resultTail = batch;
+    pool->resultQueued++;
+    pthread_cond_signal(&pool->resultReady);
+    pthread_mutex_unlock(&pool->resultLock);
+}
+
+static void scan_emit(ScanWorker* w, char* path) {
+    ScanPool* pool = w->pool;
+    if (!w->batch) {
+        w->batch = malloc(sizeof(ScanBatch) + sizeof(char*) * pool->batchSize);
+        if (!w->batch) {
+            free(path);
+            return;
+        }
+        w->batch->count = 0;
+    }
+    w->batch->paths[w->batch->count++] = path;
+    if (w->batch->count == pool->batchSize) scan_publish_batch(w);
+}
+
+static void scan_add_dir(ScanWorker* w, char* path) {
+    ScanPool* pool = w->pool;
+    atomic_fetch_add(&pool->pending, 1);
+    if (!scan_deque_push(&w->deque, path)) {
+        free(path);
+        atomic_fetch_sub(&pool->pending, 1);
+        return;
+    }
+    atomic_fetch_add(&pool->workSeq, 1);
+    if (atomic_load(&pool->idleCount) > 0) {
+        pthread_mutex_lock(&pool->idleLock);
+        pthread_cond_broadcast(&pool->idleCond);
+        pthread_mutex_unlock(&pool->idleLock);
+    }
+}
+
+// 디렉토리 하나 처리 (파일은 결과로, 하위 디렉토리는 자기 덱으로)
+static void scan_process_dir(ScanWorker* w, const char* dirPath) {
+    ScanPool* pool = w->pool;
+
+    int fd = open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    DIR* dir = fdopendir(fd);
     if (!dir) {
-        lua_pushnil(L);
-        lua_pushstring(L, "Directory not found or access denied");
-        return 2;
+        close(fd);
+        return;
     }
-    
+
     struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
+    while ((entry = readdir(dir)) != NULL && !atomic_load(&pool->cancelled)) {
         // 숨김 파일과 디렉토리 건너뛰기
         if (entry->d_name[0] == '.') continue;
-        
-        // 전체 경로로 stat 확인
-        char fullPath[1024];
-        snprintf(fullPath, sizeof(fullPath), "%s/%s", directory, entry->d_name);
-        
-        struct stat statbuf;
-        if (stat(fullPath, &statbuf) != 0) continue;
-        
-        // 디렉토리는 건너뛰기
-        if (S_ISDIR(statbuf.st_mode)) continue;
-        
-        // 음악 파일 확인
-        if (has_music_extension(entry->d_name)) {
-            lua_pushstring(L, fullPath);
-            lua_rawseti(L, -2, index++);
+
+        int isDir;
+        int isFile;
+        if (entry->d_type == DT_DIR) {
+            isDir = 1;
+            isFile = 0;
+        } else if (entry->d_type == DT_REG) {
+            isDir = 0;
+            isFile = 1;
+        } else if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            // d_type을 모르는 파일시스템이거나 심볼릭 링크일 때만 stat
+            struct stat statbuf;
+            if (fstatat(fd, entry->d_name, &statbuf, 0) != 0) continue;
+            isFile = S_ISREG(statbuf.st_mode);
+            // 심볼릭 링크 디렉토리는 순환 방지를 위해 따라가지 않음
+            isDir = S_ISDIR(statbuf.st_mode) && entry->d_type != DT_LNK;
+        } else {
+            continue;
+        }
+
+        if (isDir) {
+            if (!pool->recursive) continue;
+            char* sub = scan_join_path(dirPath, entry->d_name, '/');
+            if (sub) scan_add_dir(w, sub);
+        } else if (isFile && has_music_extension(entry->d_name)) {
+            char* fullPath = scan_join_path(dirPath, entry->d_name, '/');
+            if (fullPath) scan_emit(w, fullPath);
         }
     }
-    
+
     closedir(dir);
+}
+
+static char* scan_find_work(ScanWorker* w) {
+    ScanPool* pool = w->pool;
+    char* path = scan_deque_pop(&w->deque);
+    if (path) return path;
+
+    // 다른 워커 덱에서 훔쳐오기 (자기 다음 워커부터 순서대로)
+    for (int i = 1; i < pool->workerCount; i++) {
+        ScanWorker* victim = &pool->workers[(w->id + i) % pool->workerCount];
+        path = scan_deque_steal(&victim->deque);
+        if (path) return path;
+    }
+    return NULL;
+}
+
+static void* scan_worker_main(void* arg) {
+    ScanWorker* w = arg;
+    ScanPool* pool = w->pool;
+
+    for (;;) {
+        unsigned long seq = atomic_load(&pool->workSeq);
+        char* path = scan_find_work(w);
+
+        if (path) {
+            if (!atomic_load(&pool->cancelled)) scan_process_dir(w, path);
+            free(path);
+            if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+                // 마지막 디렉토리 처리 완료 -> 잠든 워커들 깨워서 종료
+                pthread_mutex_lock(&pool->idleLock);
+                pthread_cond_broadcast(&pool->idleCond);
+                pthread_mutex_unlock(&pool->idleLock);
+            }
+            continue;
+        }
+
+        if (atomic_load(&pool->pending) == 0) break;
+
+        pthread_mutex_lock(&pool->idleLock);
+        atomic_fetch_add(&pool->idleCount, 1);
+        if (atomic_load(&pool->workSeq) == seq && atomic_load(&pool->pending) > 0) {
+            pthread_cond_wait(&pool->idleCond, &pool->idleLock);
+        }
+        atomic_fetch_sub(&pool->idleCount, 1);
+        pthread_mutex_unlock(&pool->idleLock);
+    }
+
+    scan_publish_batch(w);
+
+    pthread_mutex_lock(&pool->resultLock);
+    pool->workersRunning--;
+    pthread_cond_signal(&pool->resultReady);
+    pthread_mutex_unlock(&pool->resultLock);
+    return NULL;
+}
+
+static void scan_free_batch(ScanBatch* batch) {
+    for (int i = 0; i < batch->count; i++) free(batch->paths[i]);
+    free(batch);
+}
+
+static int scan_walk(ScanSink* sink, const char* directory, int recursive, int batchSize, int threads) {
+    lua_State* L = sink->L;
+    ScanPool pool;
+    memset(&pool, 0, sizeof(pool));
+
+    // 루트 디렉토리는 미리 확인해서 기존과 같은 에러를 돌려줌
+    struct stat rootStat;
+    if (stat(directory, &rootStat) != 0 || !S_ISDIR(rootStat.st_mode)) {
+        lua_pushstring(L, "Directory not found or access denied");
+        return LUA_ERRFILE;
+    }
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > SCAN_MAX_THREADS) threads = SCAN_MAX_THREADS;
+    if (!recursive) threads = 1;  // 단일 디렉토리는 나눌 일이 없음
+
+    pool.workers = calloc(threads, sizeof(ScanWorker));
+    char* root = strdup(directory);
+    if (!pool.workers || !root) {
+        free(pool.workers);
+        free(root);
+        lua_pushstring(L, "Memory allocation failed");
+        return LUA_ERRMEM;
+    }
+
+    pool.workerCount = threads;
+    pool.recursive = recursive;
+    pool.batchSize = batchSize;
+    atomic_init(&pool.pending, 0);
+    atomic_init(&pool.workSeq, 0);
+    atomic_init(&pool.idleCount, 0);
+    atomic_init(&pool.cancelled, 0);
+    pthread_mutex_init(&pool.idleLock, NULL);
+    pthread_cond_init(&pool.idleCond, NULL);
+    pthread_mutex_init(&pool.resultLock, NULL);
+    pthread_cond_init(&pool.resultReady, NULL);
+    pthread_cond_init(&pool.resultSpace, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        pool.workers[i].pool = &pool;
+        pool.workers[i].id = i;
+        pthread_mutex_init(&pool.workers[i].deque.lock, NULL);
+    }
+
+    // 루트는 0번 워커 덱에서 시작 (나머지는 훔쳐가며 퍼짐)
+    scan_add_dir(&pool.workers[0], root);
+
+    pthread_t* tids = malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    for (int i = 0; tids && i < threads; i++) {
+        pthread_mutex_lock(&pool.resultLock);
+        pool.workersRunning++;
+        pthread_mutex_unlock(&pool.resultLock);
+        if (pthread_create(&tids[i], NULL, scan_worker_main, &pool.workers[i]) != 0) {
+            pthread_mutex_lock(&pool.resultLock);
+            pool.workersRunning--;
+            pthread_mutex_unlock(&pool.resultLock);
+            break;
+        }
+        started++;
+    }
+
+    // 결과 큐 소비 (Lua 스레드)
+    int status = LUA_OK;
+    for (;;) {
+        pthread_mutex_lock(&pool.resultLock);
+        while (!pool.resultHead && pool.workersRunning > 0) {
+            pthread_cond_wait(&pool.resultReady, &pool.resultLock);
+        }
+        ScanBatch* batch = pool.resultHead;
+        if (batch) {
+            pool.resultHead = batch->next;
+            if (!pool.resultHead) pool.resultTail = NULL;
+            pool.resultQueued--;
+            pthread_cond_signal(&pool.resultSpace);
+        }
+        pthread_mutex_unlock(&pool.resultLock);
+
+        if (!batch) break;
+
+        if (status == LUA_OK && !sink->stopped) {
+            status = scan_sink_deliver(sink, batch->paths, batch->count);
+            if (status != LUA_OK || sink->stopped) {
+                // 워커들에게 중단 알림 (대기 중인 생산자도 깨움)
+                atomic_store(&pool.cancelled, 1);
+                pthread_mutex_lock(&pool.resultLock);
+                pthread_cond_broadcast(&pool.resultSpace);
+                pthread_mutex_unlock(&pool.resultLock);
+            }
+        }
+        scan_free_batch(batch);
+    }
+
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    free(tids);
+
+    for (int i = 0; i < threads; i++) {
+        ScanDeque* dq = &pool.workers[i].deque;
+        for (size_t j = dq->head; j < dq->tail; j++) free(dq->items[j]);
+        free(dq->items);
+        pthread_mutex_destroy(&dq->lock);
+        if (pool.workers[i].batch) scan_free_batch(pool.workers[i].batch);
+    }
+    free(pool.workers);
+    pthread_mutex_destroy(&pool.idleLock);
+    pthread_cond_destroy(&pool.idleCond);
+    pthread_mutex_destroy(&pool.resultLock);
+    pthread_cond_destroy(&pool.resultReady);
+    pthread_cond_destroy(&pool.resultSpace);
+
+    if (status == LUA_OK && started == 0) {
+        lua_pushstring(L, "Failed to start scan threads");
+        return LUA_ERRMEM;
+    }
+    return status;
+}
 #endif
-    
-    return 1;  // 테이블 반환
+
+// 디렉토리에서 음악 파일 목록을 가져오기
+// scanMusicFiles(dir [, opts])
+//   opts.recursive - 하위 디렉토리까지 스캔 (기본 false)
+//   opts.threads   - 스캔 스레드 수 (기본: CPU 코어 수, 리눅스 전용)
+//   opts.batch     - 콜백 한 번에 전달할 경로 수 (기본 256)
+//   opts.callback  - function(paths) 지정 시 배치 단위로 전달하고 총 개수 반환.
+//                    콜백이 false를 반환하면 스캔 중단
+// 콜백이 없으면 전체 결과를 Lua 테이블로 반환 (재귀/병렬 스캔 시 순서는 보장되지 않음)
+int l_scan_music_files(lua_State* L) {
+    const char* directory = luaL_checkstring(L, 1);
+    int recursive = 0;
+    int threads = 0;
+    int batchSize = 256;
+
+    ScanSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.L = L;
+
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        lua_getfield(L, 2, "recursive");
+        recursive = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, 2, "threads");
+        threads = (int)luaL_optinteger(L, lua_gettop(L), 0);
+        lua_pop(L, 1);
+
+        lua_getfield(L, 2, "batch");
+        batchSize = (int)luaL_optinteger(L, lua_gettop(L), 256);
+        lua_pop(L, 1);
+        if (batchSize < 1) batchSize = 1;
+
+        lua_getfield(L, 2, "callback");
+        if (lua_isfunction(L, -1)) {
+            sink.callback = lua_gettop(L);  // 스택에 남겨둠
+        } else {
+            lua_pop(L, 1);
+        }
+    }
+
+    if (sink.callback == 0) {
+        lua_newtable(L);  // 결과 테이블 생성
+        sink.table = lua_gettop(L);
+    }
+
+#ifdef _WIN32
+    (void)threads;  // 윈도우는 순차 스캔
+    int status = scan_walk(&sink, directory, recursive, batchSize);
+#else
+    int status = scan_walk(&sink, directory, recursive, batchSize, threads);
+#endif
+
+    if (status == LUA_ERRFILE || status == LUA_ERRMEM) {
+        // 디렉토리 열기 실패, 메모리 부족: nil, 메시지
+        lua_pushnil(L);
+        lua_insert(L, -2);
+        return 2;
+    }
+    if (status != LUA_OK) {
+        return lua_error(L);  // 콜백에서 발생한 에러 전파
+    }
+
+    if (sink.callback != 0) {
+        lua_pushinteger(L, sink.count);
+    }
+    return 1;  // 테이블 또는 개수 반환
 }
 
-// 단일 파일 존재 확인
-int l_file_exists(lua_State* L) {
-    const char* filename = luaL_checkstring(L, 1);
-    
+// lua_loader 작업 풀 API (loader/pool.c). 레지스트리 "lua_loader.pool"에 있음
+typedef void (*PoolWorkFn)(void* data);
+typedef int (*PoolFinishFn)(lua_State* L, void* data);
+
+typedef struct {
+    int version;
+    int (*submit)(lua_State* L, PoolWorkFn work, PoolFinishFn finish, void* data);
+} LoaderPoolApi;
+
+// 느린 호출을 작업 풀로 넘김: loop 태스크 안이면 코루틴을 양보했다가 결과와 함께 재개되고,
+// 그 밖(또는 일반 lua 인터프리터)에서는 그 자리에서 실행. C 함수의 return 식으로 호출할 것
+int audio_offload(lua_State* L, PoolWorkFn work, PoolFinishFn finish, void* data) {
+    lua_getfield(L, LUA_REGISTRYINDEX, "lua_loader.pool");
+    const LoaderPoolApi* api = (const LoaderPoolApi*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (api && api->version == 1) {
+        return api->submit(L, work, finish, data);
+    }
+    work(data);
+    return finish(L, data);
+}
+
+// 경로 검사 작업 (fileExists / dirExists)
+typedef struct {
+    const char* path;  // 인자 문자열 (코루틴 스택에 남아 있으므로 복사 불필요)
+    int want_dir;
+    int result;
+} ProbeJob;
+
+static void probe_work(void* data) {
+    ProbeJob* job = (ProbeJob*)data;
 #ifdef _WIN32
-    wchar_t* wFilename = utf8_to_utf16(filename);
-    if (!wFilename) {
-        lua_pushboolean(L, 0);
-        return 1;
+    wchar_t* wPath = utf8_to_utf16(job->path);
+    if (!wPath) {
+        job->result = 0;
+        return;
     }
-    
-    DWORD attrs = GetFileAttributesW(wFilename);
-    free(wFilename);
-    
-    lua_pushboolean(L, attrs != INVALID_FILE_ATTRIBUTES && 
-                       !(attrs & FILE_ATTRIBUTE_DIRECTORY));
+
+    DWORD attrs = GetFileAttributesW(wPath);
+    free(wPath);
+
+    job->result = attrs != INVALID_FILE_ATTRIBUTES &&
+                  (job->want_dir ? (attrs & FILE_ATTRIBUTE_DIRECTORY) != 0 : !(attrs & FILE_ATTRIBUTE_DIRECTORY));
 #else
     struct stat statbuf;
-    int exists = (stat(filename, &statbuf) == 0 && S_ISREG(statbuf.st_mode));
-    lua_pushboolean(L, exists);
+    job->result = stat(job->path, &statbuf) == 0 &&
+                  (job->want_dir ? S_ISDIR(statbuf.st_mode) : S_ISREG(statbuf.st_mode));
 #endif
-    
+}
+
+static int probe_finish(lua_State* L, void* data) {
+    ProbeJob* job = (ProbeJob*)data;
+    lua_pushboolean(L, job->result);
+    free(job);
     return 1;
 }
 
+static int probe_path(lua_State* L, int want_dir) {
+    const char* path = luaL_checkstring(L, 1);
+    ProbeJob* job = (ProbeJob*)malloc(sizeof(ProbeJob));
+    if (!job) return luaL_error(L, "Memory allocation failed");
+    job->path = path;
+    job->want_dir = want_dir;
+    job->result = 0;
+    return audio_offload(L, probe_work, probe_finish, job);
+}
+
+// 단일 파일 존재 확인
+int l_file_exists(lua_State* L) {
+    return probe_path(L, 0);
+}
+
 // 디렉토리 존재 확인
 int l_dir_exists(lua_State* L) {
-    const char* dirname = luaL_checkstring(L, 1);
-    
+    return probe_path(L, 1);
+}
+
+// statMany 결과 (경로 하나당 하나)
+typedef struct {
+    int exists;
+    int type;          // 0: 기타, 1: 파일, 2: 디렉토리
+    long long size;
+    double mtime;      // 초 (소수점 이하 포함)
+} StatResult;
+
+#ifndef _WIN32
+static void stat_result_from_stat(StatResult* r, const struct stat* st) {
+    r->exists = 1;
+    r->type = S_ISREG(st->st_mode) ? 1 : S_ISDIR(st->st_mode) ? 2 : 0;
+    r->size = (long long)st->st_size;
+    r->mtime = (double)st->st_mtim.tv_sec + st->st_mtim.tv_nsec / 1e9;
+}
+
+// 스레드 풀 폴백: 워커들이 인덱스를 묶음 단위로 가져가서 stat
+#define STAT_CHUNK 64
+
+typedef struct {
+    const char** paths;
+    StatResult* results;
+    unsigned char* done;     // io_uring에서 이미 처리된 항목 (NULL 가능)
+    size_t count;
+    atomic_size_t next;
+} StatJob;
+
+static void* stat_worker_main(void* arg) {
+    StatJob* job = arg;
+    for (;;) {
+        size_t begin = atomic_fetch_add(&job->next, STAT_CHUNK);
+        if (begin >= job->count) break;
+        size_t end = begin + STAT_CHUNK < job->count ? begin + STAT_CHUNK : job->count;
+        for (size_t i = begin; i < end; i++) {
+            if (job->done && job->done[i]) continue;
+            struct stat st;
+            if (stat(job->paths[i], &st) == 0) stat_result_from_stat(&job->results[i], &st);
+        }
+    }
+    return NULL;
+}
+
+static void stat_many_threads(const char** paths, StatResult* results, unsigned char* done, size_t count) {
+    StatJob job;
+    job.paths = paths;
+    job.results = results;
+    job.done = done;
+    job.count = count;
+    atomic_init(&job.next, 0);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 0 ? (size_t)cpus : 1;
+    if (threads > SCAN_MAX_THREADS) threads = SCAN_MAX_THREADS;
+    // 작은 요청은 스레드 생성 비용이 더 큼
+    if (threads > (count + STAT_CHUNK * 4 - 1) / (STAT_CHUNK * 4)) {
+        threads = (count + STAT_CHUNK * 4 - 1) / (STAT_CHUNK * 4);
+    }
+
+    pthread_t tids[SCAN_MAX_THREADS];
+    size_t started = 0;
+    for (size_t i = 1; i < threads; i++) {
+        if (pthread_create(&tids[started], NULL, stat_worker_main, &job) != 0) break;
+        started++;
+    }
+    stat_worker_main(&job);  // 현재 스레드도 참여
+    for (size_t i = 0; i < started; i++) pthread_join(tids[i], NULL);
+}
+
+#ifdef STAT_HAVE_IO_URING
+/*
+ * io_uring 경로: liburing 없이 시스템 콜로 직접 링을 만들고
+ * IORING_OP_STATX를 한꺼번에 제출해서 시스템 콜 수를 줄임
+ */
+#define STAT_RING_ENTRIES 256
+
+typedef struct {
+    int fd;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+} StatRing;
+
+static void stat_ring_close(StatRing* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+    if (ring->sqRing) munmap(ring->sqRing, ring->sqRingSize);
+    if (ring->fd >= 0) close(ring->fd);
+}
+
+static int stat_ring_open(StatRing* ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+    ring->fd = -1;
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) return 0;  // 커널 미지원, seccomp 차단 등
+    ring->fd = fd;
+
+    ring->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        ring->sqRing = NULL;
+        stat_ring_close(ring);
+        return 0;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            ring->cqRing = NULL;
+            stat_ring_close(ring);
+            return 0;
+        }
+    }
+    ring->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        stat_ring_close(ring);
+        return 0;
+    }
+
+    char* sq = ring->sqRing;
+    char* cq = ring->cqRing;
+    ring->sqHead = (unsigned*)(sq + p.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + p.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + p.sq_off.array);
+    ring->sqEntries = p.sq_entries;
+    ring->cqHead = (unsigned*)(cq + p.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + p.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 1;
+}
+
+static void stat_result_from_statx(StatResult* r, const struct statx* stx) {
+    r->exists = 1;
+    r->type = S_ISREG(stx->stx_mode) ? 1 : S_ISDIR(stx->stx_mode) ? 2 : 0;
+    r->size = (long long)stx->stx_size;
+    r->mtime = (double)stx->stx_mtime.tv_sec + stx->stx_mtime.tv_nsec / 1e9;
+}
+
+// 성공하면 1. 중간에 STATX를 지원하지 않는 커널로 판명되면 0 (done에 처리된 항목 표시)
+static int stat_many_uring(const char** paths, StatResult* results, unsigned char* done, size_t count) {
+    StatRing ring;
+    unsigned entries = STAT_RING_ENTRIES;
+    while (entries / 2 >= count && entries > 8) entries /= 2;
+    if (!stat_ring_open(&ring, entries)) return 0;
+
+    // statx 버퍼는 링 크기만큼만 두고 슬롯 단위로 재사용
+    struct statx* buffers = malloc(sizeof(struct statx) * ring.sqEntries);
+    unsigned* freeSlots = malloc(sizeof(unsigned) * ring.sqEntries);
+    size_t* slotIndex = malloc(sizeof(size_t) * ring.sqEntries);
+    if (!buffers || !freeSlots || !slotIndex) {
+        free(buffers);
+        free(freeSlots);
+        free(slotIndex);
+        stat_ring_close(&ring);
+        return 0;
+    }
+    unsigned freeCount = ring.sqEntries;
+    for (unsigned i = 0; i < ring.sqEntries; i++) freeSlots[i] = i;
+
+    size_t submitted = 0;
+    size_t completed = 0;
+    int ok = 1;
+    int broken = 0;
+
+    // 실패해도 이미 제출한 요청은 끝까지 수거해야 버퍼를 해제할 수 있음
+    while (completed < submitted || (ok && submitted < count)) {
+        // 빈 슬롯만큼 SQE 채우기
+        unsigned tail = *ring.sqTail;
+        while (ok && submitted < count && freeCount > 0) {
+            unsigned slot = freeSlots[--freeCount];
+            unsigned idx = tail & *ring.sqMask;
+            struct io_uring_sqe* sqe = &ring.sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long long)(uintptr_t)paths[submitted];
+            sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME;
+            sqe->off = (unsigned long long)(uintptr_t)&buffers[slot];
+            sqe->user_data = slot;
+            slotIndex[slot] = submitted++;
+            ring.sqArray[idx] = idx;
+            tail++;
+        }
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+
+        // EINTR로 못 넘긴 항목이 있을 수 있으므로 커널 head 기준으로 계산
+        unsigned toSubmit = tail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+        int ret = (int)syscall(__NR_io_uring_enter, ring.fd, toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR) {
+            ok = 0;
+            broken = 1;
+            break;
+        }
+
+        // 완료 항목 수거
+        unsigned head = *ring.cqHead;
+        unsigned cqTail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        while (head != cqTail) {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+            unsigned slot = (unsigned)cqe->user_data;
+            size_t i = slotIndex[slot];
+            if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+                ok = 0;  // STATX 미지원 커널 -> 나머지는 폴백에서 처리
+            } else {
+                if (cqe->res == 0) stat_result_from_statx(&results[i], &buffers[slot]);
+                done[i] = 1;
+            }
+            freeSlots[freeCount++] = slot;
+            completed++;
+            head++;
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    // 링 자체가 고장난 경우 커널이 아직 버퍼에 쓸 수 있으므로 해제하지 않음
+    if (!broken || completed == submitted) free(buffers);
+    free(freeSlots);
+    free(slotIndex);
+    stat_ring_close(&ring);
+    return ok;
+}
+#endif
+#endif
+
+// buffer.c
+extern void* audio_check_buffer_writable(lua_State* L, int idx, int* kind, size_t* count);
+extern void audio_buffer_store(void* data, int kind, size_t i, double v);
+
+// 버퍼 종류 번호 (buffer.c와 같은 ma_format 값)
+#define STAT_KIND_I32 4  // ma_format_s32
+#define STAT_KIND_F32 5  // ma_format_f32
+
+// statMany의 결과 버퍼 (없으면 NULL)
+typedef struct {
+    void* data;
+    int kind;
+} StatColumn;
+
+// u8/s16은 없음 표시(-1)도 담지 못하므로 받지 않음. f32는 정수가 2^24를 넘으면 반올림되므로
+// 크기 열에는 i32만 허용
+static StatColumn stat_column(lua_State* L, int idx, size_t need, int allow_f32) {
+    StatColumn column = {NULL, 0};
+    if (lua_isnoneornil(L, idx)) return column;
+    size_t count;
+    column.data = audio_check_buffer_writable(L, idx, &column.kind, &count);
+    luaL_argcheck(L, column.kind == STAT_KIND_I32 || (allow_f32 && column.kind == STAT_KIND_F32), idx,
+                  allow_f32 ? "buffer must be i32 or f32" : "buffer must be i32");
+    luaL_argcheck(L, count >= need, idx, "buffer is shorter than the path list");
+    return column;
+}
+
+// i32 열에 들어가지 않는 값이면 0 (버퍼에는 잘린 값 대신 아무것도 쓰지 않음)
+static int stat_column_store(const StatColumn* column, size_t i, double v) {
+    if (column->kind == STAT_KIND_I32 && (v < -2147483648.0 || v > 2147483647.0)) return 0;
+    audio_buffer_store(column->data, column->kind, i, v);
+    return 1;
+}
+
+// 여러 경로를 한 번에 stat
+// statMany(paths) -> results, backend
+//   results[i]는 없으면 false, 있으면 {type="file"|"dir"|"other", size=, mtime=}
+//   backend는 실제로 사용된 방식 ("io_uring", "threads", "win32")
+// statMany(paths, sizes [, mtimes]) -> found, backend
+//   경로마다 테이블을 만드는 대신 버퍼(newBuffer)에 채움. 없는 경로는 -1, 파일이 아니면 크기 0
+//   sizes는 "i32", mtimes는 "i32" 또는 "f32" (mtime은 초 단위라 f32로는 정밀도가 모자람, "i32" 권장)
+//   2 GiB 이상인 파일이나 2038년 이후 mtime처럼 i32에 안 들어가는 값은 자르지 않고 에러
+int l_stat_many(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    size_t count = (size_t)lua_rawlen(L, 1);
+    const char* backend;
+    int to_buffers = !lua_isnoneornil(L, 2);
+    StatColumn sizes = stat_column(L, 2, count, 0);
+    StatColumn mtimes = stat_column(L, 3, count, 1);
+
+    // 경로 문자열은 인자 테이블이 붙잡고 있으므로 포인터만 모음
+    // (숫자를 변환한 문자열은 스택에서 빠지면 사라지므로 문자열만 받음)
+    const char** paths = malloc(sizeof(char*) * (count ? count : 1));
+    StatResult* results = calloc(count ? count : 1, sizeof(StatResult));
+    if (!paths || !results) {
+        free(paths);
+        free(results);
+        return luaL_error(L, "Memory allocation failed");
+    }
+    for (size_t i = 0; i < count; i++) {
+        paths[i] = lua_rawgeti(L, 1, (lua_Integer)i + 1) == LUA_TSTRING ? lua_tostring(L, -1) : NULL;
+        lua_pop(L, 1);
+        if (!paths[i]) {
+            free(paths);
+            free(results);
+            return luaL_error(L, "statMany: path #%d is not a string", (int)i + 1);
+        }
+    }
+
 #ifdef _WIN32
-    wchar_t* wDirname = utf8_to_utf16(dirname);
-    if (!wDirname) {
-        lua_pushboolean(L, 0);
-        return 1;
+    backend = "win32";
+    for (size_t i = 0; i < count; i++) {
+        wchar_t* wPath = utf8_to_utf16(paths[i]);
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (wPath && GetFileAttributesExW(wPath, GetFileExInfoStandard, &data)) {
+            ULARGE_INTEGER t;
+            t.LowPart = data.ftLastWriteTime.dwLowDateTime;
+            t.HighPart = data.ftLastWriteTime.dwHighDateTime;
+            results[i].exists = 1;
+            results[i].type = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? 2 : 1;
+            results[i].size = ((long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+            // FILETIME(1601년 기준 100ns) -> 유닉스 시간(초)
+            results[i].mtime = (double)(t.QuadPart - 116444736000000000ULL) / 1e7;
+        }
+        free(wPath);
     }
-    
-    DWORD attrs = GetFileAttributesW(wDirname);
-    free(wDirname);
-    
-    lua_pushboolean(L, attrs != INVALID_FILE_ATTRIBUTES && 
-                       (attrs & FILE_ATTRIBUTE_DIRECTORY));
 #else
-    struct stat statbuf;
-    int exists = (stat(dirname, &statbuf) == 0 && S_ISDIR(statbuf.st_mode));
-    lua_pushboolean(L, exists);
+    backend = "threads";
+#ifdef STAT_HAVE_IO_URING
+    unsigned char* done = calloc(count ? count : 1, 1);
+    if (done && count > 0) {
+        if (stat_many_uring(paths, results, done, count)) {
+            backend = "io_uring";
+        } else {
+            stat_many_threads(paths, results, done, count);
+        }
+    } else {
+        stat_many_threads(paths, results, NULL, count);
+    }
+    free(done);
+#else
+    stat_many_threads(paths, results, NULL, count);
 #endif
-    
-    return 1;
+#endif
+
+    if (to_buffers) {
+        lua_Integer found = 0;
+        const char* overflow = NULL;
+        for (size_t i = 0; i < count; i++) {
+            StatResult* r = &results[i];
+            found += r->exists;
+            if (sizes.data && !stat_column_store(&sizes, i, r->exists ? (r->type == 1 ? (double)r->size : 0) : -1)) {
+                overflow = "size";
+            } else if (mtimes.data && !stat_column_store(&mtimes, i, r->exists ? r->mtime : -1)) {
+                overflow = "mtime";
+            }
+            if (overflow) {
+                // 경로 문자열은 인자 테이블 소유라 해제 뒤에도 유효
+                const char* path = paths[i];
+                free(paths);
+                free(results);
+                return luaL_error(L, "statMany: %s of '%s' does not fit an i32 buffer", overflow, path);
+            }
+        }
+        lua_pushinteger(L, found);
+        lua_pushstring(L, backend);
+        free(paths);
+        free(results);
+        return 2;
+    }
+
+    lua_createtable(L, (int)count, 0);
+    for (size_t i = 0; i < count; i++) {
+        StatResult* r = &results[i];
+        if (!r->exists) {
+            lua_pushboolean(L, 0);
+        } else {
+            lua_createtable(L, 0, 3);
+            lua_pushstring(L, r->type == 1 ? "file" : r->type == 2 ? "dir" : "other");
+            lua_setfield(L, -2, "type");
+            lua_pushinteger(L, r->size);
+            lua_setfield(L, -2, "size");
+            lua_pushnumber(L, r->mtime);
+            lua_setfield(L, -2, "mtime");
+        }
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    lua_pushstring(L, backend);
+
+    free(paths);
+    free(results);
+    return 2;
 }
 
 // 키 코드 상수 테이블
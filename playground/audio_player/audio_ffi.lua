@@ -0,0 +1,169 @@
+-- audio_ffi.lua - LuaJIT FFI wrapper for the audio module's C ABI (audio/audio_abi.h)
+--
+-- local audio = require("audio_ffi")
+-- audio.init()
+-- local sound = audio.load("music/guitar.ogg")
+-- sound:setVolume(0.5)
+-- sound:play()
+--
+-- 메서드 호출이 C 함수 직접 호출로 JIT 컴파일됨 (Lua C API를 거치지 않음).
+-- require("audio")와 같은 라이브러리를 열기 때문에 엔진과 사운드를 같이 씀.
+
+local ffi = require("ffi")
+
+-- audio/audio_abi.h의 선언부와 같아야 함
+ffi.cdef [[
+typedef struct AudioSound AudioSound;
+
+int audio_abi_version(void);
+
+int audio_init(void);
+void audio_shutdown(void);
+int audio_play_file(const char* path);
+
+AudioSound* audio_load_file(const char* path);
+AudioSound* audio_load_memory(const void* data, size_t size);
+void audio_free(AudioSound* sound);
+int audio_play(AudioSound* sound);
+int audio_stop(AudioSound* sound);
+int audio_set_volume(AudioSound* sound, float volume);
+int audio_set_looping(AudioSound* sound, int loop);
+int audio_is_playing(AudioSound* sound);
+
+int audio_play_many(AudioSound* const* sounds, int count);
+int audio_stop_many(AudioSound* const* sounds, int count);
+int audio_set_volume_many(AudioSound* const* sounds, const float* volumes, int count);
+int audio_is_playing_many(AudioSound* const* sounds, unsigned char* playing, int count);
+]]
+
+local ABI_VERSION = 1
+
+-- 이미 링크된 경우 (lua_loader_static) 먼저, 아니면 package.cpath에서 audio 모듈을 찾음
+local function open_library()
+    if pcall(function() return ffi.C.audio_abi_version end) then
+        return ffi.C
+    end
+    local path = package.searchpath("audio", package.cpath)
+    if not path then
+        error("audio_ffi: audio module not found in package.cpath", 3)
+    end
+    return ffi.load(path)
+end
+
+local C = open_library()
+
+local version = C.audio_abi_version()
+if version < ABI_VERSION then
+    error(("audio_ffi: audio module ABI %d is older than %d"):format(version, ABI_VERSION), 2)
+end
+
+local M = { C = C, abiVersion = version }
+
+local Sound = {}
+
+function Sound:play()
+    return C.audio_play(self) ~= 0
+end
+
+function Sound:stop()
+    return C.audio_stop(self) ~= 0
+end
+
+function Sound:setVolume(volume)
+    return C.audio_set_volume(self, volume) ~= 0
+end
+
+function Sound:setLooping(loop)
+    return C.audio_set_looping(self, loop and 1 or 0) ~= 0
+end
+
+function Sound:isPlaying()
+    return C.audio_is_playing(self) ~= 0
+end
+
+-- 명시적으로 해제 (이후 핸들은 쓰지 말 것)
+function Sound:free()
+    ffi.gc(self, nil)
+    C.audio_free(self)
+end
+
+ffi.metatype("AudioSound", { __index = Sound })
+
+local function wrap(handle)
+    if handle == nil then
+        return nil
+    end
+    return ffi.gc(handle, C.audio_free)
+end
+
+function M.init()
+    return C.audio_init() ~= 0
+end
+
+function M.shutdown()
+    C.audio_shutdown()
+end
+
+function M.playFile(path)
+    return C.audio_play_file(path) ~= 0
+end
+
+function M.load(path)
+    local sound = wrap(C.audio_load_file(path))
+    if not sound then
+        return nil, "Failed to load: " .. path
+    end
+    return sound
+end
+
+function M.loadMemory(data)
+    local sound = wrap(C.audio_load_memory(data, #data))
+    if not sound then
+        return nil, "Failed to decode audio data"
+    end
+    return sound
+end
+
+-- 일괄 처리: 사운드 목록을 핸들 배열로 바꿔 한 번에 넘김
+local function handles(sounds)
+    local n = #sounds
+    local array = ffi.new("AudioSound*[?]", n)
+    for i = 1, n do
+        array[i - 1] = sounds[i]
+    end
+    return array, n
+end
+
+function M.playAll(sounds)
+    local array, n = handles(sounds)
+    return C.audio_play_many(array, n)
+end
+
+function M.stopAll(sounds)
+    local array, n = handles(sounds)
+    return C.audio_stop_many(array, n)
+end
+
+-- volumes: 숫자 하나 (모두 같은 볼륨) 또는 사운드마다 하나씩
+function M.setVolumeAll(sounds, volumes)
+    local array, n = handles(sounds)
+    local values = ffi.new("float[?]", n)
+    for i = 1, n do
+        values[i - 1] = type(volumes) == "table" and volumes[i] or volumes
+    end
+    return C.audio_set_volume_many(array, values, n)
+end
+
+-- 재생 중인 개수와 사운드별 재생 여부 (boolean 목록)
+function M.playingAll(sounds)
+    local array, n = handles(sounds)
+    local playing = ffi.new("unsigned char[?]", n)
+    local count = C.audio_is_playing_many(array, playing, n)
+    local list = {}
+    for i = 1, n do
+        list[i] = playing[i - 1] ~= 0
+    end
+    return count, list
+end
+
+return M
@@ -0,0 +1,327 @@
+/*
+ * alloc.c - Custom lua_Alloc implementations for lua_loader
+ *
+ * system: plain realloc/free, with accounting
+ * pool:   size-class slabs for blocks up to 512 bytes, one free list per
+ *         class. Each allocator instance belongs to one lua_State, so the
+ *         free lists are only touched from the thread running that state.
+ * arena:  bump allocation for small blocks, frees are ignored until the
+ *         state is closed. Good for short batch scripts, not for long runs.
+ *
+ * Lua passes the old block size on every free/realloc, so no per-block
+ * header is needed to tell pool blocks from malloc'ed ones.
+ * All modes honour an optional hard cap on live bytes, and an optional hook
+ * sees every call (used by the GC telemetry in gc.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#define POOL_MAX_SMALL 512
+#define POOL_CLASS_COUNT 19
+#define POOL_SLAB_SIZE (64 * 1024)
+#define ARENA_CHUNK_SIZE (256 * 1024)
+
+typedef enum { ALLOC_SYSTEM, ALLOC_POOL, ALLOC_ARENA } AllocMode;
+
+typedef struct PoolSlab {
+    struct PoolSlab* next;
+    size_t used;
+    size_t size;
+    // block storage follows, 16-byte aligned
+} PoolSlab;
+
+#define SLAB_HEADER ((sizeof(PoolSlab) + 15) & ~(size_t)15)
+
+typedef void (*AllocHook)(void* hook_ud, int is_free, size_t current);
+
+typedef struct {
+    AllocMode mode;
+    size_t limit;  // 0 = unlimited
+    size_t current;
+    size_t peak;
+    unsigned long long allocated;  // bytes handed out, counting only growth
+    size_t total_allocs;
+    size_t total_frees;
+    size_t failed;
+
+    void* free_lists[POOL_CLASS_COUNT];
+    PoolSlab* slabs;     // pool slabs / arena chunks
+    size_t slab_bytes;   // bytes reserved from the system for slabs
+
+    size_t class_allocs[POOL_CLASS_COUNT];
+    size_t class_live[POOL_CLASS_COUNT];
+    size_t large_allocs;
+
+    AllocHook hook;
+    void* hook_ud;
+} LoaderAlloc;
+
+static const unsigned short g_class_sizes[POOL_CLASS_COUNT] = {
+    16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512};
+
+// Index by (size + 7) / 8 for sizes 1..512
+static unsigned char g_class_index[POOL_MAX_SMALL / 8 + 1];
+static int g_class_index_ready = 0;
+
+static void init_class_index(void) {
+    int c = 0;
+    for (int i = 0; i <= POOL_MAX_SMALL / 8; i++) {
+        while ((size_t)i * 8 > g_class_sizes[c]) c++;
+        g_class_index[i] = (unsigned char)c;
+    }
+    g_class_index_ready = 1;
+}
+
+static int size_class(size_t size) {
+    return g_class_index[(size + 7) / 8];
+}
+
+// Carve a block of 'size' bytes (multiple of 8) from the current slab, adding a slab if needed
+static void* slab_carve(LoaderAlloc* a, size_t size, size_t slab_size) {
+    PoolSlab* slab = a->slabs;
+    if (!slab || slab->used + size > slab->size) {
+        slab = malloc(SLAB_HEADER + slab_size);
+        if (!slab) return NULL;
+        slab->next = a->slabs;
+        slab->used = 0;
+        slab->size = slab_size;
+        a->slabs = slab;
+        a->slab_bytes += SLAB_HEADER + slab_size;
+    }
+    void* block = (char*)slab + SLAB_HEADER + slab->used;
+    slab->used += size;
+    return block;
+}
+
+static void* pool_alloc_small(LoaderAlloc* a, size_t size) {
+    int c = size_class(size);
+    void* block = a->free_lists[c];
+    if (block) {
+        a->free_lists[c] = *(void**)block;
+    } else {
+        block = slab_carve(a, g_class_sizes[c], POOL_SLAB_SIZE);
+        if (!block) return NULL;
+    }
+    a->class_allocs[c]++;
+    a->class_live[c]++;
+    return block;
+}
+
+static void pool_free_small(LoaderAlloc* a, void* block, size_t size) {
+    int c = size_class(size);
+    *(void**)block = a->free_lists[c];
+    a->free_lists[c] = block;
+    a->class_live[c]--;
+}
+
+static void* arena_alloc_small(LoaderAlloc* a, size_t size) {
+    int c = size_class(size);
+    a->class_allocs[c]++;
+    a->class_live[c]++;
+    return slab_carve(a, (size + 15) & ~(size_t)15, ARENA_CHUNK_SIZE);
+}
+
+static void* loader_alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+    LoaderAlloc* a = ud;
+    size_t old = ptr ? osize : 0;  // when ptr is NULL osize is an object type tag
+
+    if (nsize == 0) {
+        if (!ptr) return NULL;
+        a->current -= old;
+        a->total_frees++;
+        if (a->mode == ALLOC_SYSTEM || old > POOL_MAX_SMALL) {
+            free(ptr);
+        } else if (a->mode == ALLOC_POOL) {
+            pool_free_small(a, ptr, old);
+        } else {
+            a->class_live[size_class(old)]--;  // arena: reclaimed at close
+        }
+        if (a->hook) a->hook(a->hook_ud, 1, a->current);
+        return NULL;
+    }
+
+    // Lua assumes shrinking never fails, so the cap only applies to growth
+    if (a->limit && nsize > old && a->current + (nsize - old) > a->limit) {
+        a->failed++;
+        return NULL;
+    }
+
+    void* block;
+    if (a->mode == ALLOC_SYSTEM || (nsize > POOL_MAX_SMALL && old > POOL_MAX_SMALL)) {
+        block = realloc(ptr, nsize);
+        if (!block) {
+            a->failed++;
+            return NULL;
+        }
+        if (nsize > POOL_MAX_SMALL && !ptr) a->large_allocs++;
+    } else if (ptr && old <= POOL_MAX_SMALL && nsize <= POOL_MAX_SMALL &&
+               (a->mode == ALLOC_POOL ? size_class(old) == size_class(nsize) : nsize <= old)) {
+        block = ptr;  // still fits the same block
+        a->class_live[size_class(old)]--;
+        a->class_live[size_class(nsize)]++;
+    } else {
+        if (nsize <= POOL_MAX_SMALL) {
+            block = a->mode == ALLOC_POOL ? pool_alloc_small(a, nsize) : arena_alloc_small(a, nsize);
+        } else {
+            block = malloc(nsize);
+            if (block) a->large_allocs++;
+        }
+        if (!block) {
+            a->failed++;
+            return NULL;
+        }
+        if (ptr) {
+            memcpy(block, ptr, old < nsize ? old : nsize);
+            if (old > POOL_MAX_SMALL) {
+                free(ptr);
+            } else if (a->mode == ALLOC_POOL) {
+                pool_free_small(a, ptr, old);
+            } else {
+                a->class_live[size_class(old)]--;
+            }
+        }
+    }
+
+    if (!ptr) a->total_allocs++;
+    if (nsize > old) a->allocated += nsize - old;
+    a->current = a->current - old + nsize;
+    if (a->current > a->peak) a->peak = a->current;
+    if (a->hook) a->hook(a->hook_ud, 0, a->current);
+    return block;
+}
+
+static int alloc_panic(lua_State* L) {
+    const char* msg = lua_tostring(L, -1);
+    fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg ? msg : "error object is not a string");
+    return 0;  // abort
+}
+
+#if LUA_VERSION_NUM >= 504
+// Warning function of luaL_newstate (lauxlib's warnf*, which are static): warnings
+// are off until "@on", "@off" turns them off again, pieces are continued until tocont is 0
+static void warnf_on(void* ud, const char* msg, int tocont);
+static void warnf_off(void* ud, const char* msg, int tocont);
+
+static int warnf_control(lua_State* L, const char* msg, int tocont) {
+    if (tocont || *(msg++) != '@') return 0;
+    if (strcmp(msg, "off") == 0) {
+        lua_setwarnf(L, warnf_off, L);
+    } else if (strcmp(msg, "on") == 0) {
+        lua_setwarnf(L, warnf_on, L);
+    }
+    return 1;
+}
+
+static void warnf_off(void* ud, const char* msg, int tocont) {
+    warnf_control((lua_State*)ud, msg, tocont);
+}
+
+static void warnf_cont(void* ud, const char* msg, int tocont) {
+    lua_State* L = ud;
+    fprintf(stderr, "%s", msg);
+    if (tocont) {
+        lua_setwarnf(L, warnf_cont, L);
+    } else {
+        fprintf(stderr, "\n");
+        fflush(stderr);
+        lua_setwarnf(L, warnf_on, L);
+    }
+}
+
+static void warnf_on(void* ud, const char* msg, int tocont) {
+    if (warnf_control((lua_State*)ud, msg, tocont)) return;
+    fprintf(stderr, "Lua warning: ");
+    warnf_cont(ud, msg, tocont);
+}
+#endif
+
+// Parse "system", "pool" or "arena"; returns -1 if unknown
+int alloc_parse_mode(const char* name) {
+    if (strcmp(name, "system") == 0) return ALLOC_SYSTEM;
+    if (strcmp(name, "pool") == 0) return ALLOC_POOL;
+    if (strcmp(name, "arena") == 0) return ALLOC_ARENA;
+    return -1;
+}
+
+// Create a Lua state backed by the chosen allocator; *out_ud receives the allocator
+lua_State* alloc_newstate(int mode, size_t limit, void** out_ud) {
+    if (!g_class_index_ready) init_class_index();
+
+    LoaderAlloc* a = calloc(1, sizeof(LoaderAlloc));
+    if (!a) return NULL;
+    a->mode = (AllocMode)mode;
+    a->limit = limit;
+
+    lua_State* L = lua_newstate(loader_alloc, a);
+    if (!L) {
+        free(a);
+        return NULL;
+    }
+    lua_atpanic(L, alloc_panic);
+#if LUA_VERSION_NUM >= 504
+    lua_setwarnf(L, warnf_off, L);  // like luaL_newstate: off until warn("@on")
+#endif
+    *out_ud = a;
+    return L;
+}
+
+// Counters for --bench; any output pointer may be NULL
+void alloc_get_stats(void* ud, size_t* current, size_t* peak, unsigned long long* allocated) {
+    LoaderAlloc* a = ud;
+    if (current) *current = a->current;
+    if (peak) *peak = a->peak;
+    if (allocated) *allocated = a->allocated;
+}
+
+// Observe every allocator call; pass NULL to remove
+void alloc_set_hook(void* ud, AllocHook hook, void* hook_ud) {
+    LoaderAlloc* a = ud;
+    a->hook = hook;
+    a->hook_ud = hook_ud;
+}
+
+// Start a new peak window at the current heap size
+void alloc_reset_peak(void* ud) {
+    LoaderAlloc* a = ud;
+    a->peak = a->current;
+}
+
+// Release slabs and the allocator itself; call after lua_close
+void alloc_free(void* ud) {
+    LoaderAlloc* a = ud;
+    if (!a) return;
+    while (a->slabs) {
+        PoolSlab* next = a->slabs->next;
+        free(a->slabs);
+        a->slabs = next;
+    }
+    free(a);
+}
+
+// Print counters, then alloc_free
+void alloc_report_and_free(void* ud) {
+    LoaderAlloc* a = ud;
+    if (!a) return;
+
+    static const char* mode_names[] = {"system", "pool", "arena"};
+    printf("Allocator (%s): peak %zu bytes, current %zu bytes, %zu allocs, %zu frees",
+           mode_names[a->mode], a->peak, a->current, a->total_allocs, a->total_frees);
+    if (a->limit) printf(", limit %zu bytes, %zu refused", a->limit, a->failed);
+    printf("\n");
+
+    if (a->mode != ALLOC_SYSTEM) {
+        printf("  slabs reserved: %zu bytes, large (>%d) allocs: %zu\n", a->slab_bytes, POOL_MAX_SMALL,
+               a->large_allocs);
+        printf("  %6s %10s %8s\n", "class", "allocs", "live");
+        for (int c = 0; c < POOL_CLASS_COUNT; c++) {
+            if (a->class_allocs[c] == 0) continue;
+            printf("  %6u %10zu %8zu\n", g_class_sizes[c], a->class_allocs[c], a->class_live[c]);
+        }
+    }
+
+    alloc_free(a);
+}
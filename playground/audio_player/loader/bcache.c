@@ -0,0 +1,287 @@
+/*
+ * bcache.c - Bytecode compile cache for lua_loader
+ *
+ * Compiled chunks are stored as lua_dump output in a cache directory.
+ * The file name is a hash of the source path, its mtime and size, the Lua
+ * version and the strip flag, so a changed source simply misses and a stale
+ * entry is never reused. A searcher replaces the standard Lua searcher in
+ * package.searchers so that require'd modules go through the same cache.
+ *
+ * Every source edit leaves the old entry behind, so a run that stored new
+ * entries prunes the directory at exit: entries not used for
+ * BCACHE_MAX_AGE_DAYS are removed. A hit refreshes the entry's mtime at most
+ * once a day, so modules that are still required keep their entries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#include <windows.h>
+#define bcache_mkdir(path) _mkdir(path)
+#define bcache_getpid() _getpid()
+#define bcache_touch(path) _utime(path, NULL)
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#define bcache_mkdir(path) mkdir(path, 0755)
+#define bcache_getpid() getpid()
+#define bcache_touch(path) utime(path, NULL)
+#endif
+
+#define BCACHE_MAX_AGE_DAYS 30
+#define BCACHE_DAY (24 * 60 * 60)
+
+static char* g_cache_dir = NULL;
+static int g_strip = 0;
+static long g_hits = 0;
+static long g_misses = 0;
+
+typedef struct {
+    FILE* file;
+    int failed;
+} DumpState;
+
+static int dump_writer(lua_State* L, const void* p, size_t size, void* ud) {
+    DumpState* state = ud;
+    (void)L;
+    if (size > 0 && fwrite(p, size, 1, state->file) != 1) state->failed = 1;
+    return state->failed;
+}
+
+static unsigned long long fnv1a(unsigned long long h, const void* data, size_t size) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Cache file path for a source file; returns 0 if the source cannot be stat'ed
+static int cache_path_for(const char* filename, char* out, size_t size) {
+    struct stat st;
+    if (stat(filename, &st) != 0) return 0;
+
+    // Hash the absolute path so the same relative name from another directory does not collide
+    char full[4096];
+#ifdef _WIN32
+    if (!_fullpath(full, filename, sizeof(full))) return 0;
+#else
+    if (!realpath(filename, full)) return 0;
+#endif
+
+    // Whole-second mtime misses an edit within the same second that keeps the size,
+    // so add the nanoseconds, ctime and inode where the platform has them
+    long long stamp[5] = {(long long)st.st_mtime, 0, (long long)st.st_ctime, 0, (long long)st.st_ino};
+#if defined(__APPLE__)
+    stamp[1] = (long long)st.st_mtimespec.tv_nsec;
+    stamp[3] = (long long)st.st_ctimespec.tv_nsec;
+#elif !defined(_WIN32)
+    stamp[1] = (long long)st.st_mtim.tv_nsec;
+    stamp[3] = (long long)st.st_ctim.tv_nsec;
+#endif
+    long long fsize = (long long)st.st_size;
+    int version = LUA_VERSION_NUM;
+    unsigned long long h = 14695981039346656037ULL;
+    h = fnv1a(h, full, strlen(full));
+    h = fnv1a(h, stamp, sizeof(stamp));
+    h = fnv1a(h, &fsize, sizeof(fsize));
+    h = fnv1a(h, &version, sizeof(version));
+    h = fnv1a(h, &g_strip, sizeof(g_strip));
+    h = fnv1a(h, LUA_RELEASE, strlen(LUA_RELEASE));
+
+    // A cache directory too long for the buffer disables the cache for this file
+    int n = snprintf(out, size, "%s/%016llx.luac", g_cache_dir, h);
+    return n > 0 && (size_t)n < size;
+}
+
+// Try to load a cached chunk; returns LUA_OK and pushes the function on success
+static int load_cached(lua_State* L, const char* cache_path, const char* chunkname) {
+    FILE* f = fopen(cache_path, "rb");
+    if (!f) return LUA_ERRFILE;
+
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) {
+        fclose(f);
+        return LUA_ERRFILE;
+    }
+    long size = (long)st.st_size;
+
+    char* buffer = malloc((size_t)size);
+    if (!buffer) {
+        fclose(f);
+        return LUA_ERRMEM;
+    }
+    size_t read = fread(buffer, 1, (size_t)size, f);
+    fclose(f);
+    if (read != (size_t)size) {
+        free(buffer);
+        return LUA_ERRFILE;
+    }
+
+    // Binary only: a corrupt or foreign entry fails the header check and falls back to source
+    int status = luaL_loadbufferx(L, buffer, (size_t)size, chunkname, "b");
+    free(buffer);
+    if (status != LUA_OK) {
+        lua_pop(L, 1);
+        return status;
+    }
+    // Keep entries in use out of reach of prune_cache
+    if ((long long)time(NULL) - (long long)st.st_mtime > BCACHE_DAY) bcache_touch(cache_path);
+    return LUA_OK;
+}
+
+// Dump the function on top of the stack to the cache (temp file + rename)
+static void store_cached(lua_State* L, const char* cache_path) {
+    // Per-process temp name: two loaders missing the same entry must not share a file
+    char tmp_path[1024];
+    int n = snprintf(tmp_path, sizeof(tmp_path), "%s.%d", cache_path, (int)bcache_getpid());
+    if (n < 0 || (size_t)n >= sizeof(tmp_path)) return;
+
+    DumpState state = {fopen(tmp_path, "wb"), 0};
+    if (!state.file) return;
+    lua_dump(L, dump_writer, &state, g_strip);
+    if (fclose(state.file) != 0) state.failed = 1;
+
+    if (state.failed) {
+        remove(tmp_path);
+        return;
+    }
+#ifdef _WIN32
+    remove(cache_path);  // rename does not replace on Windows
+#endif
+    if (rename(tmp_path, cache_path) != 0) remove(tmp_path);
+}
+
+// Remove a cache entry (or a temp file left by a crashed writer) unused for too long
+static void prune_entry(const char* name, long long mtime, long long now) {
+    const char* ext = strstr(name, ".luac");
+    if (!ext || now - mtime < (long long)BCACHE_MAX_AGE_DAYS * BCACHE_DAY) return;
+    char path[1024];
+    int n = snprintf(path, sizeof(path), "%s/%s", g_cache_dir, name);
+    if (n > 0 && (size_t)n < sizeof(path)) remove(path);
+}
+
+// Drop entries older than BCACHE_MAX_AGE_DAYS; only files this cache names are touched
+static void prune_cache(void) {
+    long long now = (long long)time(NULL);
+#ifdef _WIN32
+    char pattern[1024];
+    int n = snprintf(pattern, sizeof(pattern), "%s\\*.luac*", g_cache_dir);
+    if (n < 0 || (size_t)n >= sizeof(pattern)) return;
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        // FILETIME counts 100 ns units since 1601
+        ULARGE_INTEGER t;
+        t.LowPart = data.ftLastWriteTime.dwLowDateTime;
+        t.HighPart = data.ftLastWriteTime.dwHighDateTime;
+        long long mtime = (long long)(t.QuadPart / 10000000ULL) - 11644473600LL;
+        prune_entry(data.cFileName, mtime, now);
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(g_cache_dir);
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!strstr(entry->d_name, ".luac")) continue;
+        char path[1024];
+        int n = snprintf(path, sizeof(path), "%s/%s", g_cache_dir, entry->d_name);
+        struct stat st;
+        if (n < 0 || (size_t)n >= sizeof(path) || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        prune_entry(entry->d_name, (long long)st.st_mtime, now);
+    }
+    closedir(dir);
+#endif
+}
+
+// Load a Lua file through the cache (same contract as luaL_loadfile)
+int bcache_loadfile(lua_State* L, const char* filename) {
+    char cache_path[1024];
+    if (!g_cache_dir || !cache_path_for(filename, cache_path, sizeof(cache_path))) {
+        return luaL_loadfile(L, filename);
+    }
+
+    lua_pushfstring(L, "@%s", filename);
+    const char* chunkname = lua_tostring(L, -1);
+    int status = load_cached(L, cache_path, chunkname);
+    if (status == LUA_OK) {
+        lua_remove(L, -2);  // chunkname
+        g_hits++;
+        return LUA_OK;
+    }
+    lua_pop(L, 1);  // chunkname
+
+    g_misses++;
+    status = luaL_loadfile(L, filename);
+    if (status == LUA_OK) store_cached(L, cache_path);
+    return status;
+}
+
+// Replacement for the standard Lua searcher (package.searchers[2])
+static int bcache_searcher(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+
+    lua_getfield(L, lua_upvalueindex(1), "searchpath");
+    lua_pushstring(L, name);
+    lua_getfield(L, lua_upvalueindex(1), "path");
+    if (!lua_isstring(L, -1)) luaL_error(L, "'package.path' must be a string");
+    lua_call(L, 2, 2);
+    if (lua_isnil(L, -2)) return 1;  // error message from searchpath
+
+    const char* filename = lua_tostring(L, -2);
+    if (bcache_loadfile(L, filename) != LUA_OK) {
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, filename, lua_tostring(L, -1));
+    }
+    lua_pushstring(L, filename);  // 2nd argument to the loader
+    return 2;
+}
+
+// Enable the cache and install the searcher; requires package library loaded
+int bcache_init(lua_State* L, const char* cache_dir, int strip) {
+    struct stat st;
+    if (stat(cache_dir, &st) != 0 && bcache_mkdir(cache_dir) != 0) return 0;
+
+    free(g_cache_dir);
+    g_cache_dir = malloc(strlen(cache_dir) + 1);
+    if (!g_cache_dir) return 0;
+    strcpy(g_cache_dir, cache_dir);
+    g_strip = strip;
+
+    lua_getglobal(L, "package");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        return 1;
+    }
+    lua_getfield(L, -1, "searchers");
+    if (lua_istable(L, -1)) {
+        lua_pushvalue(L, -2);  // package as upvalue
+        lua_pushcclosure(L, bcache_searcher, 1);
+        lua_rawseti(L, -2, 2);
+    }
+    lua_pop(L, 2);
+    return 1;
+}
+
+void bcache_report(void) {
+    if (!g_cache_dir) return;
+    printf("Bytecode cache: %ld hits, %ld misses (%s)\n", g_hits, g_misses, g_cache_dir);
+    // Only a run that stored entries can have left stale ones behind
+    if (g_misses > 0) prune_cache();
+    free(g_cache_dir);
+    g_cache_dir = NULL;
+}
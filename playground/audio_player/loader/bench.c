@@ -0,0 +1,242 @@
+/*
+ * bench.c - Measurement helpers for lua_loader --bench
+ *
+ * main.c drives the runs; this file provides the clocks, a GC cycle
+ * counter and the min/median/p95 summary (text and JSON).
+ *
+ * GC cycles are counted with a sentinel userdata whose __gc creates a new
+ * sentinel, so the count is the number of completed cycles that reached the
+ * finalizer phase. The sentinel is always young, so in generational mode
+ * minor collections are counted too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#define BENCH_SENTINEL_META "lua_loader.gc_sentinel"
+
+typedef struct {
+    double wall_ms;
+    double cpu_ms;
+    long gc_cycles;
+    unsigned long long allocated;  // bytes
+    size_t peak;                   // bytes
+} BenchRun;
+
+static BenchRun* g_runs = NULL;
+static int g_run_count = 0;
+static int g_run_cap = 0;
+
+long long bench_wall_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    long long seconds = counter.QuadPart / freq.QuadPart;
+    long long rest = counter.QuadPart % freq.QuadPart;
+    return seconds * 1000000000LL + rest * 1000000000LL / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// User + system CPU time of the process
+long long bench_cpu_ns(void) {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (long long)(k.QuadPart + u.QuadPart) * 100;  // 100ns units
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return ((long long)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000LL +
+           ((long long)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000LL;
+#endif
+}
+
+static void push_sentinel(lua_State* L, long* counter);
+
+static int sentinel_gc(lua_State* L) {
+    long** slot = luaL_checkudata(L, 1, BENCH_SENTINEL_META);
+    long* counter = *slot;
+    if (!counter) return 0;
+    (*counter)++;
+    push_sentinel(L, counter);  // next cycle
+    lua_pop(L, 1);
+    return 0;
+}
+
+static void push_sentinel(lua_State* L, long* counter) {
+    long** slot = lua_newuserdatauv(L, sizeof(long*), 0);
+    *slot = counter;
+    luaL_setmetatable(L, BENCH_SENTINEL_META);
+}
+
+// Count GC cycles of L into *counter from now on
+void bench_gc_counter_install(lua_State* L, long* counter) {
+    if (luaL_newmetatable(L, BENCH_SENTINEL_META)) {
+        lua_pushcfunction(L, sentinel_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_pop(L, 1);
+    push_sentinel(L, counter);
+    lua_pop(L, 1);  // unreferenced: collected by the next cycle
+}
+
+// Detach the counter so lua_close does not write into a dead run
+void bench_gc_counter_remove(lua_State* L) {
+    luaL_getmetatable(L, BENCH_SENTINEL_META);
+    if (lua_istable(L, -1)) {
+        lua_pushnil(L);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_pop(L, 1);
+}
+
+// Reserve space for n measured runs
+int bench_begin(int n) {
+    free(g_runs);
+    g_runs = calloc((size_t)(n > 0 ? n : 1), sizeof(BenchRun));
+    g_run_count = 0;
+    g_run_cap = g_runs ? n : 0;
+    return g_runs != NULL;
+}
+
+void bench_record(long long wall_ns, long long cpu_ns, long gc_cycles, unsigned long long allocated, size_t peak) {
+    if (g_run_count >= g_run_cap) return;
+    BenchRun* run = &g_runs[g_run_count++];
+    run->wall_ms = (double)wall_ns / 1e6;
+    run->cpu_ms = (double)cpu_ns / 1e6;
+    run->gc_cycles = gc_cycles;
+    run->allocated = allocated;
+    run->peak = peak;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+typedef struct {
+    double min;
+    double median;
+    double p95;
+} BenchSummary;
+
+// values is sorted in place
+static BenchSummary summarize(double* values, int n) {
+    BenchSummary s = {0, 0, 0};
+    if (n <= 0) return s;
+    qsort(values, (size_t)n, sizeof(double), compare_doubles);
+    s.min = values[0];
+    s.median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+    int rank = (int)(0.95 * n + 0.999999) - 1;  // nearest-rank
+    s.p95 = values[rank < 0 ? 0 : rank >= n ? n - 1 : rank];
+    return s;
+}
+
+#define BENCH_METRIC_COUNT 5
+
+static const char* g_metric_names[BENCH_METRIC_COUNT] = {"wall_ms", "cpu_ms", "gc_cycles", "allocated_kb",
+                                                         "peak_kb"};
+
+static double metric_value(const BenchRun* run, int metric) {
+    switch (metric) {
+        case 0: return run->wall_ms;
+        case 1: return run->cpu_ms;
+        case 2: return (double)run->gc_cycles;
+        case 3: return (double)run->allocated / 1024.0;
+        default: return (double)run->peak / 1024.0;
+    }
+}
+
+static void write_json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+            fputc(*s, out);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_json(FILE* out, const char* script, const BenchSummary* summary, int warmup, int reuse) {
+    const BenchRun* runs = g_runs;
+    int n = g_run_count;
+
+    fprintf(out, "{\"script\":");
+    write_json_string(out, script);
+    fprintf(out, ",\"lua\":\"%s\",\"runs\":%d,\"warmup\":%d,\"state\":\"%s\",\"summary\":{", LUA_RELEASE, n,
+            warmup, reuse ? "reused" : "fresh");
+    for (int m = 0; m < BENCH_METRIC_COUNT; m++) {
+        fprintf(out, "%s\"%s\":{\"min\":%.6f,\"median\":%.6f,\"p95\":%.6f}", m ? "," : "", g_metric_names[m],
+                summary[m].min, summary[m].median, summary[m].p95);
+    }
+    fprintf(out, "},\"samples\":[");
+    for (int i = 0; i < n; i++) {
+        fprintf(out, "%s{\"wall_ms\":%.6f,\"cpu_ms\":%.6f,\"gc_cycles\":%ld,\"allocated\":%llu,\"peak\":%zu}",
+                i ? "," : "", runs[i].wall_ms, runs[i].cpu_ms, runs[i].gc_cycles, runs[i].allocated, runs[i].peak);
+    }
+    fprintf(out, "]}\n");
+}
+
+// Print the summary table and, if json_path is set, write runs + summary as JSON ("-" = stdout)
+void bench_report(const char* script, int warmup, int reuse, const char* json_path) {
+    BenchSummary summary[BENCH_METRIC_COUNT];
+    const BenchRun* runs = g_runs;
+    int n = g_run_count;
+    double* values = malloc(sizeof(double) * (size_t)(n > 0 ? n : 1));
+    for (int m = 0; m < BENCH_METRIC_COUNT; m++) {
+        for (int i = 0; values && i < n; i++) values[i] = metric_value(&runs[i], m);
+        summary[m] = summarize(values, values ? n : 0);
+    }
+    free(values);
+
+    printf("\nBenchmark: %s (%d runs, %d warmup, %s state)\n", script, n, warmup, reuse ? "reused" : "fresh");
+    printf("%-14s %12s %12s %12s\n", "metric", "min", "median", "p95");
+    for (int m = 0; m < BENCH_METRIC_COUNT; m++) {
+        printf("%-14s %12.3f %12.3f %12.3f\n", g_metric_names[m], summary[m].min, summary[m].median, summary[m].p95);
+    }
+
+    if (json_path) {
+        FILE* out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!out) {
+            printf("Error: cannot write benchmark JSON to '%s'\n", json_path);
+        } else {
+            write_json(out, script, summary, warmup, reuse);
+            if (out != stdout) {
+                fclose(out);
+                printf("Benchmark JSON written to %s\n", json_path);
+            }
+        }
+    }
+
+    free(g_runs);
+    g_runs = NULL;
+    g_run_count = g_run_cap = 0;
+}
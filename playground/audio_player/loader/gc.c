@@ -0,0 +1,270 @@
+/*
+ * gc.c - Collector mode selection and GC telemetry for lua_loader
+ *
+ * Mode spec (--gc=... or the LUA_LOADER_GC environment variable):
+ *   incremental[,pause=N][,stepmul=N][,stepsize=N]
+ *   generational[,minormul=N][,majormul=N]
+ * Parameters left out keep Lua's defaults.
+ *
+ * Telemetry (--gc-trace=file) hooks the accounting allocator in alloc.c.
+ * Lua only frees objects while sweeping, so a run of consecutive frees is
+ * taken as one GC step, timed from the allocator call that triggered it to
+ * the last free. Mark-only steps make no allocator calls and are not seen,
+ * so step time is a lower bound. Heap size, step time and completed cycles
+ * are bucketed per interval and written as a JSON timeline at exit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// alloc.c
+typedef void (*AllocHook)(void* hook_ud, int is_free, size_t current);
+extern void alloc_set_hook(void* ud, AllocHook hook, void* hook_ud);
+
+// bench.c
+extern void bench_gc_counter_install(lua_State* L, long* counter);
+extern void bench_gc_counter_remove(lua_State* L);
+
+#define GC_TRACE_INTERVAL_NS 1000000LL  // 1ms buckets
+
+typedef struct {
+    int mode;  // 0 = leave default, LUA_GCINC or LUA_GCGEN
+    int pause;
+    int stepmul;
+    int stepsize;
+    int minormul;
+    int majormul;
+} GcConfig;
+
+typedef struct {
+    long long t;      // bucket end, ns since start
+    size_t heap;      // bytes at bucket end
+    long long gc_ns;  // step time inside the bucket
+    int steps;
+    int cycles;
+} GcSample;
+
+typedef struct {
+    lua_State* L;
+    void* alloc_ud;
+    long long start;
+    long long last_call;
+    long long bucket_end;
+
+    int in_step;
+    long long step_start;
+    long long step_end;
+
+    long steps;
+    long long total_ns;
+    long long max_ns;
+    long cycles;  // updated by the finalizer sentinel
+    long seen_cycles;
+
+    GcSample current;
+    GcSample* samples;
+    size_t count;
+    size_t cap;
+} GcTrace;
+
+static GcConfig g_config;
+static GcTrace g_trace;
+static int g_tracing = 0;
+
+static long long gc_now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    long long seconds = counter.QuadPart / freq.QuadPart;
+    long long rest = counter.QuadPart % freq.QuadPart;
+    return seconds * 1000000000LL + rest * 1000000000LL / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// Parse "name=value" into the matching field; returns 0 for unknown names
+static int parse_param(GcConfig* c, const char* item) {
+    static const struct {
+        const char* name;
+        int mode;
+        size_t offset;
+    } params[] = {
+        {"pause", LUA_GCINC, offsetof(GcConfig, pause)},
+        {"stepmul", LUA_GCINC, offsetof(GcConfig, stepmul)},
+        {"stepsize", LUA_GCINC, offsetof(GcConfig, stepsize)},
+        {"minormul", LUA_GCGEN, offsetof(GcConfig, minormul)},
+        {"majormul", LUA_GCGEN, offsetof(GcConfig, majormul)},
+    };
+    const char* eq = strchr(item, '=');
+    if (!eq) return 0;
+    for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+        size_t len = strlen(params[i].name);
+        if ((size_t)(eq - item) != len || strncmp(item, params[i].name, len) != 0) continue;
+        if (params[i].mode != c->mode) return 0;
+        int value = atoi(eq + 1);
+        if (value <= 0) return 0;
+        *(int*)((char*)c + params[i].offset) = value;
+        return 1;
+    }
+    return 0;
+}
+
+// Parse a mode spec; returns 1 on success
+int gc_parse_spec(const char* spec) {
+    GcConfig c;
+    memset(&c, 0, sizeof(c));
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+    char* item = strtok(buffer, ",");
+    if (!item) return 0;
+    if (strcmp(item, "incremental") == 0 || strcmp(item, "inc") == 0) {
+        c.mode = LUA_GCINC;
+    } else if (strcmp(item, "generational") == 0 || strcmp(item, "gen") == 0) {
+        c.mode = LUA_GCGEN;
+    } else {
+        return 0;
+    }
+    while ((item = strtok(NULL, ",")) != NULL) {
+        if (!parse_param(&c, item)) return 0;
+    }
+    g_config = c;
+    return 1;
+}
+
+// Switch L to the configured mode; returns a description for the startup banner
+const char* gc_apply(lua_State* L, char* out, size_t size) {
+    if (g_config.mode == LUA_GCINC) {
+        lua_gc(L, LUA_GCINC, g_config.pause, g_config.stepmul, g_config.stepsize);
+        snprintf(out, size, "incremental (pause=%d, stepmul=%d, stepsize=%d; 0 = default)", g_config.pause,
+                 g_config.stepmul, g_config.stepsize);
+    } else if (g_config.mode == LUA_GCGEN) {
+        lua_gc(L, LUA_GCGEN, g_config.minormul, g_config.majormul);
+        snprintf(out, size, "generational (minormul=%d, majormul=%d; 0 = default)", g_config.minormul,
+                 g_config.majormul);
+    } else {
+        return NULL;
+    }
+    return out;
+}
+
+static void trace_push_sample(GcTrace* t) {
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 4096;
+        GcSample* grown = realloc(t->samples, cap * sizeof(GcSample));
+        if (!grown) return;  // keep totals, drop the bucket
+        t->samples = grown;
+        t->cap = cap;
+    }
+    t->samples[t->count++] = t->current;
+}
+
+static void trace_end_step(GcTrace* t) {
+    long long duration = t->step_end - t->step_start;
+    t->in_step = 0;
+    t->steps++;
+    t->total_ns += duration;
+    if (duration > t->max_ns) t->max_ns = duration;
+    t->current.gc_ns += duration;
+    t->current.steps++;
+}
+
+static void trace_hook(void* ud, int is_free, size_t heap) {
+    GcTrace* t = ud;
+    long long now = gc_now_ns();
+
+    if (is_free) {
+        if (!t->in_step) {
+            t->in_step = 1;
+            t->step_start = t->last_call;  // the allocation that triggered the step
+        }
+        t->step_end = now;
+    } else if (t->in_step) {
+        trace_end_step(t);
+    }
+    t->last_call = now;
+
+    if (t->cycles != t->seen_cycles) {
+        t->current.cycles += (int)(t->cycles - t->seen_cycles);
+        t->seen_cycles = t->cycles;
+    }
+    if (now >= t->bucket_end) {
+        t->current.t = now - t->start;
+        t->current.heap = heap;
+        trace_push_sample(t);
+        memset(&t->current, 0, sizeof(t->current));
+        t->bucket_end = now + GC_TRACE_INTERVAL_NS;
+    }
+}
+
+// Start collecting telemetry for L (requires the accounting allocator)
+int gc_trace_start(lua_State* L, void* alloc_ud) {
+    if (!alloc_ud) return 0;
+    memset(&g_trace, 0, sizeof(g_trace));
+    g_trace.L = L;
+    g_trace.alloc_ud = alloc_ud;
+    g_trace.start = gc_now_ns();
+    g_trace.last_call = g_trace.start;
+    g_trace.bucket_end = g_trace.start + GC_TRACE_INTERVAL_NS;
+    bench_gc_counter_install(L, &g_trace.cycles);
+    alloc_set_hook(alloc_ud, trace_hook, &g_trace);
+    g_tracing = 1;
+    return 1;
+}
+
+// Stop before lua_close, print the summary and write the timeline
+void gc_trace_stop(const char* path) {
+    if (!g_tracing) return;
+    g_tracing = 0;
+
+    GcTrace* t = &g_trace;
+    alloc_set_hook(t->alloc_ud, NULL, NULL);
+    bench_gc_counter_remove(t->L);
+    if (t->in_step) trace_end_step(t);
+    if (t->current.steps || t->current.cycles) {
+        t->current.t = gc_now_ns() - t->start;
+        t->current.heap = (size_t)lua_gc(t->L, LUA_GCCOUNT) * 1024 + (size_t)lua_gc(t->L, LUA_GCCOUNTB);
+        trace_push_sample(t);
+    }
+
+    printf("GC: %ld cycles, %ld sweep steps, %.3f ms in steps (max %.3f ms) over %.3f s\n", t->cycles, t->steps,
+           (double)t->total_ns / 1e6, (double)t->max_ns / 1e6, (double)(gc_now_ns() - t->start) / 1e9);
+
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        printf("Error: cannot write GC trace to '%s'\n", path);
+    } else {
+        const char* mode = g_config.mode == LUA_GCGEN ? "generational" : "incremental";
+        fprintf(out, "{\"mode\":\"%s\",\"interval_ms\":%.3f,\"cycles\":%ld,\"steps\":%ld,\"gc_ms\":%.6f,"
+                     "\"max_step_ms\":%.6f,\n\"columns\":[\"t_ms\",\"heap_bytes\",\"gc_ms\",\"steps\",\"cycles\"],\n"
+                     "\"rows\":[",
+                mode, GC_TRACE_INTERVAL_NS / 1e6, t->cycles, t->steps, (double)t->total_ns / 1e6,
+                (double)t->max_ns / 1e6);
+        for (size_t i = 0; i < t->count; i++) {
+            GcSample* s = &t->samples[i];
+            fprintf(out, "%s[%.3f,%zu,%.6f,%d,%d]", i ? ",\n" : "\n", (double)s->t / 1e6, s->heap,
+                    (double)s->gc_ns / 1e6, s->steps, s->cycles);
+        }
+        fprintf(out, "\n]}\n");
+        fclose(out);
+        printf("GC timeline written to %s (%zu samples)\n", path, t->count);
+    }
+
+    free(t->samples);
+    memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,1223 @@
+/*
+ * loop.c - Coroutine event loop for lua_loader ("loop" module)
+ *
+ * Lua usage:
+ * local loop = require("loop")
+ * loop.spawn(function()
+ *     while true do loop.sleep(0.5); print("tick") end
+ * end)
+ * loop.spawn(function()
+ *     local line = loop.read(0)          -- stdin, no busy-waiting
+ *     print("got", line); loop.stop()
+ * end)
+ * loop.run()
+ *
+ * Every task is a coroutine. Waiting functions (sleep, readable, read,
+ * write, accept, connect, event) register the task with the loop and yield;
+ * loop.run() resumes it when the timer fires or the fd is ready. Timers
+ * live in a hierarchical timer wheel (4 levels of 64 slots, 1ms ticks);
+ * fd readiness comes from epoll on Linux, poll() on other POSIX systems and
+ * WaitForMultipleObjects on Windows.
+ *
+ * Loader C code can park a task too: loop_suspend() marks the running task
+ * as waiting, loop_wake() makes it runnable, and loop_add_source() adds a
+ * callback that runs after every wait (pool.c uses these for offloaded jobs).
+ *
+ * On Windows, fds are C runtime fds and waits go to their handles: a console
+ * becomes readable on a key press and loop.read returns the keys typed so far
+ * rather than a whole line; pipes are polled every millisecond; files and all
+ * writes are always ready. loop.event takes a waitable handle (an auto-reset
+ * event from a C module, as an integer) and returns 1. At most 64 handles can
+ * be waited on at once, and listen/accept/connect/write are POSIX only.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#define LOOP_USE_EPOLL
+#else
+#include <poll.h>
+#endif
+#endif
+
+#define LOOP_META "loop.Loop"
+#define LOOP_INSTANCE_KEY "loop.instance"
+#define LOOP_READ_DEFAULT 4096
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+
+enum { TASK_READY, TASK_RUNNING, TASK_WAITING, TASK_DONE };
+enum { WAIT_READ = 1, WAIT_WRITE = 2, WAIT_HANDLE = 4 };  // WAIT_HANDLE: fd is a Windows handle
+
+#ifdef _WIN32
+// How a handle signals readiness (see wait_fd and backend_wait)
+enum { HANDLE_WAITABLE, HANDLE_CONSOLE, HANDLE_PIPE, HANDLE_READY };
+#endif
+
+typedef struct Task Task;
+
+typedef struct TimerNode {
+    struct TimerNode* prev;
+    struct TimerNode* next;
+    uint64_t expires;  // tick (ms since loop start)
+    int armed;
+} TimerNode;
+
+struct Task {
+    int ref;        // registry reference to the coroutine
+    lua_State* co;
+    int nargs;      // values to pass on the first resume
+    int state;
+    int wait_fd;    // -1 when not waiting on an fd
+    int wait_events;
+    int wait_result;  // 1 = ready / timer fired as requested, 0 = timed out, -1 = closed
+    int external;     // suspended through loop_suspend()
+    TimerNode timer;
+    Task* next_ready;
+    Task* prev_all;
+    Task* next_all;
+};
+
+typedef struct {
+    Task* reader;
+    Task* writer;
+    int source;           // watched by a LoopSource
+    unsigned registered;  // WAIT_READ | WAIT_WRITE currently in the backend
+#ifdef _WIN32
+    HANDLE handle;  // fds[] is a table of handles on Windows; NULL = free slot
+    int kind;
+#endif
+} FdWatch;
+
+typedef struct {
+    TimerNode slots[WHEEL_LEVELS][WHEEL_SIZE];  // list heads
+    TimerNode overflow;
+    uint64_t current;
+    long count;
+} TimerWheel;
+
+// C-side event source (e.g. the work pool), polled after every wait
+typedef void (*LoopSourceFn)(lua_State* L, void* ud);
+
+typedef struct {
+    int fd;  // wakes the backend when readable; -1 = poll only
+    LoopSourceFn fn;
+    void* ud;
+} LoopSource;
+
+#define LOOP_MAX_SOURCES 8
+
+typedef struct {
+    TimerWheel wheel;
+    long long start_ms;
+    Task* ready_head;
+    Task* ready_tail;
+    Task* all;
+    Task* current;
+    long alive;
+    int stopped;
+    FdWatch* fds;
+    int fd_cap;
+    int fd_waiters;
+    long external;  // tasks suspended by C code until loop_wake()
+    LoopSource sources[LOOP_MAX_SOURCES];
+    int source_count;
+#ifdef LOOP_USE_EPOLL
+    int epfd;
+#endif
+} Loop;
+
+static long long loop_clock_ms(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000L;
+#endif
+}
+
+// Timer wheel
+
+static void list_init(TimerNode* head) {
+    head->prev = head->next = head;
+}
+
+static void list_append(TimerNode* head, TimerNode* node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void list_remove(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = node;
+}
+
+static void wheel_init(TimerWheel* w) {
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        for (int s = 0; s < WHEEL_SIZE; s++) list_init(&w->slots[l][s]);
+    }
+    list_init(&w->overflow);
+    w->current = 0;
+    w->count = 0;
+}
+
+// Put a node in the slot matching its distance from the current tick
+static void wheel_place(TimerWheel* w, TimerNode* node) {
+    // The current tick's slot has already been processed: due timers go in the next one
+    uint64_t expires = node->expires <= w->current ? w->current + 1 : node->expires;
+    uint64_t delta = expires - w->current;
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        if (delta < ((uint64_t)1 << (WHEEL_BITS * (l + 1)))) {
+            list_append(&w->slots[l][(expires >> (WHEEL_BITS * l)) & WHEEL_MASK], node);
+            return;
+        }
+    }
+    list_append(&w->overflow, node);
+}
+
+static void wheel_add(TimerWheel* w, TimerNode* node, uint64_t expires) {
+    node->expires = expires;
+    node->armed = 1;
+    wheel_place(w, node);
+    w->count++;
+}
+
+static void wheel_cancel(TimerWheel* w, TimerNode* node) {
+    if (!node->armed) return;
+    list_remove(node);
+    node->armed = 0;
+    w->count--;
+}
+
+// Move one higher-level slot down after the lower level wrapped
+static void wheel_cascade(TimerWheel* w, TimerNode* head) {
+    TimerNode pending;
+    list_init(&pending);
+    if (head->next != head) {
+        pending.next = head->next;
+        pending.prev = head->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        list_init(head);
+    }
+    while (pending.next != &pending) {
+        TimerNode* node = pending.next;
+        list_remove(node);
+        wheel_place(w, node);
+    }
+}
+
+static void wake_task(Loop* loop, Task* t, int result);
+
+static Task* task_from_timer(TimerNode* node) {
+    return (Task*)((char*)node - offsetof(Task, timer));
+}
+
+// Advance to tick 'now', firing expired timers
+static void wheel_advance(Loop* loop, uint64_t now) {
+    TimerWheel* w = &loop->wheel;
+    if (w->count == 0) {
+        w->current = now;
+        return;
+    }
+    while (w->current < now) {
+        w->current++;
+        uint64_t tick = w->current;
+        if ((tick & WHEEL_MASK) == 0) {
+            int l = 1;
+            for (; l < WHEEL_LEVELS; l++) {
+                wheel_cascade(w, &w->slots[l][(tick >> (WHEEL_BITS * l)) & WHEEL_MASK]);
+                if (((tick >> (WHEEL_BITS * l)) & WHEEL_MASK) != 0) break;
+            }
+            if (l == WHEEL_LEVELS) wheel_cascade(w, &w->overflow);
+        }
+        TimerNode* head = &w->slots[0][tick & WHEEL_MASK];
+        while (head->next != head) {
+            TimerNode* node = head->next;
+            wheel_cancel(w, node);
+            Task* t = task_from_timer(node);
+            // A sleep completes normally; an fd wait that times out reports 0
+            wake_task(loop, t, t->wait_fd < 0 ? 1 : 0);
+        }
+        if (w->count == 0) {
+            w->current = now;
+            return;
+        }
+    }
+}
+
+// Milliseconds until the wheel needs attention, or -1 if no timers
+static long wheel_next_delay(TimerWheel* w) {
+    if (w->count == 0) return -1;
+    for (uint64_t d = 1; d <= WHEEL_SIZE; d++) {
+        uint64_t tick = w->current + d;
+        if ((tick & WHEEL_MASK) == 0) return (long)d;  // cascade point
+        TimerNode* head = &w->slots[0][tick & WHEEL_MASK];
+        if (head->next != head) return (long)d;
+    }
+    return WHEEL_SIZE;
+}
+
+// Ready queue and fd registration
+
+static void ready_push(Loop* loop, Task* t) {
+    t->state = TASK_READY;
+    t->next_ready = NULL;
+    if (loop->ready_tail) {
+        loop->ready_tail->next_ready = t;
+    } else {
+        loop->ready_head = t;
+    }
+    loop->ready_tail = t;
+}
+
+static int fd_reserve(Loop* loop, int fd) {
+    if (fd < loop->fd_cap) return 1;
+    int cap = loop->fd_cap ? loop->fd_cap : 64;
+    while (cap <= fd) cap *= 2;
+    FdWatch* grown = realloc(loop->fds, sizeof(FdWatch) * (size_t)cap);
+    if (!grown) return 0;
+    memset(grown + loop->fd_cap, 0, sizeof(FdWatch) * (size_t)(cap - loop->fd_cap));
+    loop->fds = grown;
+    loop->fd_cap = cap;
+    return 1;
+}
+
+// Sync the backend with the waiters of fd; returns 0 if fd cannot be polled
+static int fd_update(Loop* loop, int fd) {
+    FdWatch* w = &loop->fds[fd];
+    unsigned want = (w->reader || w->source ? WAIT_READ : 0) | (w->writer ? WAIT_WRITE : 0);
+    if (want == w->registered) return 1;
+#ifdef LOOP_USE_EPOLL
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((want & WAIT_READ) ? EPOLLIN : 0) | ((want & WAIT_WRITE) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    int op = w->registered == 0 ? EPOLL_CTL_ADD : want == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if (epoll_ctl(loop->epfd, op, fd, &ev) != 0 && op != EPOLL_CTL_DEL) return 0;
+#endif
+#ifdef _WIN32
+    if (want == 0) w->handle = NULL;
+#endif
+    w->registered = want;
+    return 1;
+}
+
+static void fd_detach(Loop* loop, Task* t) {
+    if (t->wait_fd < 0) return;
+    FdWatch* w = &loop->fds[t->wait_fd];
+    if (w->reader == t) w->reader = NULL;
+    if (w->writer == t) w->writer = NULL;
+    fd_update(loop, t->wait_fd);
+    loop->fd_waiters--;
+    t->wait_fd = -1;
+}
+
+static void wake_task(Loop* loop, Task* t, int result) {
+    if (t->state != TASK_WAITING) return;
+    if (t->external) {
+        t->external = 0;
+        loop->external--;
+    }
+    wheel_cancel(&loop->wheel, &t->timer);
+    fd_detach(loop, t);
+    t->wait_result = result;
+    t->nargs = 0;
+    ready_push(loop, t);
+}
+
+static Loop* get_loop(lua_State* L) {
+    return luaL_checkudata(L, lua_upvalueindex(1), LOOP_META);
+}
+
+// The running task, checking that L is its coroutine
+static Task* current_task(lua_State* L, Loop* loop) {
+    Task* t = loop->current;
+    if (!t || t->co != L) luaL_error(L, "must be called from a task started with loop.spawn");
+    return t;
+}
+
+static uint64_t deadline_ticks(Loop* loop, double seconds) {
+    if (seconds < 0) seconds = 0;
+    return (uint64_t)(loop_clock_ms() - loop->start_ms) + (uint64_t)(seconds * 1000.0 + 0.5);
+}
+
+#ifdef _WIN32
+
+static int handle_kind(HANDLE h) {
+    DWORD mode;
+    switch (GetFileType(h)) {
+        case FILE_TYPE_CHAR:
+            return GetConsoleMode(h, &mode) ? HANDLE_CONSOLE : HANDLE_READY;
+        case FILE_TYPE_PIPE:
+            return HANDLE_PIPE;
+        default:
+            return HANDLE_READY;  // disk files never block
+    }
+}
+
+// Slot of h in the handle table, added on first use; -1 when the table is full
+static int handle_slot(Loop* loop, HANDLE h, int kind) {
+    int free_slot = -1;
+    int waitable = 0;
+    for (int i = 0; i < loop->fd_cap; i++) {
+        FdWatch* w = &loop->fds[i];
+        if (w->handle == h) return i;
+        if (!w->handle) {
+            if (free_slot < 0) free_slot = i;
+        } else if (w->kind != HANDLE_PIPE) {
+            waitable++;
+        }
+    }
+    if (kind != HANDLE_PIPE && waitable >= MAXIMUM_WAIT_OBJECTS) return -1;
+    if (free_slot < 0) {
+        free_slot = loop->fd_cap;
+        if (!fd_reserve(loop, free_slot)) return -1;
+    }
+    loop->fds[free_slot].handle = h;
+    loop->fds[free_slot].kind = kind;
+    return free_slot;
+}
+
+// A pipe has no waitable state; a failed peek means the writer is gone (eof)
+static int pipe_ready(HANDLE h) {
+    DWORD avail = 0;
+    return !PeekNamedPipe(h, NULL, 0, NULL, &avail, NULL) || avail > 0;
+}
+
+// A console handle is signaled by any input record: drop key-ups, mouse,
+// focus and resize records so only a typed character counts as readable
+static int console_has_key(HANDLE h) {
+    INPUT_RECORD rec;
+    DWORD n;
+    while (PeekConsoleInputW(h, &rec, 1, &n) && n == 1) {
+        if (rec.EventType == KEY_EVENT && rec.Event.KeyEvent.bKeyDown && rec.Event.KeyEvent.uChar.UnicodeChar) return 1;
+        ReadConsoleInputW(h, &rec, 1, &n);
+    }
+    return 0;
+}
+
+#endif
+
+// Register the current task as waiting on fd (and optionally a timeout)
+static void wait_fd(lua_State* L, Loop* loop, Task* t, int fd, int events, double timeout) {
+#ifdef _WIN32
+    // Handles fit in 32 bits, so loop.event gets them as plain integers
+    HANDLE h = (events & WAIT_HANDLE) ? (HANDLE)(intptr_t)fd : (HANDLE)_get_osfhandle(fd);
+    if (h == NULL || h == INVALID_HANDLE_VALUE) luaL_error(L, "invalid fd %d", fd);
+    int kind = (events & WAIT_HANDLE) ? HANDLE_WAITABLE : handle_kind(h);
+    if ((events & WAIT_WRITE) || kind == HANDLE_READY) {
+        // Files and writes complete without waiting on anything
+        t->wait_result = 1;
+        ready_push(loop, t);
+        return;
+    }
+    int index = handle_slot(loop, h, kind);
+    if (index < 0) luaL_error(L, "cannot wait on fd %d: too many handles", fd);
+    FdWatch* w = &loop->fds[index];
+    if (w->reader) luaL_error(L, "fd %d already has a reader waiting", fd);
+
+    w->reader = t;
+    t->wait_fd = index;
+    t->wait_events = WAIT_READ;
+    t->state = TASK_WAITING;
+    loop->fd_waiters++;
+    fd_update(loop, index);
+    if (timeout >= 0) wheel_add(&loop->wheel, &t->timer, deadline_ticks(loop, timeout));
+#else
+    events &= ~WAIT_HANDLE;
+    if (fd < 0 || !fd_reserve(loop, fd)) luaL_error(L, "invalid fd %d", fd);
+    FdWatch* w = &loop->fds[fd];
+    Task** slot = events == WAIT_READ ? &w->reader : &w->writer;
+    if (*slot) luaL_error(L, "fd %d already has a %s waiting", fd, events == WAIT_READ ? "reader" : "writer");
+
+    *slot = t;
+    t->wait_fd = fd;
+    t->wait_events = events;
+    t->state = TASK_WAITING;
+    loop->fd_waiters++;
+    if (!fd_update(loop, fd)) {
+        // Regular files cannot be polled and are always ready
+        fd_detach(loop, t);
+        t->wait_result = 1;
+        ready_push(loop, t);
+        return;
+    }
+    if (timeout >= 0) wheel_add(&loop->wheel, &t->timer, deadline_ticks(loop, timeout));
+#endif
+}
+
+// Task lifecycle
+
+static Task* task_new(lua_State* L, Loop* loop) {
+    Task* t = calloc(1, sizeof(Task));
+    if (!t) luaL_error(L, "not enough memory for task");
+    t->wait_fd = -1;
+    list_init(&t->timer);
+    t->next_all = loop->all;
+    if (loop->all) loop->all->prev_all = t;
+    loop->all = t;
+    loop->alive++;
+    return t;
+}
+
+static void task_free(lua_State* L, Loop* loop, Task* t) {
+    if (t->external) loop->external--;
+    wheel_cancel(&loop->wheel, &t->timer);
+    fd_detach(loop, t);
+    if (t->prev_all) {
+        t->prev_all->next_all = t->next_all;
+    } else {
+        loop->all = t->next_all;
+    }
+    if (t->next_all) t->next_all->prev_all = t->prev_all;
+    if (L) luaL_unref(L, LUA_REGISTRYINDEX, t->ref);
+    loop->alive--;
+    free(t);
+}
+
+// loop.spawn(fn, ...) -> coroutine
+static int l_spawn(lua_State* L) {
+    Loop* loop = get_loop(L);
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    int nargs = lua_gettop(L) - 1;
+
+    lua_State* co = lua_newthread(L);
+    Task* t = task_new(L, loop);
+    lua_pushvalue(L, -1);
+    t->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    t->co = co;
+
+    lua_pushvalue(L, 1);
+    lua_xmove(L, co, 1);
+    for (int i = 2; i <= nargs + 1; i++) lua_pushvalue(L, i);
+    lua_xmove(L, co, nargs);
+    t->nargs = nargs;
+    ready_push(loop, t);
+    return 1;  // the coroutine
+}
+
+static int k_sleep(lua_State* L, int status, lua_KContext ctx) {
+    (void)L;
+    (void)status;
+    (void)ctx;
+    return 0;
+}
+
+// loop.sleep(seconds)
+static int l_sleep(lua_State* L) {
+    Loop* loop = get_loop(L);
+    double seconds = luaL_checknumber(L, 1);
+    Task* t = current_task(L, loop);
+    t->state = TASK_WAITING;
+    wheel_add(&loop->wheel, &t->timer, deadline_ticks(loop, seconds));
+    return lua_yieldk(L, 0, 0, k_sleep);
+}
+
+// loop.yield(): let other ready tasks run
+static int l_yield(lua_State* L) {
+    Loop* loop = get_loop(L);
+    Task* t = current_task(L, loop);
+    t->nargs = 0;
+    ready_push(loop, t);
+    return lua_yieldk(L, 0, 0, k_sleep);
+}
+
+// nil, "timeout" | nil, "closed" for a wait that did not end with the fd ready
+static int push_wait_failure(lua_State* L, Task* t) {
+    lua_pushnil(L);
+    lua_pushstring(L, t->wait_result < 0 ? "closed" : "timeout");
+    return 2;
+}
+
+static int k_readable(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    (void)ctx;
+    Task* t = get_loop(L)->current;
+    if (t->wait_result <= 0) {
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, t->wait_result < 0 ? "closed" : "timeout");
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// loop.readable(fd [, timeout]) / loop.writable(fd [, timeout]) -> true | false, "timeout" | false, "closed"
+static int wait_ready(lua_State* L, int events) {
+    Loop* loop = get_loop(L);
+    int fd = (int)luaL_checkinteger(L, 1);
+    double timeout = luaL_optnumber(L, 2, -1);
+    Task* t = current_task(L, loop);
+    wait_fd(L, loop, t, fd, events, timeout);
+    return lua_yieldk(L, 0, 0, k_readable);
+}
+
+static int l_readable(lua_State* L) {
+    return wait_ready(L, WAIT_READ);
+}
+
+static int l_writable(lua_State* L) {
+    return wait_ready(L, WAIT_WRITE);
+}
+
+#ifdef _WIN32
+
+// Characters typed so far (Enter as "\n"), about max bytes at most
+static void console_read(HANDLE h, luaL_Buffer* b, size_t max) {
+    INPUT_RECORD rec;
+    DWORD n, pending;
+    while (luaL_bufflen(b) + 4 <= max && GetNumberOfConsoleInputEvents(h, &pending) && pending > 0) {
+        if (!ReadConsoleInputW(h, &rec, 1, &n) || n != 1) break;
+        KEY_EVENT_RECORD* key = &rec.Event.KeyEvent;
+        if (rec.EventType != KEY_EVENT || !key->bKeyDown || !key->uChar.UnicodeChar) continue;
+        WCHAR c = key->uChar.UnicodeChar == L'\r' ? L'\n' : key->uChar.UnicodeChar;
+        char utf8[4];
+        int len = WideCharToMultiByte(CP_UTF8, 0, &c, 1, utf8, (int)sizeof(utf8), NULL, NULL);
+        for (WORD i = 0; len > 0 && i < key->wRepeatCount; i++) luaL_addlstring(b, utf8, (size_t)len);
+    }
+}
+
+static int k_read(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    Task* t = get_loop(L)->current;
+    if (t->wait_result <= 0) return push_wait_failure(L, t);
+
+    int fd = (int)(ctx >> 32);
+    size_t max = (size_t)(ctx & 0xffffffff);
+    HANDLE h = (HANDLE)_get_osfhandle(fd);
+    luaL_Buffer b;
+    if (handle_kind(h) == HANDLE_CONSOLE) {
+        luaL_buffinit(L, &b);
+        console_read(h, &b, max);
+        if (luaL_bufflen(&b) == 0) {
+            // Only non-character records were pending: wait again
+            lua_settop(L, 0);
+            wait_fd(L, get_loop(L), t, fd, WAIT_READ, -1);
+            return lua_yieldk(L, 0, ctx, k_read);
+        }
+        luaL_pushresult(&b);
+        return 1;
+    }
+    char* p = luaL_buffinitsize(L, &b, max);
+    int n = _read(fd, p, (unsigned)max);
+    if (n < 0) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    if (n == 0) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "eof");
+        return 2;
+    }
+    luaL_pushresultsize(&b, (size_t)n);
+    return 1;
+}
+
+// The wait itself consumed the auto-reset event
+static int k_event(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    (void)ctx;
+    Task* t = get_loop(L)->current;
+    if (t->wait_result <= 0) return push_wait_failure(L, t);
+    lua_pushinteger(L, 1);
+    return 1;
+}
+
+// loop.close(fd)
+static int l_close(lua_State* L) {
+    Loop* loop = get_loop(L);
+    int fd = (int)luaL_checkinteger(L, 1);
+    HANDLE h = (HANDLE)_get_osfhandle(fd);
+    for (int i = 0; h != INVALID_HANDLE_VALUE && i < loop->fd_cap; i++) {
+        if (loop->fds[i].handle == h && loop->fds[i].reader) wake_task(loop, loop->fds[i].reader, -1);
+    }
+    lua_pushboolean(L, _close(fd) == 0);
+    return 1;
+}
+
+#else
+
+static int k_read(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    Task* t = get_loop(L)->current;
+    if (t->wait_result <= 0) return push_wait_failure(L, t);
+
+    int fd = (int)(ctx >> 32);
+    size_t max = (size_t)(ctx & 0xffffffff);
+    luaL_Buffer b;
+    char* p = luaL_buffinitsize(L, &b, max);
+    ssize_t n = read(fd, p, max);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // Spurious wakeup: wait again
+        Loop* loop = get_loop(L);
+        wait_fd(L, loop, t, fd, WAIT_READ, -1);
+        return lua_yieldk(L, 0, ctx, k_read);
+    }
+    if (n < 0) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    if (n == 0) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "eof");
+        return 2;
+    }
+    luaL_pushresultsize(&b, (size_t)n);
+    return 1;
+}
+
+#endif
+
+// loop.read(fd [, max [, timeout]]) -> data | nil, "eof" | nil, "timeout" | nil, "closed"
+static int l_read(lua_State* L) {
+    Loop* loop = get_loop(L);
+    int fd = (int)luaL_checkinteger(L, 1);
+    lua_Integer max = luaL_optinteger(L, 2, LOOP_READ_DEFAULT);
+    double timeout = luaL_optnumber(L, 3, -1);
+    luaL_argcheck(L, max > 0 && max <= 0x7fffffff, 2, "invalid size");
+    Task* t = current_task(L, loop);
+    lua_settop(L, 0);
+    wait_fd(L, loop, t, fd, WAIT_READ, timeout);
+    return lua_yieldk(L, 0, ((lua_KContext)fd << 32) | (lua_KContext)max, k_read);
+}
+
+#ifndef _WIN32
+
+static int k_write(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    Loop* loop = get_loop(L);
+    Task* t = loop->current;
+    int fd = (int)ctx;
+    if (t->wait_result < 0) return push_wait_failure(L, t);
+    // Stack: data, offset
+    size_t len;
+    const char* data = lua_tolstring(L, 1, &len);
+    size_t offset = (size_t)lua_tointeger(L, 2);
+    while (offset < len) {
+        ssize_t n = write(fd, data + offset, len - offset);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            lua_pushinteger(L, (lua_Integer)offset);
+            lua_replace(L, 2);
+            wait_fd(L, loop, t, fd, WAIT_WRITE, -1);
+            return lua_yieldk(L, 0, ctx, k_write);
+        }
+        if (n < 0) {
+            lua_pushnil(L);
+            lua_pushstring(L, strerror(errno));
+            return 2;
+        }
+        offset += (size_t)n;
+    }
+    lua_pushinteger(L, (lua_Integer)len);
+    return 1;
+}
+
+// loop.write(fd, data) -> bytes written | nil, error
+static int l_write(lua_State* L) {
+    get_loop(L);
+    int fd = (int)luaL_checkinteger(L, 1);
+    luaL_checkstring(L, 2);
+    current_task(L, get_loop(L))->wait_result = 1;
+    lua_remove(L, 1);
+    lua_settop(L, 1);
+    lua_pushinteger(L, 0);
+    return k_write(L, LUA_OK, (lua_KContext)fd);
+}
+
+static int k_event(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    Task* t = get_loop(L)->current;
+    if (t->wait_result <= 0) return push_wait_failure(L, t);
+    uint64_t counter = 0;
+    ssize_t n = read((int)ctx, &counter, sizeof(counter));
+    if (n != (ssize_t)sizeof(counter)) {
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            wait_fd(L, get_loop(L), t, (int)ctx, WAIT_READ, -1);
+            return lua_yieldk(L, 0, ctx, k_event);
+        }
+        lua_pushnil(L);
+        lua_pushstring(L, n < 0 ? strerror(errno) : "short read");
+        return 2;
+    }
+    lua_pushinteger(L, (lua_Integer)counter);
+    return 1;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int fill_address(lua_State* L, const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return luaL_error(L, "socket path too long: %s", path);
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+static int push_errno(lua_State* L) {
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    return 2;
+}
+
+// loop.listen(path [, backlog]) -> fd: non-blocking Unix stream socket (stale socket file is replaced)
+static int l_listen(lua_State* L) {
+    const char* path = luaL_checkstring(L, 1);
+    int backlog = (int)luaL_optinteger(L, 2, 16);
+    struct sockaddr_un addr;
+    fill_address(L, path, &addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return push_errno(L);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0 || !set_nonblocking(fd)) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return push_errno(L);
+    }
+    lua_pushinteger(L, fd);
+    return 1;
+}
+
+static int k_accept(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    Task* t = get_loop(L)->current;
+    if (t->wait_result <= 0) return push_wait_failure(L, t);
+    int client = accept((int)ctx, NULL, NULL);
+    if (client < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        wait_fd(L, get_loop(L), t, (int)ctx, WAIT_READ, -1);
+        return lua_yieldk(L, 0, ctx, k_accept);
+    }
+    if (client < 0 || !set_nonblocking(client)) return push_errno(L);
+    lua_pushinteger(L, client);
+    return 1;
+}
+
+// loop.accept(fd [, timeout]) -> client fd
+static int l_accept(lua_State* L) {
+    Loop* loop = get_loop(L);
+    int fd = (int)luaL_checkinteger(L, 1);
+    double timeout = luaL_optnumber(L, 2, -1);
+    Task* t = current_task(L, loop);
+    wait_fd(L, loop, t, fd, WAIT_READ, timeout);
+    return lua_yieldk(L, 0, (lua_KContext)fd, k_accept);
+}
+
+static int k_connect(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    Task* t = get_loop(L)->current;
+    int fd = (int)ctx;
+    if (t->wait_result <= 0) {
+        if (t->wait_result == 0) close(fd);  // loop.close already closed it otherwise
+        return push_wait_failure(L, t);
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) err = errno;
+    if (err != 0) {
+        close(fd);
+        errno = err;
+        return push_errno(L);
+    }
+    lua_pushinteger(L, fd);
+    return 1;
+}
+
+// loop.connect(path [, timeout]) -> fd
+static int l_connect(lua_State* L) {
+    Loop* loop = get_loop(L);
+    const char* path = luaL_checkstring(L, 1);
+    double timeout = luaL_optnumber(L, 2, -1);
+    Task* t = current_task(L, loop);
+    struct sockaddr_un addr;
+    fill_address(L, path, &addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return push_errno(L);
+    if (!set_nonblocking(fd)) {
+        close(fd);
+        return push_errno(L);
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        lua_pushinteger(L, fd);
+        return 1;
+    }
+    if (errno != EINPROGRESS && errno != EAGAIN) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return push_errno(L);
+    }
+    wait_fd(L, loop, t, fd, WAIT_WRITE, timeout);
+    return lua_yieldk(L, 0, (lua_KContext)fd, k_connect);
+}
+
+// loop.close(fd)
+static int l_close(lua_State* L) {
+    Loop* loop = get_loop(L);
+    int fd = (int)luaL_checkinteger(L, 1);
+    // Waiters on a closed fd would never wake: fail them with "closed"
+    if (fd >= 0 && fd < loop->fd_cap) {
+        if (loop->fds[fd].reader) wake_task(loop, loop->fds[fd].reader, -1);
+        if (loop->fds[fd].writer) wake_task(loop, loop->fds[fd].writer, -1);
+    }
+    lua_pushboolean(L, close(fd) == 0);
+    return 1;
+}
+
+#endif
+
+// loop.event(fd [, timeout]) -> counter: wait on an eventfd (Windows: event handle) from a C module and drain it
+static int l_event(lua_State* L) {
+    Loop* loop = get_loop(L);
+    int fd = (int)luaL_checkinteger(L, 1);
+    double timeout = luaL_optnumber(L, 2, -1);
+    Task* t = current_task(L, loop);
+    wait_fd(L, loop, t, fd, WAIT_READ | WAIT_HANDLE, timeout);
+    return lua_yieldk(L, 0, (lua_KContext)fd, k_event);
+}
+
+// Wait for fd readiness or the timeout (ms, -1 = forever)
+static void backend_wait(Loop* loop, long timeout_ms) {
+#ifdef _WIN32
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    int slots[MAXIMUM_WAIT_OBJECTS];
+    int count = 0;
+    int poll = 0;  // pipes and sources without a handle are checked every millisecond
+    for (int i = 0; i < loop->fd_cap; i++) {
+        FdWatch* w = &loop->fds[i];
+        if (!w->handle) continue;
+        if (w->kind == HANDLE_PIPE) {
+            if (pipe_ready(w->handle)) {
+                wake_task(loop, w->reader, 1);
+                timeout_ms = 0;
+            } else {
+                poll = 1;
+            }
+        } else if (count < MAXIMUM_WAIT_OBJECTS) {
+            handles[count] = w->handle;
+            slots[count++] = i;
+        }
+    }
+    for (int i = 0; i < loop->source_count; i++) {
+        if (loop->sources[i].fd == -1 && loop->external > 0) poll = 1;
+    }
+    if (poll && (timeout_ms < 0 || timeout_ms > 1)) timeout_ms = 1;
+    DWORD wait = timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms;
+    if (count == 0) {
+        if (wait != INFINITE && wait > 0) Sleep(wait);
+        return;
+    }
+    DWORD r = WaitForMultipleObjects((DWORD)count, handles, FALSE, wait);
+    if (r >= WAIT_OBJECT_0 + (DWORD)count) return;  // timeout
+    // Only the first signaled handle is reported: test the rest without waiting
+    int first = (int)(r - WAIT_OBJECT_0);
+    for (int k = first; k < count; k++) {
+        if (k > first && WaitForSingleObject(handles[k], 0) != WAIT_OBJECT_0) continue;
+        FdWatch* w = &loop->fds[slots[k]];
+        if (w->kind == HANDLE_CONSOLE && !console_has_key(w->handle)) continue;
+        if (w->reader) wake_task(loop, w->reader, 1);
+    }
+#elif defined(LOOP_USE_EPOLL)
+    struct epoll_event events[64];
+    int n = epoll_wait(loop->epfd, events, 64, (int)timeout_ms);
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        FdWatch* w = &loop->fds[fd];
+        uint32_t e = events[i].events;
+        if (w->reader && (e & (EPOLLIN | EPOLLHUP | EPOLLERR))) wake_task(loop, w->reader, 1);
+        if (w->writer && (e & (EPOLLOUT | EPOLLHUP | EPOLLERR))) wake_task(loop, w->writer, 1);
+    }
+#else
+    int watched = loop->fd_waiters + loop->source_count;
+    struct pollfd* pfds = malloc(sizeof(struct pollfd) * (size_t)(watched ? watched : 1));
+    int count = 0;
+    for (int fd = 0; pfds && fd < loop->fd_cap && count < watched; fd++) {
+        FdWatch* w = &loop->fds[fd];
+        if (!w->reader && !w->writer && !w->source) continue;
+        pfds[count].fd = fd;
+        pfds[count].events = (short)((w->reader || w->source ? POLLIN : 0) | (w->writer ? POLLOUT : 0));
+        pfds[count].revents = 0;
+        count++;
+    }
+    int n = poll(pfds, (nfds_t)count, (int)timeout_ms);
+    for (int i = 0; n > 0 && i < count; i++) {
+        FdWatch* w = &loop->fds[pfds[i].fd];
+        short e = pfds[i].revents;
+        if (w->reader && (e & (POLLIN | POLLHUP | POLLERR))) wake_task(loop, w->reader, 1);
+        if (w->writer && (e & (POLLOUT | POLLHUP | POLLERR))) wake_task(loop, w->writer, 1);
+    }
+    free(pfds);
+#endif
+}
+
+// Resume one task; returns 0 and leaves a message on L if it raised an error
+static int run_task(lua_State* L, Loop* loop, Task* t) {
+    int nres = 0;
+    int nargs = t->nargs;
+    t->nargs = 0;
+    t->state = TASK_RUNNING;
+    loop->current = t;
+    int status = lua_resume(t->co, L, nargs, &nres);
+    loop->current = NULL;
+
+    if (status == LUA_YIELD) {
+        lua_pop(t->co, nres);
+        // Plain coroutine.yield() inside a task: just run it again later
+        if (t->state == TASK_RUNNING) ready_push(loop, t);
+        return 1;
+    }
+    if (status == LUA_OK) {
+        t->state = TASK_DONE;
+        task_free(L, loop, t);
+        return 1;
+    }
+    luaL_traceback(L, t->co, lua_tostring(t->co, -1), 0);
+    t->state = TASK_DONE;
+    task_free(L, loop, t);
+    return 0;
+}
+
+// loop.run(): run until every task has finished or loop.stop() is called
+static int l_run(lua_State* L) {
+    Loop* loop = get_loop(L);
+    if (loop->current) return luaL_error(L, "loop.run cannot be called from a task");
+    loop->stopped = 0;
+
+    while (!loop->stopped && loop->alive > 0) {
+        // Run only the tasks that were ready at the start of this pass
+        Task* tail = loop->ready_tail;
+        while (loop->ready_head && !loop->stopped) {
+            Task* t = loop->ready_head;
+            loop->ready_head = t->next_ready;
+            if (!loop->ready_head) loop->ready_tail = NULL;
+            if (!run_task(L, loop, t)) return lua_error(L);
+            if (t == tail) break;
+        }
+        if (loop->stopped || loop->alive == 0) break;
+
+        long timeout = loop->ready_head ? 0 : wheel_next_delay(&loop->wheel);
+        if (timeout < 0 && loop->fd_waiters == 0 && loop->external == 0) {
+            return luaL_error(L, "loop.run: %d task(s) blocked with nothing to wait for", (int)loop->alive);
+        }
+        backend_wait(loop, timeout);
+        for (int i = 0; i < loop->source_count; i++) loop->sources[i].fn(L, loop->sources[i].ud);
+        wheel_advance(loop, (uint64_t)(loop_clock_ms() - loop->start_ms));
+    }
+    return 0;
+}
+
+static int l_stop(lua_State* L) {
+    get_loop(L)->stopped = 1;
+    return 0;
+}
+
+// loop.now() -> seconds since the loop was created
+static int l_now(lua_State* L) {
+    Loop* loop = get_loop(L);
+    lua_pushnumber(L, (double)(loop_clock_ms() - loop->start_ms) / 1000.0);
+    return 1;
+}
+
+// loop.stats() -> { tasks, ready, timers, fds, external }
+static int l_stats(lua_State* L) {
+    Loop* loop = get_loop(L);
+    int ready = 0;
+    for (Task* t = loop->ready_head; t; t = t->next_ready) ready++;
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, loop->alive);
+    lua_setfield(L, -2, "tasks");
+    lua_pushinteger(L, ready);
+    lua_setfield(L, -2, "ready");
+    lua_pushinteger(L, loop->wheel.count);
+    lua_setfield(L, -2, "timers");
+    lua_pushinteger(L, loop->fd_waiters);
+    lua_setfield(L, -2, "fds");
+    lua_pushinteger(L, loop->external);
+    lua_setfield(L, -2, "external");
+    return 1;
+}
+
+static int l_loop_gc(lua_State* L) {
+    Loop* loop = luaL_checkudata(L, 1, LOOP_META);
+    while (loop->all) task_free(NULL, loop, loop->all);  // registry refs die with the state
+    free(loop->fds);
+    loop->fds = NULL;
+    loop->fd_cap = 0;
+#ifdef LOOP_USE_EPOLL
+    if (loop->epfd >= 0) close(loop->epfd);
+    loop->epfd = -1;
+#endif
+    return 0;
+}
+
+static const luaL_Reg loop_lib[] = {
+    {"spawn", l_spawn},
+    {"run", l_run},
+    {"stop", l_stop},
+    {"sleep", l_sleep},
+    {"yield", l_yield},
+    {"now", l_now},
+    {"stats", l_stats},
+    {"readable", l_readable},
+    {"writable", l_writable},
+    {"read", l_read},
+    {"event", l_event},
+    {"close", l_close},
+#ifndef _WIN32
+    {"write", l_write},
+    {"listen", l_listen},
+    {"accept", l_accept},
+    {"connect", l_connect},
+#endif
+    {NULL, NULL}};
+
+int luaopen_loop(lua_State* L) {
+    luaL_newlibtable(L, loop_lib);
+
+    Loop* loop = lua_newuserdatauv(L, sizeof(Loop), 0);
+    memset(loop, 0, sizeof(*loop));
+    wheel_init(&loop->wheel);
+    loop->start_ms = loop_clock_ms();
+#ifdef LOOP_USE_EPOLL
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) return luaL_error(L, "epoll_create1 failed: %s", strerror(errno));
+#endif
+    if (luaL_newmetatable(L, LOOP_META)) {
+        lua_pushcfunction(L, l_loop_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, LOOP_INSTANCE_KEY);  // for loop_suspend() and friends
+
+    luaL_setfuncs(L, loop_lib, 1);  // loop userdata as shared upvalue
+    return 1;
+}
+
+// C API for other loader modules (pool.c)
+
+// The loop of L, or NULL if require("loop") has not run
+static Loop* loop_of(lua_State* L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, LOOP_INSTANCE_KEY);
+    Loop* loop = luaL_testudata(L, -1, LOOP_META);
+    lua_pop(L, 1);
+    return loop;
+}
+
+// Nonzero if L is the coroutine of the running loop task
+int loop_in_task(lua_State* L) {
+    Loop* loop = loop_of(L);
+    return loop && loop->current && loop->current->co == L;
+}
+
+// Suspend the running task until loop_wake(); returns NULL when L is not a
+// loop task (the caller should then do the work synchronously). The caller
+// must follow up with lua_yieldk.
+void* loop_suspend(lua_State* L) {
+    Loop* loop = loop_of(L);
+    if (!loop || !loop->current || loop->current->co != L) return NULL;
+    Task* t = loop->current;
+    t->state = TASK_WAITING;
+    t->external = 1;
+    loop->external++;
+    return t;
+}
+
+// Make a task suspended by loop_suspend() runnable again (owning thread only)
+void loop_wake(lua_State* L, void* task) {
+    Loop* loop = loop_of(L);
+    if (loop && task) wake_task(loop, task, 1);
+}
+
+// Call fn after every wait; fd (if >= 0) must become readable when fn has work
+// (on Windows: an auto-reset event handle that is set, or -1)
+int loop_add_source(lua_State* L, int fd, LoopSourceFn fn, void* ud) {
+    Loop* loop = loop_of(L);
+    if (!loop || loop->source_count == LOOP_MAX_SOURCES) return 0;
+#ifdef _WIN32
+    // fd is an event handle here (-1 = none)
+    if (fd != -1) {
+        int index = handle_slot(loop, (HANDLE)(intptr_t)fd, HANDLE_WAITABLE);
+        if (index < 0) return 0;
+        loop->fds[index].source = 1;
+        fd_update(loop, index);
+    }
+#else
+    if (fd >= 0) {
+        if (!fd_reserve(loop, fd)) return 0;
+        loop->fds[fd].source = 1;
+        if (!fd_update(loop, fd)) {
+            loop->fds[fd].source = 0;
+            return 0;
+        }
+    }
+#endif
+    LoopSource* src = &loop->sources[loop->source_count++];
+    src->fd = fd;
+    src->fn = fn;
+    src->ud = ud;
+    return 1;
+}
+
+void loop_remove_source(lua_State* L, LoopSourceFn fn, void* ud) {
+    Loop* loop = loop_of(L);
+    if (!loop) return;
+    for (int i = 0; i < loop->source_count; i++) {
+        LoopSource* src = &loop->sources[i];
+        if (src->fn != fn || src->ud != ud) continue;
+#ifdef _WIN32
+        for (int k = 0; src->fd != -1 && k < loop->fd_cap; k++) {
+            if (loop->fds[k].handle != (HANDLE)(intptr_t)src->fd) continue;
+            loop->fds[k].source = 0;
+            fd_update(loop, k);
+        }
+#else
+        if (src->fd >= 0 && src->fd < loop->fd_cap) {
+            loop->fds[src->fd].source = 0;
+            fd_update(loop, src->fd);
+        }
+#endif
+        loop->sources[i] = loop->sources[--loop->source_count];
+        return;
+    }
+}
+
+// Make require("loop") available in L
+void loop_register(lua_State* L) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+    lua_pushcfunction(L, luaopen_loop);
+    lua_setfield(L, -2, "loop");
+    lua_pop(L, 1);
+}
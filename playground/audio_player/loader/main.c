@@ -4,8 +4,30 @@
  * Uses static linking with Lua libraries
  * Much simpler than dynamic loading
  *
- * Compile: gcc -o lua_loader.exe loader/main.c -I../../lua/include -L../../lua/lib -llua -lm
- * Usage: lua_loader.exe script.lua [args...]
+ * Compile: gcc -o lua_loader.exe loader/main.c loader/profile.c loader/bcache.c loader/alloc.c loader/preload.c loader/bench.c loader/thread.c loader/gc.c loader/rcache.c loader/loop.c loader/pool.c loader/trace.c -I../../lua/include -L../../lua/lib -llua -lm
+ * Static: make static (links audio and say into the loader, see preload.c)
+ * Usage: lua_loader.exe [options] script.lua [args...]
+ *
+ * Options:
+ *   --profile[=file]     Sample the Lua stack, write folded stacks (default lua_loader.folded)
+ *   --profile-hz=N       Sampling rate in Hz (default 1000)
+ *   --profile-top=N      Number of rows in the self/total table (default 20)
+ *   --bytecode-cache[=dir]  Cache compiled scripts and modules (default .luacache)
+ *   --strip              Strip debug info from cached bytecode
+ *   --alloc=MODE         Lua allocator: system, pool or arena; prints memory stats at exit
+ *   --mem-limit=SIZE     Hard cap on Lua heap size (suffix K, M or G)
+ *   --lazy               Static build: open linked modules on first require
+ *   --bench N            Run the script N times and print min/median/p95 timings
+ *   --warmup M           Unmeasured runs before --bench (default 0)
+ *   --bench-reuse        Run every iteration in the same Lua state (default: fresh state per run)
+ *   --bench-json[=file]  Also write the samples as JSON (default stdout)
+ *   --gc=SPEC            incremental[,pause=N,stepmul=N,stepsize=N] or generational[,minormul=N,majormul=N]
+ *                        (default from LUA_LOADER_GC)
+ *   --gc-trace=file      Write a GC timeline (heap size, step time, cycles) as JSON
+ *   --no-require-cache   Use the standard require searchers (see rcache.c)
+ *   --pool-workers=N     Threads for offloaded C calls (default: one per core, see pool.c)
+ *   --pool-queue=N       Jobs queued to the workers at once (default 64)
+ *   --trace-startup[=file]  Write startup phases and requires as a Chrome trace (default lua_loader.trace.json)
  */
 
 #include <stdio.h>
@@ -16,24 +38,226 @@
 #include "lua.h"
 #include "lualib.h"
 
+// profile.c
+extern int profiler_start(lua_State* L, int hz);
+extern void profiler_stop(const char* folded_path, int top_n);
+
+// bcache.c
+extern int bcache_init(lua_State* L, const char* cache_dir, int strip);
+extern int bcache_loadfile(lua_State* L, const char* filename);
+extern void bcache_report(void);
+
+// alloc.c
+extern int alloc_parse_mode(const char* name);
+extern lua_State* alloc_newstate(int mode, size_t limit, void** out_ud);
+extern void alloc_report_and_free(void* ud);
+
+// bench.c
+extern long long bench_wall_ns(void);
+extern long long bench_cpu_ns(void);
+extern void bench_gc_counter_install(lua_State* L, long* counter);
+extern void bench_gc_counter_remove(lua_State* L);
+extern int bench_begin(int n);
+extern void bench_record(long long wall_ns, long long cpu_ns, long gc_cycles, unsigned long long allocated,
+                         size_t peak);
+extern void bench_report(const char* script, int warmup, int reuse, const char* json_path);
+
+// alloc.c (bench counters)
+extern void alloc_get_stats(void* ud, size_t* current, size_t* peak, unsigned long long* allocated);
+extern void alloc_reset_peak(void* ud);
+extern void alloc_free(void* ud);
+
+// thread.c
+extern void thread_register(lua_State* L);
+
+// loop.c
+extern void loop_register(lua_State* L);
+
+// pool.c
+extern void pool_configure(int workers, int queue);
+extern void pool_register(lua_State* L);
+extern void pool_report(void);
+
+// trace.c
+extern void trace_start(void);
+extern void trace_phase(const char* name);
+extern void trace_skip(void);
+extern void trace_install(lua_State* L);
+extern void trace_stop(const char* path);
+
+// gc.c
+extern int gc_parse_spec(const char* spec);
+extern const char* gc_apply(lua_State* L, char* out, size_t size);
+extern int gc_trace_start(lua_State* L, void* alloc_ud);
+extern void gc_trace_stop(const char* path);
+
+// rcache.c
+extern int rcache_init(lua_State* L);
+extern void rcache_report(void);
+
+// preload.c
+extern int preload_register(lua_State* L, int lazy);
+extern void preload_describe(char* out, size_t size);
+
+// Command line options (everything before the script name)
+typedef struct {
+    const char* profile_path;  // NULL = profiler off
+    int profile_hz;
+    int profile_top;
+    const char* cache_dir;     // NULL = bytecode cache off
+    int strip;
+    int alloc_mode;            // -1 = luaL_newstate default allocator
+    size_t mem_limit;          // 0 = unlimited
+    int lazy;                  // open static modules on first require
+    int bench_runs;            // 0 = normal single run
+    int bench_warmup;
+    int bench_reuse;
+    const char* bench_json;    // NULL = no JSON output
+    const char* gc_trace;      // NULL = GC telemetry off
+    int require_cache;
+    int pool_workers;          // 0 = one per core
+    int pool_queue;            // 0 = default
+    const char* trace_path;    // NULL = startup tracing off
+} LoaderOptions;
+
 // Set up command line arguments in Lua global 'arg' table
-static void setup_lua_args(lua_State* L, int argc, char* argv[]) {
-    lua_createtable(L, argc, 0);  // Create 'arg' table
+// arg[0] is the loader, arg[1] the script and the rest its arguments (loader options are skipped)
+static void setup_lua_args(lua_State* L, int argc, char* argv[], int script_index) {
+    lua_createtable(L, argc - script_index + 1, 0);  // Create 'arg' table
 
-    for (int i = 0; i < argc; i++) {
-        lua_pushinteger(L, i);       // Index
-        lua_pushstring(L, argv[i]);  // Argument value
-        lua_settable(L, -3);         // arg[i] = argv[i]
+    lua_pushinteger(L, 0);
+    lua_pushstring(L, argv[0]);
+    lua_settable(L, -3);  // arg[0] = loader
+
+    for (int i = script_index; i < argc; i++) {
+        lua_pushinteger(L, i - script_index + 1);  // Index
+        lua_pushstring(L, argv[i]);                // Argument value
+        lua_settable(L, -3);                       // arg[n] = argv[i]
     }
 
     lua_setglobal(L, "arg");  // Set global variable 'arg'
 }
 
+// Parse "--name=value" integer options; returns 1 if matched
+static int parse_int_option(const char* arg, const char* name, int* out) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=') return 0;
+    *out = atoi(arg + len + 1);
+    return 1;
+}
+
+// Parse "--name N" integer options that take the value as the next argument; returns 1 if matched
+static int parse_int_pair(int argc, char* argv[], int* i, const char* name, int* out) {
+    if (strcmp(argv[*i], name) != 0 || *i + 1 >= argc) return 0;
+    char* end;
+    long value = strtol(argv[*i + 1], &end, 10);
+    if (end == argv[*i + 1] || *end != '\0') return 0;
+    *out = (int)value;
+    (*i)++;
+    return 1;
+}
+
+// Parse a byte count with optional K/M/G suffix; returns 0 on error
+static size_t parse_size(const char* text) {
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || value <= 0) return 0;
+    switch (*end) {
+        case 'k': case 'K': value *= 1024.0; end++; break;
+        case 'm': case 'M': value *= 1024.0 * 1024.0; end++; break;
+        case 'g': case 'G': value *= 1024.0 * 1024.0 * 1024.0; end++; break;
+        default: break;
+    }
+    return *end == '\0' ? (size_t)value : 0;
+}
+
+// Parse loader options; returns index of the script argument or -1 on error
+static int parse_options(int argc, char* argv[], LoaderOptions* opts) {
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(arg, "--profile") == 0) {
+            opts->profile_path = "lua_loader.folded";
+        } else if (strncmp(arg, "--profile=", 10) == 0) {
+            opts->profile_path = arg + 10;
+        } else if (strcmp(arg, "--bytecode-cache") == 0) {
+            opts->cache_dir = ".luacache";
+        } else if (strncmp(arg, "--bytecode-cache=", 17) == 0) {
+            opts->cache_dir = arg + 17;
+        } else if (strcmp(arg, "--strip") == 0) {
+            opts->strip = 1;
+        } else if (strcmp(arg, "--trace-startup") == 0) {
+            opts->trace_path = "lua_loader.trace.json";
+        } else if (strncmp(arg, "--trace-startup=", 16) == 0) {
+            opts->trace_path = arg + 16;
+        } else if (strcmp(arg, "--no-require-cache") == 0) {
+            opts->require_cache = 0;
+        } else if (strcmp(arg, "--lazy") == 0) {
+            opts->lazy = 1;
+        } else if (strcmp(arg, "--bench-reuse") == 0) {
+            opts->bench_reuse = 1;
+        } else if (strcmp(arg, "--bench-json") == 0) {
+            opts->bench_json = "-";
+        } else if (strncmp(arg, "--bench-json=", 13) == 0) {
+            opts->bench_json = arg + 13;
+        } else if (strncmp(arg, "--gc=", 5) == 0) {
+            if (!gc_parse_spec(arg + 5)) {
+                printf("Error: Invalid GC spec '%s'\n", arg + 5);
+                return -1;
+            }
+        } else if (strncmp(arg, "--gc-trace=", 11) == 0) {
+            opts->gc_trace = arg + 11;
+        } else if (parse_int_pair(argc, argv, &i, "--bench", &opts->bench_runs) ||
+                   parse_int_pair(argc, argv, &i, "--warmup", &opts->bench_warmup) ||
+                   parse_int_option(arg, "--bench", &opts->bench_runs) ||
+                   parse_int_option(arg, "--warmup", &opts->bench_warmup)) {
+            // handled
+        } else if (strncmp(arg, "--alloc=", 8) == 0) {
+            opts->alloc_mode = alloc_parse_mode(arg + 8);
+            if (opts->alloc_mode < 0) {
+                printf("Error: Unknown allocator '%s' (expected system, pool or arena)\n", arg + 8);
+                return -1;
+            }
+        } else if (strncmp(arg, "--mem-limit=", 12) == 0) {
+            opts->mem_limit = parse_size(arg + 12);
+            if (opts->mem_limit == 0) {
+                printf("Error: Invalid memory limit '%s'\n", arg + 12);
+                return -1;
+            }
+        } else if (parse_int_option(arg, "--profile-hz", &opts->profile_hz) ||
+                   parse_int_option(arg, "--profile-top", &opts->profile_top) ||
+                   parse_int_option(arg, "--pool-workers", &opts->pool_workers) ||
+                   parse_int_option(arg, "--pool-queue", &opts->pool_queue)) {
+            // handled
+        } else {
+            printf("Error: Unknown option '%s'\n", arg);
+            return -1;
+        }
+    }
+    if (opts->bench_runs < 0 || opts->bench_warmup < 0) {
+        printf("Error: --bench and --warmup need non-negative counts\n");
+        return -1;
+    }
+
+    // A memory cap and GC telemetry need an accounting allocator
+    if ((opts->mem_limit || opts->gc_trace) && opts->alloc_mode < 0) opts->alloc_mode = alloc_parse_mode("system");
+    return i < argc ? i : -1;
+}
+
 // Execute Lua script file
 static int execute_lua_file(lua_State* L, const char* filename) {
     printf("Executing Lua script: %s\n", filename);
 
-    int result = luaL_dofile(L, filename);
+    trace_skip();
+    int result = bcache_loadfile(L, filename);
+    trace_phase("compile script");
+    if (result == LUA_OK) {
+        result = lua_pcall(L, 0, LUA_MULTRET, 0);
+        trace_phase("run script");
+    }
     if (result != LUA_OK) {
         // Error occurred
         const char* error_msg = lua_tostring(L, -1);
@@ -56,21 +280,176 @@ static int file_exists(const char* filename) {
     return 0;
 }
 
+// Create a Lua state with libraries, static modules, bytecode cache and 'arg' set up
+static lua_State* create_state(const LoaderOptions* opts, int argc, char* argv[], int script_index, void** alloc_ud,
+                               int verbose) {
+    *alloc_ud = NULL;
+    lua_State* L = opts->alloc_mode < 0 ? luaL_newstate() : alloc_newstate(opts->alloc_mode, opts->mem_limit, alloc_ud);
+    if (!L) return NULL;
+    trace_phase("lua_newstate");
+    if (verbose) printf("Lua state created successfully\n");
+
+    // Open standard libraries
+    luaL_openlibs(L);
+    trace_phase("luaL_openlibs");
+    if (verbose) {
+        printf("Lua standard libraries loaded\n");
+        printf("Lua version: %s\n", LUA_VERSION);
+    }
+
+    char gc_desc[128];
+    if (gc_apply(L, gc_desc, sizeof(gc_desc)) && verbose) printf("GC mode: %s\n", gc_desc);
+
+    thread_register(L);  // require("thread")
+    loop_register(L);    // require("loop")
+    pool_register(L);    // offloaded C calls resume loop tasks
+    trace_phase("loader modules");
+
+    int static_count = preload_register(L, opts->lazy);
+    trace_phase("static modules");
+    if (verbose && static_count > 0) {
+        char names[256];
+        preload_describe(names, sizeof(names));
+        printf("Static modules %s: %s\n", opts->lazy ? "preloaded" : "opened", names);
+    }
+
+    if (opts->cache_dir) {
+        if (!bcache_init(L, opts->cache_dir, opts->strip)) {
+            printf("Warning: Cannot use bytecode cache directory '%s'\n", opts->cache_dir);
+        } else if (verbose) {
+            printf("Bytecode cache enabled: %s%s\n", opts->cache_dir, opts->strip ? " (stripped)" : "");
+        }
+        trace_phase("bytecode cache");
+    }
+
+    // After bcache_init: the cached Lua searcher loads through the bytecode cache
+    if (opts->require_cache && rcache_init(L) && verbose) printf("Require cache enabled\n");
+    trace_install(L);  // wraps the final searchers
+    trace_phase("require setup");
+
+    // Set up command line arguments
+    setup_lua_args(L, argc, argv, script_index);
+    trace_phase("arg table");
+    if (verbose) printf("Command line arguments set up\n");
+    return L;
+}
+
+// Run the script warmup + N times and report per-run statistics
+static int run_bench(const LoaderOptions* opts, int argc, char* argv[], int script_index) {
+    const char* script_file = argv[script_index];
+
+    // Allocation counters need the accounting allocator
+    LoaderOptions bench_opts = *opts;
+    if (bench_opts.alloc_mode < 0) bench_opts.alloc_mode = alloc_parse_mode("system");
+    if (!bench_begin(opts->bench_runs)) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+
+    printf("Benchmarking %s: %d warmup + %d runs, %s state\n", script_file, opts->bench_warmup, opts->bench_runs,
+           opts->bench_reuse ? "reused" : "fresh");
+
+    lua_State* L = NULL;
+    void* alloc_ud = NULL;
+    long gc_cycles = 0;
+    int status = LUA_OK;
+    int total = opts->bench_warmup + opts->bench_runs;
+
+    for (int i = 0; i < total && status == LUA_OK; i++) {
+        if (!L) {
+            L = create_state(&bench_opts, argc, argv, script_index, &alloc_ud, 0);
+            if (!L) {
+                printf("Error: Failed to create Lua state\n");
+                return 1;
+            }
+            gc_cycles = 0;
+            bench_gc_counter_install(L, &gc_cycles);
+        }
+
+        unsigned long long allocated_before;
+        alloc_reset_peak(alloc_ud);
+        alloc_get_stats(alloc_ud, NULL, NULL, &allocated_before);
+        long gc_before = gc_cycles;
+        long long cpu_start = bench_cpu_ns();
+        long long wall_start = bench_wall_ns();
+
+        status = bcache_loadfile(L, script_file);
+        if (status == LUA_OK) status = lua_pcall(L, 0, 0, 0);
+
+        long long wall = bench_wall_ns() - wall_start;
+        long long cpu = bench_cpu_ns() - cpu_start;
+        if (status != LUA_OK) {
+            const char* error_msg = lua_tostring(L, -1);
+            printf("Lua Error (run %d): %s\n", i + 1, error_msg ? error_msg : "Unknown error");
+            lua_pop(L, 1);
+        } else if (i >= opts->bench_warmup) {
+            size_t peak;
+            unsigned long long allocated;
+            alloc_get_stats(alloc_ud, NULL, &peak, &allocated);
+            bench_record(wall, cpu, gc_cycles - gc_before, allocated - allocated_before, peak);
+        }
+
+        if (!opts->bench_reuse || status != LUA_OK || i == total - 1) {
+            bench_gc_counter_remove(L);
+            lua_close(L);
+            alloc_free(alloc_ud);
+            L = NULL;
+        }
+    }
+
+    if (status == LUA_OK) bench_report(script_file, opts->bench_warmup, opts->bench_reuse, opts->bench_json);
+    bcache_report();
+    rcache_report();
+    return status == LUA_OK ? 0 : 1;
+}
+
 // Main entry point
 int main(int argc, char* argv[]) {
     printf("Simple Lua Runner v1.0\n");
     printf("======================\n");
 
+    LoaderOptions opts = {NULL, 1000, 20, NULL, 0, -1, 0, 0, 0, 0, 0, NULL, NULL, 1, 0, 0, NULL};
+
+    // Collector config from the environment; --gc overrides it
+    const char* gc_env = getenv("LUA_LOADER_GC");
+    if (gc_env && *gc_env && !gc_parse_spec(gc_env)) {
+        printf("Warning: Ignoring invalid LUA_LOADER_GC '%s'\n", gc_env);
+    }
+
     // Check arguments
-    if (argc < 2) {
-        printf("Usage: %s script.lua [args...]\n", argv[0]);
+    int script_index = parse_options(argc, argv, &opts);
+    if (script_index < 0) {
+        printf("Usage: %s [options] script.lua [args...]\n", argv[0]);
+        printf("Options:\n");
+        printf("  --profile[=file]   Sample Lua stacks, write folded output (default lua_loader.folded)\n");
+        printf("  --profile-hz=N     Sampling rate (default 1000)\n");
+        printf("  --profile-top=N    Rows in the self/total table (default 20)\n");
+        printf("  --bytecode-cache[=dir]  Cache compiled bytecode (default .luacache)\n");
+        printf("  --strip            Strip debug info from cached bytecode\n");
+        printf("  --alloc=MODE       Allocator: system, pool or arena (prints memory stats)\n");
+        printf("  --mem-limit=SIZE   Hard cap on Lua heap, e.g. 64M\n");
+        printf("  --lazy             Static build: open linked modules on first require\n");
+        printf("  --bench N          Time N runs of the script (min/median/p95)\n");
+        printf("  --warmup M         Unmeasured runs before the measured ones\n");
+        printf("  --bench-reuse      Reuse one Lua state for all runs\n");
+        printf("  --bench-json[=file]  Write bench samples as JSON (default stdout)\n");
+        printf("  --gc=SPEC          incremental[,pause=N,stepmul=N,stepsize=N] or\n");
+        printf("                     generational[,minormul=N,majormul=N] (env LUA_LOADER_GC)\n");
+        printf("  --gc-trace=file    Write GC timeline JSON at exit\n");
+        printf("  --no-require-cache Probe package.path/cpath with the standard searchers\n");
+        printf("  --pool-workers=N   Worker threads for offloaded C calls (default: cores)\n");
+        printf("  --pool-queue=N     Bounded work queue size (default 64)\n");
+        printf("  --trace-startup[=file]  Chrome trace of startup phases and requires\n");
         printf("Examples:\n");
         printf("  %s test.lua\n", argv[0]);
         printf("  %s game.lua --fullscreen\n", argv[0]);
+        printf("  %s --profile=player.folded player_full.lua\n", argv[0]);
+        printf("  %s --bench 20 --warmup 3 --bench-json=bench.json test.lua\n", argv[0]);
         return 1;
     }
 
-    const char* script_file = argv[1];
+    pool_configure(opts.pool_workers, opts.pool_queue);
+    const char* script_file = argv[script_index];
 
     // Check if script file exists
     if (!file_exists(script_file)) {
@@ -78,30 +457,51 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (opts.bench_runs > 0) {
+        return run_bench(&opts, argc, argv, script_index);
+    }
+
+    if (opts.trace_path) trace_start();
+
     // Create Lua state
-    lua_State* L = luaL_newstate();
+    void* alloc_ud = NULL;
+    lua_State* L = create_state(&opts, argc, argv, script_index, &alloc_ud, 1);
     if (!L) {
         printf("Error: Failed to create Lua state\n");
         return 1;
     }
 
-    printf("Lua state created successfully\n");
-
-    // Open standard libraries
-    luaL_openlibs(L);
-    printf("Lua standard libraries loaded\n");
-    printf("Lua version: %s\n", LUA_VERSION);
+    if (opts.gc_trace && !gc_trace_start(L, alloc_ud)) {
+        printf("Warning: GC telemetry needs the accounting allocator\n");
+        opts.gc_trace = NULL;
+    }
 
-    // Set up command line arguments
-    setup_lua_args(L, argc, argv);
-    printf("Command line arguments set up\n");
+    if (opts.profile_path) {
+        if (profiler_start(L, opts.profile_hz)) {
+            printf("Profiler started (%d Hz)\n", opts.profile_hz);
+        } else {
+            printf("Warning: Failed to start profiler\n");
+            opts.profile_path = NULL;
+        }
+    }
 
     // Execute the script
     int exit_code = execute_lua_file(L, script_file);
 
+    if (opts.profile_path) {
+        profiler_stop(opts.profile_path, opts.profile_top);
+    }
+
+    if (opts.gc_trace) gc_trace_stop(opts.gc_trace);
+    if (opts.trace_path) trace_stop(opts.trace_path);
+    bcache_report();
+    rcache_report();
+    pool_report();
+
     // Cleanup
     printf("Cleaning up...\n");
     lua_close(L);
+    alloc_report_and_free(alloc_ud);
 
     if (exit_code == LUA_OK) {
         printf("Program completed successfully\n");
@@ -0,0 +1,413 @@
+/*
+ * pool.c - Work pool for blocking C calls in lua_loader
+ *
+ * C modules reach the pool through the registry, so they need no link-time
+ * dependency on the loader:
+ *
+ *   const LoaderPoolApi* api = lua_touserdata(L, -1);  // registry["lua_loader.pool"]
+ *   return api->submit(L, work, finish, job);
+ *
+ * work(job) runs on a worker thread and must not touch the Lua state.
+ * finish(L, job) runs afterwards on the owning thread, pushes the results,
+ * returns their count and frees job. When called from a loop task (see
+ * loop.c) submit yields the coroutine and the loop resumes it once the job
+ * is done; anywhere else it runs work and finish in place, so the binding
+ * behaves like a plain blocking call.
+ *
+ * The worker queue is bounded (--pool-queue). Jobs submitted while it is
+ * full wait on the owning thread, with their tasks still suspended, and are
+ * handed over as workers drain the queue. Workers start on the first
+ * asynchronous submit (--pool-workers, default: one per core).
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#define POOL_API_KEY "lua_loader.pool"
+#define POOL_GUARD_META "lua_loader.pool_guard"
+#define POOL_API_VERSION 1
+#define POOL_DEFAULT_QUEUE 64
+#define POOL_MAX_WORKERS 64
+
+typedef void (*PoolWorkFn)(void* data);
+typedef int (*PoolFinishFn)(lua_State* L, void* data);
+
+typedef struct {
+    int version;
+    int (*submit)(lua_State* L, PoolWorkFn work, PoolFinishFn finish, void* data);
+} LoaderPoolApi;
+
+// loop.c
+typedef void (*LoopSourceFn)(lua_State* L, void* ud);
+extern int loop_in_task(lua_State* L);
+extern void* loop_suspend(lua_State* L);
+extern void loop_wake(lua_State* L, void* task);
+extern int loop_add_source(lua_State* L, int fd, LoopSourceFn fn, void* ud);
+
+typedef struct PoolJob {
+    PoolWorkFn work;
+    PoolFinishFn finish;
+    void* data;
+    void* task;
+    struct PoolJob* next;
+} PoolJob;
+
+typedef struct {
+    int started;
+    int stopping;
+    int worker_count;
+    int capacity;
+
+    // Shared with the workers, guarded by lock
+    PoolJob* queue_head;
+    PoolJob* queue_tail;
+    int queued;
+    int running;
+    PoolJob* done;  // newest first
+
+    // Owning thread only
+    PoolJob* wait_head;
+    PoolJob* wait_tail;
+    int waiting;
+    long submitted;
+    long completed;
+    int peak_queued;
+
+    int notify_fd[2];  // [0] read end (eventfd: both the same), -1 on Windows
+#ifdef _WIN32
+    HANDLE notify_event;  // auto-reset, waited on by the loop
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+    HANDLE threads[POOL_MAX_WORKERS];
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t threads[POOL_MAX_WORKERS];
+#endif
+} Pool;
+
+static Pool g_pool;
+static int g_config_workers = 0;  // 0 = one per core
+static int g_config_queue = POOL_DEFAULT_QUEUE;
+static long g_inline_runs = 0;  // submits outside a loop task
+
+static int pool_submit(lua_State* L, PoolWorkFn work, PoolFinishFn finish, void* data);
+static const LoaderPoolApi g_api = {POOL_API_VERSION, pool_submit};
+
+// Set before the first submit; values <= 0 keep the defaults
+void pool_configure(int workers, int queue) {
+    if (workers > 0) g_config_workers = workers < POOL_MAX_WORKERS ? workers : POOL_MAX_WORKERS;
+    if (queue > 0) g_config_queue = queue;
+}
+
+static int core_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+static void pool_lock(Pool* p) {
+#ifdef _WIN32
+    EnterCriticalSection(&p->lock);
+#else
+    pthread_mutex_lock(&p->lock);
+#endif
+}
+
+static void pool_unlock(Pool* p) {
+#ifdef _WIN32
+    LeaveCriticalSection(&p->lock);
+#else
+    pthread_mutex_unlock(&p->lock);
+#endif
+}
+
+static void pool_notify(Pool* p) {
+#ifndef _WIN32
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t n = write(p->notify_fd[1], &one, sizeof(one));
+#else
+    char one = 1;
+    ssize_t n = write(p->notify_fd[1], &one, 1);
+#endif
+    (void)n;  // a full pipe already has a wakeup pending
+#else
+    SetEvent(p->notify_event);
+#endif
+}
+
+static void pool_clear_notify(Pool* p) {
+#ifndef _WIN32
+    char buffer[64];
+    while (read(p->notify_fd[0], buffer, sizeof(buffer)) > 0) {
+    }
+#else
+    (void)p;  // the loop's wait resets the event
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg) {
+#else
+static void* worker_main(void* arg) {
+#endif
+    Pool* p = arg;
+    for (;;) {
+        pool_lock(p);
+        while (!p->stopping && !p->queue_head) {
+#ifdef _WIN32
+            SleepConditionVariableCS(&p->wake, &p->lock, INFINITE);
+#else
+            pthread_cond_wait(&p->wake, &p->lock);
+#endif
+        }
+        if (p->stopping) {
+            pool_unlock(p);
+            break;
+        }
+        PoolJob* job = p->queue_head;
+        p->queue_head = job->next;
+        if (!p->queue_head) p->queue_tail = NULL;
+        p->queued--;
+        p->running++;
+        pool_unlock(p);
+
+        job->work(job->data);
+
+        pool_lock(p);
+        p->running--;
+        job->next = p->done;
+        p->done = job;
+        pool_unlock(p);
+        pool_notify(p);
+    }
+    return 0;
+}
+
+// Move waiting jobs into the worker queue while there is room (owning thread)
+static void pool_fill_queue(Pool* p) {
+    if (!p->wait_head) return;
+    pool_lock(p);
+    int moved = 0;
+    while (p->wait_head && p->queued < p->capacity) {
+        PoolJob* job = p->wait_head;
+        p->wait_head = job->next;
+        if (!p->wait_head) p->wait_tail = NULL;
+        p->waiting--;
+        job->next = NULL;
+        if (p->queue_tail) {
+            p->queue_tail->next = job;
+        } else {
+            p->queue_head = job;
+        }
+        p->queue_tail = job;
+        p->queued++;
+        moved++;
+    }
+    if (p->queued > p->peak_queued) p->peak_queued = p->queued;
+    pool_unlock(p);
+#ifdef _WIN32
+    if (moved) WakeAllConditionVariable(&p->wake);
+#else
+    if (moved) pthread_cond_broadcast(&p->wake);
+#endif
+}
+
+// Loop source: resume the tasks whose jobs finished
+static void pool_drain(lua_State* L, void* ud) {
+    Pool* p = ud;
+    pool_clear_notify(p);
+    pool_lock(p);
+    PoolJob* done = p->done;
+    p->done = NULL;
+    pool_unlock(p);
+
+    // Oldest first
+    PoolJob* ordered = NULL;
+    while (done) {
+        PoolJob* next = done->next;
+        done->next = ordered;
+        ordered = done;
+        done = next;
+    }
+    while (ordered) {
+        PoolJob* job = ordered;
+        ordered = job->next;
+        p->completed++;
+        loop_wake(L, job->task);
+    }
+    pool_fill_queue(p);
+}
+
+static int pool_start(lua_State* L, Pool* p) {
+    if (p->started) return p->worker_count > 0;
+    memset(p, 0, sizeof(*p));
+    p->worker_count = g_config_workers > 0 ? g_config_workers : core_count();
+    if (p->worker_count > POOL_MAX_WORKERS) p->worker_count = POOL_MAX_WORKERS;
+    p->capacity = g_config_queue;
+    p->notify_fd[0] = p->notify_fd[1] = -1;
+
+#if defined(__linux__)
+    p->notify_fd[0] = p->notify_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (p->notify_fd[0] < 0) return 0;
+#elif !defined(_WIN32)
+    if (pipe(p->notify_fd) != 0) return 0;
+    for (int i = 0; i < 2; i++) fcntl(p->notify_fd[i], F_SETFL, fcntl(p->notify_fd[i], F_GETFL, 0) | O_NONBLOCK);
+#endif
+#ifdef _WIN32
+    p->notify_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!p->notify_event) return 0;
+    if (!loop_add_source(L, (int)(intptr_t)p->notify_event, pool_drain, p)) {
+        CloseHandle(p->notify_event);
+        return 0;
+    }
+#else
+    if (!loop_add_source(L, p->notify_fd[0], pool_drain, p)) {
+        close(p->notify_fd[0]);
+        if (p->notify_fd[1] != p->notify_fd[0]) close(p->notify_fd[1]);
+        return 0;
+    }
+#endif
+
+#ifdef _WIN32
+    InitializeCriticalSection(&p->lock);
+    InitializeConditionVariable(&p->wake);
+#else
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+#endif
+    int started = 0;
+    for (; started < p->worker_count; started++) {
+#ifdef _WIN32
+        p->threads[started] = CreateThread(NULL, 0, worker_main, p, 0, NULL);
+        if (!p->threads[started]) break;
+#else
+        if (pthread_create(&p->threads[started], NULL, worker_main, p) != 0) break;
+#endif
+    }
+    p->worker_count = started;
+    p->started = 1;
+    return started > 0;
+}
+
+// Stop the workers; jobs that never ran are dropped without calling finish
+static void pool_shutdown(Pool* p) {
+    if (!p->started) return;
+    pool_lock(p);
+    p->stopping = 1;
+    pool_unlock(p);
+#ifdef _WIN32
+    WakeAllConditionVariable(&p->wake);
+    for (int i = 0; i < p->worker_count; i++) {
+        WaitForSingleObject(p->threads[i], INFINITE);
+        CloseHandle(p->threads[i]);
+    }
+    DeleteCriticalSection(&p->lock);
+    CloseHandle(p->notify_event);
+#else
+    pthread_cond_broadcast(&p->wake);
+    for (int i = 0; i < p->worker_count; i++) pthread_join(p->threads[i], NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    close(p->notify_fd[0]);
+    if (p->notify_fd[1] != p->notify_fd[0]) close(p->notify_fd[1]);
+#endif
+    PoolJob* lists[3] = {p->queue_head, p->done, p->wait_head};
+    for (int i = 0; i < 3; i++) {
+        while (lists[i]) {
+            PoolJob* next = lists[i]->next;
+            free(lists[i]);
+            lists[i] = next;
+        }
+    }
+    memset(p, 0, sizeof(*p));
+}
+
+static int k_finish(lua_State* L, int status, lua_KContext ctx) {
+    (void)status;
+    PoolJob* job = (PoolJob*)ctx;
+    PoolFinishFn finish = job->finish;
+    void* data = job->data;
+    free(job);
+    return finish(L, data);
+}
+
+static int pool_submit(lua_State* L, PoolWorkFn work, PoolFinishFn finish, void* data) {
+    Pool* p = &g_pool;
+    PoolJob* job = NULL;
+    // Only a task that can yield here waits for the pool; a call from inside a C
+    // boundary (e.g. a table.sort comparator) runs the job inline instead
+    if (lua_isyieldable(L) && loop_in_task(L) && pool_start(L, p)) job = malloc(sizeof(PoolJob));
+    if (!job) {
+        g_inline_runs++;
+        work(data);
+        return finish(L, data);
+    }
+
+    job->work = work;
+    job->finish = finish;
+    job->data = data;
+    job->task = loop_suspend(L);
+    job->next = NULL;
+    if (p->wait_tail) {
+        p->wait_tail->next = job;
+    } else {
+        p->wait_head = job;
+    }
+    p->wait_tail = job;
+    p->waiting++;
+    p->submitted++;
+    pool_fill_queue(p);
+    return lua_yieldk(L, 0, (lua_KContext)job, k_finish);
+}
+
+static int pool_guard_gc(lua_State* L) {
+    (void)L;
+    pool_shutdown(&g_pool);
+    return 0;
+}
+
+// Publish the pool API in L's registry; the workers stop when L is closed
+void pool_register(lua_State* L) {
+    lua_pushlightuserdata(L, (void*)&g_api);
+    lua_setfield(L, LUA_REGISTRYINDEX, POOL_API_KEY);
+
+    lua_newuserdatauv(L, 1, 0);
+    if (luaL_newmetatable(L, POOL_GUARD_META)) {
+        lua_pushcfunction(L, pool_guard_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, POOL_GUARD_META);
+}
+
+// Print pool statistics if it was used
+void pool_report(void) {
+    Pool* p = &g_pool;
+    if (!p->started) return;
+    printf("Work pool: %d workers, %ld jobs (%ld done), peak queue %d/%d, %ld run inline\n", p->worker_count,
+           p->submitted, p->completed, p->peak_queued, p->capacity, g_inline_runs);
+}
@@ -0,0 +1,63 @@
+/*
+ * preload.c - Statically linked C modules for lua_loader
+ *
+ * Built with -DLOADER_STATIC_MODULES (make static), audio.c, util.c and
+ * the say module are linked into the loader. Their luaopen_* functions are
+ * registered in package.preload, so require() finds them without probing
+ * package.cpath or calling dlopen.
+ *
+ * Default: each module is opened at startup and stored in package.loaded.
+ * --lazy:  only the preload entries are installed; a module is opened the
+ *          first time it is required.
+ */
+
+#include <stdio.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef LOADER_STATIC_MODULES
+
+extern int luaopen_audio(lua_State* L);
+extern int luaopen_say(lua_State* L);
+
+static const luaL_Reg g_static_modules[] = {
+    {"audio", luaopen_audio},
+    {"say", luaopen_say},
+    {NULL, NULL}};
+
+#else
+
+static const luaL_Reg g_static_modules[] = {{NULL, NULL}};
+
+#endif
+
+// Register statically linked modules; returns the number of modules
+int preload_register(lua_State* L, int lazy) {
+    int count = 0;
+
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+    for (const luaL_Reg* m = g_static_modules; m->name; m++) {
+        lua_pushcfunction(L, m->func);
+        lua_setfield(L, -2, m->name);
+        count++;
+    }
+    lua_pop(L, 1);
+
+    if (!lazy) {
+        for (const luaL_Reg* m = g_static_modules; m->name; m++) {
+            luaL_requiref(L, m->name, m->func, 0);  // sets package.loaded[name]
+            lua_pop(L, 1);
+        }
+    }
+    return count;
+}
+
+// Comma separated module names, for the startup banner
+void preload_describe(char* out, size_t size) {
+    size_t len = 0;
+    out[0] = '\0';
+    for (const luaL_Reg* m = g_static_modules; m->name && len < size; m++) {
+        len += (size_t)snprintf(out + len, size - len, "%s%s", len ? ", " : "", m->name);
+    }
+}
@@ -0,0 +1,312 @@
+/*
+ * profile.c - Sampling profiler for lua_loader
+ *
+ * A timer (setitimer/SIGPROF on POSIX, a timer-queue thread on Windows)
+ * fires at the requested rate and only arms a one-shot count hook with
+ * lua_sethook, which is safe to call asynchronously. The hook then runs
+ * inside the interpreter, walks the Lua stack and aggregates the folded
+ * stack in C. At exit the folded stacks are written for flamegraph tools
+ * and a top-N self/total table is printed.
+ *
+ * Note: hooks are per coroutine in Lua 5.4 and the timer arms the main
+ * thread only, so samples taken while a coroutine runs are attributed to
+ * the coroutine.resume call site.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#define PROFILE_MAX_DEPTH 64
+#define PROFILE_FRAME_SIZE 160
+
+typedef struct {
+    char* key;        // folded stack "outer;inner;leaf"
+    long count;
+} ProfileEntry;
+
+typedef struct {
+    ProfileEntry* entries;
+    size_t cap;
+    size_t used;
+} ProfileTable;
+
+static lua_State* g_profile_state = NULL;
+static ProfileTable g_stacks;
+static long g_samples = 0;
+static long g_dropped = 0;
+static int g_running = 0;
+
+#ifdef _WIN32
+static HANDLE g_timer_queue = NULL;
+static HANDLE g_timer = NULL;
+#endif
+
+static size_t profile_hash(const char* s) {
+    size_t h = 5381;
+    while (*s) h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+// Find or insert key; returns entry or NULL when out of memory
+static ProfileEntry* profile_table_get(ProfileTable* t, const char* key) {
+    if ((t->used + 1) * 2 > t->cap) {
+        size_t new_cap = t->cap ? t->cap * 2 : 1024;
+        ProfileEntry* grown = calloc(new_cap, sizeof(ProfileEntry));
+        if (!grown) return NULL;
+        for (size_t i = 0; i < t->cap; i++) {
+            if (!t->entries[i].key) continue;
+            size_t slot = profile_hash(t->entries[i].key) & (new_cap - 1);
+            while (grown[slot].key) slot = (slot + 1) & (new_cap - 1);
+            grown[slot] = t->entries[i];
+        }
+        free(t->entries);
+        t->entries = grown;
+        t->cap = new_cap;
+    }
+
+    size_t slot = profile_hash(key) & (t->cap - 1);
+    while (t->entries[slot].key) {
+        if (strcmp(t->entries[slot].key, key) == 0) return &t->entries[slot];
+        slot = (slot + 1) & (t->cap - 1);
+    }
+
+    char* copy = malloc(strlen(key) + 1);
+    if (!copy) return NULL;
+    strcpy(copy, key);
+    t->entries[slot].key = copy;
+    t->entries[slot].count = 0;
+    t->used++;
+    return &t->entries[slot];
+}
+
+static void profile_table_free(ProfileTable* t) {
+    for (size_t i = 0; i < t->cap; i++) free(t->entries[i].key);
+    free(t->entries);
+    memset(t, 0, sizeof(*t));
+}
+
+// Describe one frame as "name (source:line)"; ';' is reserved by the folded format
+static void profile_describe_frame(lua_State* L, lua_Debug* ar, char* out, size_t size) {
+    lua_getinfo(L, "Sn", ar);
+    if (*ar->what == 'm') {
+        snprintf(out, size, "main chunk (%s)", ar->short_src);
+    } else if (*ar->what == 'C') {
+        snprintf(out, size, "%s [C]", ar->name ? ar->name : "?");
+    } else {
+        snprintf(out, size, "%s (%s:%d)", ar->name ? ar->name : "?", ar->short_src, ar->linedefined);
+    }
+    for (char* p = out; *p; p++) {
+        if (*p == ';') *p = ':';
+    }
+}
+
+// One-shot hook: record the current stack and disarm
+static void profile_hook(lua_State* L, lua_Debug* ar) {
+    (void)ar;
+    lua_sethook(L, NULL, 0, 0);
+
+    char frames[PROFILE_MAX_DEPTH][PROFILE_FRAME_SIZE];
+    int depth = 0;
+    lua_Debug info;
+    while (depth < PROFILE_MAX_DEPTH && lua_getstack(L, depth, &info)) {
+        profile_describe_frame(L, &info, frames[depth], sizeof(frames[depth]));
+        depth++;
+    }
+    if (depth == 0) return;
+
+    // Folded format is root first
+    char key[PROFILE_MAX_DEPTH * PROFILE_FRAME_SIZE];
+    size_t len = 0;
+    for (int i = depth - 1; i >= 0; i--) {
+        size_t n = strlen(frames[i]);
+        memcpy(key + len, frames[i], n);
+        len += n;
+        if (i > 0) key[len++] = ';';
+    }
+    key[len] = '\0';
+
+    ProfileEntry* entry = profile_table_get(&g_stacks, key);
+    if (entry) {
+        entry->count++;
+        g_samples++;
+    } else {
+        g_dropped++;
+    }
+}
+
+static void profile_arm(void) {
+    if (g_profile_state) lua_sethook(g_profile_state, profile_hook, LUA_MASKCOUNT, 1);
+}
+
+#ifdef _WIN32
+static VOID CALLBACK profile_timer_callback(PVOID param, BOOLEAN fired) {
+    (void)param;
+    (void)fired;
+    profile_arm();
+}
+#else
+static void profile_signal_handler(int sig) {
+    (void)sig;
+    profile_arm();
+}
+#endif
+
+// Start sampling L at hz samples per second
+int profiler_start(lua_State* L, int hz) {
+    if (hz <= 0) hz = 1000;
+    g_profile_state = L;
+    g_samples = 0;
+    g_dropped = 0;
+
+#ifdef _WIN32
+    DWORD period_ms = (DWORD)(1000 / hz);
+    if (period_ms == 0) period_ms = 1;
+    g_timer_queue = CreateTimerQueue();
+    if (!g_timer_queue) return 0;
+    if (!CreateTimerQueueTimer(&g_timer, g_timer_queue, profile_timer_callback, NULL, period_ms, period_ms,
+                               WT_EXECUTEINTIMERTHREAD)) {
+        DeleteTimerQueueEx(g_timer_queue, NULL);
+        g_timer_queue = NULL;
+        return 0;
+    }
+#else
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = profile_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) != 0) return 0;
+
+    struct itimerval timer;
+    long usec = 1000000L / hz;
+    if (usec <= 0) usec = 1;
+    timer.it_interval.tv_sec = usec / 1000000L;
+    timer.it_interval.tv_usec = usec % 1000000L;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) return 0;
+#endif
+
+    g_running = 1;
+    return 1;
+}
+
+typedef struct {
+    const char* name;
+    long self;
+    long total;
+} ProfileFrame;
+
+static int compare_frames(const void* a, const void* b) {
+    const ProfileFrame* fa = a;
+    const ProfileFrame* fb = b;
+    if (fa->self != fb->self) return fa->self < fb->self ? 1 : -1;
+    return fa->total < fb->total ? 1 : fa->total > fb->total ? -1 : 0;
+}
+
+// Print the top-N frames by self samples, with inclusive totals
+static void profile_print_top(int top_n) {
+    ProfileTable frames = {NULL, 0, 0};
+    ProfileTable totals = {NULL, 0, 0};
+
+    for (size_t i = 0; i < g_stacks.cap; i++) {
+        ProfileEntry* e = &g_stacks.entries[i];
+        if (!e->key) continue;
+
+        // Split the folded key into frames; count each distinct frame once for totals
+        char* copy = malloc(strlen(e->key) + 1);
+        if (!copy) continue;
+        strcpy(copy, e->key);
+
+        char* seen[PROFILE_MAX_DEPTH];
+        int seen_count = 0;
+        char* leaf = copy;
+        for (char* frame = strtok(copy, ";"); frame; frame = strtok(NULL, ";")) {
+            leaf = frame;
+            int dup = 0;
+            for (int j = 0; j < seen_count; j++) {
+                if (strcmp(seen[j], frame) == 0) dup = 1;
+            }
+            if (dup) continue;
+            if (seen_count < PROFILE_MAX_DEPTH) seen[seen_count++] = frame;
+            ProfileEntry* t = profile_table_get(&totals, frame);
+            if (t) t->count += e->count;
+        }
+        ProfileEntry* s = profile_table_get(&frames, leaf);
+        if (s) s->count += e->count;
+        free(copy);
+    }
+
+    ProfileFrame* list = calloc(totals.used ? totals.used : 1, sizeof(ProfileFrame));
+    size_t n = 0;
+    for (size_t i = 0; list && i < totals.cap; i++) {
+        ProfileEntry* t = &totals.entries[i];
+        if (!t->key) continue;
+        ProfileEntry* s = profile_table_get(&frames, t->key);
+        list[n].name = t->key;
+        list[n].total = t->count;
+        list[n].self = s ? s->count : 0;
+        n++;
+    }
+    if (list) qsort(list, n, sizeof(ProfileFrame), compare_frames);
+
+    fprintf(stderr, "\nProfile: %ld samples", g_samples);
+    if (g_dropped > 0) fprintf(stderr, " (%ld dropped)", g_dropped);
+    fprintf(stderr, "\n%8s %7s %8s %7s  %s\n", "self", "self%", "total", "total%", "function");
+    for (size_t i = 0; i < n && (int)i < top_n; i++) {
+        double denom = g_samples > 0 ? (double)g_samples : 1.0;
+        fprintf(stderr, "%8ld %6.2f%% %8ld %6.2f%%  %s\n", list[i].self, 100.0 * list[i].self / denom,
+                list[i].total, 100.0 * list[i].total / denom, list[i].name);
+    }
+
+    free(list);
+    profile_table_free(&frames);
+    profile_table_free(&totals);
+}
+
+// Stop sampling, write folded stacks and print the summary table
+void profiler_stop(const char* folded_path, int top_n) {
+    if (!g_running) return;
+    g_running = 0;
+
+#ifdef _WIN32
+    if (g_timer_queue) {
+        DeleteTimerQueueEx(g_timer_queue, INVALID_HANDLE_VALUE);  // waits for callbacks
+        g_timer_queue = NULL;
+        g_timer = NULL;
+    }
+#else
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    signal(SIGPROF, SIG_IGN);
+#endif
+    if (g_profile_state) lua_sethook(g_profile_state, NULL, 0, 0);
+    g_profile_state = NULL;
+
+    if (folded_path) {
+        FILE* out = fopen(folded_path, "w");
+        if (out) {
+            for (size_t i = 0; i < g_stacks.cap; i++) {
+                if (g_stacks.entries[i].key) fprintf(out, "%s %ld\n", g_stacks.entries[i].key, g_stacks.entries[i].count);
+            }
+            fclose(out);
+            fprintf(stderr, "Profile written to %s\n", folded_path);
+        } else {
+            fprintf(stderr, "Error: cannot write profile to '%s'\n", folded_path);
+        }
+    }
+
+    if (top_n > 0) profile_print_top(top_n);
+    profile_table_free(&g_stacks);
+}
@@ -0,0 +1,456 @@
+/*
+ * rcache.c - Module resolution cache for require in lua_loader
+ *
+ * The standard searchers try every package.path / package.cpath template
+ * with fopen, so each require costs one failed open per template miss.
+ * Here every directory a template points into is listed once and kept as a
+ * hash set of entry names; a candidate path becomes a hash lookup. Missing
+ * directories are remembered too, which makes templates like "./?/init.lua"
+ * free after the first miss.
+ *
+ * A lookup that finds nothing re-checks the mtimes of the directories it
+ * consulted and rescans the ones that changed, so modules created while
+ * the script runs are still found. As in git's racy-index check, a
+ * directory modified in the same second it was listed is always rescanned
+ * on a miss, since a second change would not move its mtime. A hit is
+ * validated by the open itself.
+ *
+ * package.searchpath, the Lua searcher (which loads through bcache.c) and
+ * the C searcher are replaced; the error messages match the standard ones.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define RCACHE_DIRSEP "\\"
+#else
+#include <dirent.h>
+#define RCACHE_DIRSEP "/"
+#endif
+
+// Candidates longer than this are expanded on the heap and probed with fopen
+#define RCACHE_MAX_PATH 1024
+
+// bcache.c
+extern int bcache_loadfile(lua_State* L, const char* filename);
+
+typedef struct {
+    char* path;         // directory as produced by the template, trailing separator stripped
+    int exists;
+    long long mtime;
+    long long scanned;  // wall-clock second of the last listing
+    char** names;       // open addressing set of entry names
+    size_t cap;
+    size_t used;
+} DirIndex;
+
+typedef struct {
+    DirIndex** dirs;
+    size_t cap;
+    size_t used;
+} DirTable;
+
+static DirTable g_dirs;
+static int g_enabled = 0;
+static long g_hits = 0;
+static long g_misses = 0;
+static long g_probes = 0;   // candidate paths checked against an index
+static long g_scans = 0;    // directory listings (first scan and rescans)
+static long g_rescans = 0;
+
+static uint32_t name_hash(const char* s) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+#ifdef _WIN32
+        if (c >= 'A' && c <= 'Z') c = (unsigned char)(c - 'A' + 'a');  // case-insensitive file system
+#endif
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int name_equal(const char* a, const char* b) {
+#ifdef _WIN32
+    return _stricmp(a, b) == 0;
+#else
+    return strcmp(a, b) == 0;
+#endif
+}
+
+static char* copy_string(const char* s) {
+    size_t len = strlen(s);
+    char* copy = malloc(len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static int set_add(DirIndex* d, const char* name) {
+    if ((d->used + 1) * 2 > d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 64;
+        char** grown = calloc(cap, sizeof(char*));
+        if (!grown) return 0;
+        for (size_t i = 0; i < d->cap; i++) {
+            if (!d->names[i]) continue;
+            size_t slot = name_hash(d->names[i]) & (cap - 1);
+            while (grown[slot]) slot = (slot + 1) & (cap - 1);
+            grown[slot] = d->names[i];
+        }
+        free(d->names);
+        d->names = grown;
+        d->cap = cap;
+    }
+    char* copy = copy_string(name);
+    if (!copy) return 0;
+    size_t slot = name_hash(name) & (d->cap - 1);
+    while (d->names[slot]) slot = (slot + 1) & (d->cap - 1);
+    d->names[slot] = copy;
+    d->used++;
+    return 1;
+}
+
+static int set_contains(const DirIndex* d, const char* name) {
+    if (!d->cap) return 0;
+    size_t slot = name_hash(name) & (d->cap - 1);
+    while (d->names[slot]) {
+        if (name_equal(d->names[slot], name)) return 1;
+        slot = (slot + 1) & (d->cap - 1);
+    }
+    return 0;
+}
+
+static void set_clear(DirIndex* d) {
+    for (size_t i = 0; i < d->cap; i++) free(d->names[i]);
+    free(d->names);
+    d->names = NULL;
+    d->cap = 0;
+    d->used = 0;
+}
+
+// Current mtime of a directory; returns 0 if it does not exist
+static int dir_stat(const char* path, long long* mtime) {
+    struct stat st;
+    if (stat(*path ? path : ".", &st) != 0 || !(st.st_mode & S_IFDIR)) return 0;
+    *mtime = (long long)st.st_mtime;
+    return 1;
+}
+
+// (Re)list a directory into its name set
+static void dir_scan(DirIndex* d) {
+    set_clear(d);
+    g_scans++;
+    d->scanned = (long long)time(NULL);
+    d->exists = dir_stat(d->path, &d->mtime);
+    if (!d->exists) return;
+
+    const char* path = *d->path ? d->path : ".";
+#ifdef _WIN32
+    char pattern[RCACHE_MAX_PATH + 2];
+    snprintf(pattern, sizeof(pattern), "%s\\*", path);
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        if (strcmp(data.cFileName, ".") != 0 && strcmp(data.cFileName, "..") != 0) set_add(d, data.cFileName);
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) set_add(d, entry->d_name);
+    }
+    closedir(dir);
+#endif
+}
+
+// Find or create (and scan) the index for a directory
+static DirIndex* dir_get(const char* path) {
+    if ((g_dirs.used + 1) * 2 > g_dirs.cap) {
+        size_t cap = g_dirs.cap ? g_dirs.cap * 2 : 64;
+        DirIndex** grown = calloc(cap, sizeof(DirIndex*));
+        if (!grown) return NULL;
+        for (size_t i = 0; i < g_dirs.cap; i++) {
+            if (!g_dirs.dirs[i]) continue;
+            size_t slot = name_hash(g_dirs.dirs[i]->path) & (cap - 1);
+            while (grown[slot]) slot = (slot + 1) & (cap - 1);
+            grown[slot] = g_dirs.dirs[i];
+        }
+        free(g_dirs.dirs);
+        g_dirs.dirs = grown;
+        g_dirs.cap = cap;
+    }
+
+    size_t slot = name_hash(path) & (g_dirs.cap - 1);
+    while (g_dirs.dirs[slot]) {
+        if (strcmp(g_dirs.dirs[slot]->path, path) == 0) return g_dirs.dirs[slot];
+        slot = (slot + 1) & (g_dirs.cap - 1);
+    }
+
+    DirIndex* d = calloc(1, sizeof(DirIndex));
+    if (!d) return NULL;
+    d->path = copy_string(path);
+    if (!d->path) {
+        free(d);
+        return NULL;
+    }
+    dir_scan(d);
+    g_dirs.dirs[slot] = d;
+    g_dirs.used++;
+    return d;
+}
+
+static int is_separator(char c) {
+    return c == '/' || c == '\\';
+}
+
+// Check one candidate file path against its directory index
+static int candidate_exists(const char* filename, DirIndex** out_dir) {
+    char dir[RCACHE_MAX_PATH];
+    const char* base = filename;
+    for (const char* p = filename; *p; p++) {
+        if (is_separator(*p)) base = p + 1;
+    }
+    size_t dir_len = (size_t)(base - filename);
+    if (dir_len >= sizeof(dir)) {
+        // Directory too long to index: probe like the stock searcher
+        FILE* f = fopen(filename, "r");
+        if (!f) return 0;
+        fclose(f);
+        return 1;
+    }
+    memcpy(dir, filename, dir_len);
+    // "a/b/" and "a/b" name the same directory; keep "/" for the root
+    while (dir_len > 1 && is_separator(dir[dir_len - 1])) dir_len--;
+    dir[dir_len] = '\0';
+
+    DirIndex* d = dir_get(dir);
+    *out_dir = d;
+    g_probes++;
+    return d && d->exists && set_contains(d, base);
+}
+
+// Expand one template into buf, or into a heap copy when it does not fit; NULL if that fails
+static char* expand_template(const char* tmpl, size_t tmpl_len, const char* name, char* buf, size_t size) {
+    size_t name_len = strlen(name);
+    size_t need = 1;
+    for (size_t i = 0; i < tmpl_len; i++) need += tmpl[i] == '?' ? name_len : 1;
+    char* out = need <= size ? buf : malloc(need);
+    if (!out) return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < tmpl_len; i++) {
+        if (tmpl[i] == '?') {
+            memcpy(out + n, name, name_len);
+            n += name_len;
+        } else {
+            out[n++] = tmpl[i];
+        }
+    }
+    out[n] = '\0';
+    return out;
+}
+
+// Resolve name against a ';'-separated template list; pushes the filename and returns 1 on success
+static int resolve(lua_State* L, const char* name, const char* path) {
+    DirIndex* consulted[64];
+    int consulted_count = 0;
+    char buf[RCACHE_MAX_PATH];
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const char* tmpl = path;
+        while (*tmpl) {
+            const char* end = strchr(tmpl, ';');
+            size_t len = end ? (size_t)(end - tmpl) : strlen(tmpl);
+            if (len > 0) {
+                char* candidate = expand_template(tmpl, len, name, buf, sizeof(buf));
+                if (!candidate) luaL_error(L, "not enough memory");
+                DirIndex* d = NULL;
+                int found = candidate_exists(candidate, &d);
+                if (found) lua_pushstring(L, candidate);
+                if (candidate != buf) free(candidate);
+                if (found) {
+                    g_hits++;
+                    return 1;
+                }
+                if (attempt == 0 && d && consulted_count < 64) consulted[consulted_count++] = d;
+            }
+            tmpl += len;
+            if (*tmpl == ';') tmpl++;
+        }
+
+        // Nothing found: rescan directories that changed since they were listed
+        int changed = 0;
+        for (int i = 0; attempt == 0 && i < consulted_count; i++) {
+            long long mtime = 0;
+            int exists = dir_stat(consulted[i]->path, &mtime);
+            int racy = exists && mtime >= consulted[i]->scanned;
+            if (exists != consulted[i]->exists || mtime != consulted[i]->mtime || racy) {
+                dir_scan(consulted[i]);
+                g_rescans++;
+                changed = 1;
+            }
+        }
+        if (!changed) break;
+    }
+    g_misses++;
+    return 0;
+}
+
+// Push the standard "no file 'x'" list for a failed lookup
+static void push_not_found(lua_State* L, const char* name, const char* path) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    int first = 1;
+    const char* tmpl = path;
+    while (*tmpl) {
+        const char* end = strchr(tmpl, ';');
+        size_t len = end ? (size_t)(end - tmpl) : strlen(tmpl);
+        if (len > 0) {
+            luaL_addstring(&b, first ? "no file '" : "\n\tno file '");
+            for (size_t i = 0; i < len; i++) {
+                if (tmpl[i] == '?') {
+                    luaL_addstring(&b, name);
+                } else {
+                    luaL_addchar(&b, tmpl[i]);
+                }
+            }
+            first = 0;
+            luaL_addstring(&b, "'");
+        }
+        tmpl += len;
+        if (*tmpl == ';') tmpl++;
+    }
+    luaL_pushresult(&b);
+}
+
+// Module name with sep replaced by rep (same as package.searchpath)
+static const char* push_name_path(lua_State* L, const char* name, const char* sep, const char* rep) {
+    if (*sep != '\0' && strstr(name, sep) != NULL) return luaL_gsub(L, name, sep, rep);
+    return lua_pushstring(L, name);
+}
+
+// package.searchpath(name, path [, sep [, rep]])
+static int l_searchpath(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    const char* path = luaL_checkstring(L, 2);
+    const char* sep = luaL_optstring(L, 3, ".");
+    const char* rep = luaL_optstring(L, 4, RCACHE_DIRSEP);
+    const char* name_path = push_name_path(L, name, sep, rep);
+
+    if (resolve(L, name_path, path)) return 1;
+    lua_pushnil(L);
+    push_not_found(L, name_path, path);
+    return 2;
+}
+
+// Look up package[field] for name; pushes filename or an error message
+static int search_field(lua_State* L, const char* name, const char* field) {
+    lua_getfield(L, lua_upvalueindex(1), field);
+    const char* path = lua_tostring(L, -1);
+    if (!path) luaL_error(L, "'package.%s' must be a string", field);
+    const char* name_path = push_name_path(L, name, ".", RCACHE_DIRSEP);
+
+    int found = resolve(L, name_path, path);
+    if (!found) push_not_found(L, name_path, path);
+    lua_replace(L, -3);  // drop path
+    lua_pop(L, 1);       // drop name_path
+    return found;
+}
+
+// Replacement for package.searchers[2]
+static int l_searcher_lua(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    if (!search_field(L, name, "path")) return 1;  // error message
+
+    const char* filename = lua_tostring(L, -1);
+    if (bcache_loadfile(L, filename) != LUA_OK) {
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, filename, lua_tostring(L, -1));
+    }
+    lua_pushstring(L, filename);  // 2nd argument to the loader
+    return 2;
+}
+
+// Call package.loadlib(filename, "luaopen_<name>"); pushes the function or error
+static int load_c_function(lua_State* L, const char* filename, const char* modname) {
+    lua_getfield(L, lua_upvalueindex(1), "loadlib");
+    lua_pushstring(L, filename);
+    const char* funcname = luaL_gsub(L, modname, ".", "_");
+    lua_pushfstring(L, "luaopen_%s", funcname);
+    lua_remove(L, -2);
+    lua_call(L, 2, 2);
+    if (!lua_isnil(L, -2)) {
+        lua_pop(L, 1);
+        return 1;
+    }
+    lua_remove(L, -2);  // nil
+    return 0;
+}
+
+// Replacement for package.searchers[3]
+static int l_searcher_c(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    if (!search_field(L, name, "cpath")) return 1;
+
+    const char* filename = lua_tostring(L, -1);
+    // "a.b-c" opens luaopen_a_b first, then luaopen_c (LUA_IGMARK)
+    const char* mark = strchr(name, '-');
+    int ok;
+    if (mark) {
+        lua_pushlstring(L, name, (size_t)(mark - name));
+        ok = load_c_function(L, filename, lua_tostring(L, -1));
+        lua_remove(L, -2);
+        if (!ok) {
+            lua_pop(L, 1);
+            ok = load_c_function(L, filename, mark + 1);
+        }
+    } else {
+        ok = load_c_function(L, filename, name);
+    }
+    if (!ok) {
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, filename, lua_tostring(L, -1));
+    }
+    lua_pushstring(L, filename);
+    return 2;
+}
+
+// Install the cached searchers and package.searchpath; requires the package library
+int rcache_init(lua_State* L) {
+    lua_getglobal(L, "package");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        return 0;
+    }
+    lua_pushcfunction(L, l_searchpath);
+    lua_setfield(L, -2, "searchpath");
+
+    lua_getfield(L, -1, "searchers");
+    if (lua_istable(L, -1)) {
+        lua_pushvalue(L, -2);  // package as upvalue
+        lua_pushcclosure(L, l_searcher_lua, 1);
+        lua_rawseti(L, -2, 2);
+        lua_pushvalue(L, -2);
+        lua_pushcclosure(L, l_searcher_c, 1);
+        lua_rawseti(L, -2, 3);
+    }
+    lua_pop(L, 2);
+    g_enabled = 1;
+    return 1;
+}
+
+void rcache_report(void) {
+    if (!g_enabled || g_hits + g_misses == 0) return;
+    printf("Require cache: %ld hits, %ld misses, %ld probes, %ld directory scans (%ld rescans)\n", g_hits, g_misses,
+           g_probes, g_scans, g_rescans);
+}
@@ -0,0 +1,1017 @@
+/*
+ * thread.c - Worker states and channels for lua_loader ("thread" module)
+ *
+ * Lua usage:
+ * local thread = require("thread")
+ * local jobs, results = thread.channel(64), thread.channel(64)
+ * local w = thread.spawn(function(jobs, results)
+ *     for n in function() return jobs:pop() end do results:push(n * n) end
+ * end, jobs, results)
+ * jobs:push(7); jobs:close()
+ * print(results:pop())        --> 49
+ * print(w:join())             --> true
+ *
+ * Each worker is a separate lua_State on its own OS thread. Nothing is
+ * shared between states except channels: values are serialized into a
+ * single heap block (nil, booleans, numbers, strings, flat tables, channels
+ * and blobs) and the block pointer travels through a bounded lock-free MPMC
+ * queue (Vyukov's sequence-number ring).
+ *
+ * Blobs are the zero-copy path for large payloads: thread.blob(str) copies
+ * once into a heap block, and sending a blob moves that block to the
+ * receiver instead of copying it; the sender's blob becomes empty.
+ *
+ * Blocking push/pop spin briefly, then yield, then sleep with growing
+ * backoff, so the queue itself never takes a lock.
+ *
+ * A spawned function may only have the _ENV upvalue, which is rebound to the
+ * worker's globals; other values must be passed as arguments. A worker whose
+ * handle is collected unjoined is cancelled: its blocking push/pop raise.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+#include "lualib.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define CHANNEL_META "thread.Channel"
+#define WORKER_META "thread.Worker"
+#define BLOB_META "thread.Blob"
+#define CHANNEL_DEFAULT_CAPACITY 64
+#define CHANNEL_MAX_CAPACITY (1 << 20)
+
+// Shared objects
+
+typedef struct {
+    _Atomic size_t seq;
+    void* data;
+} ChannelCell;
+
+typedef struct {
+    _Atomic int refs;
+    _Atomic int closed;
+    size_t mask;
+    ChannelCell* cells;
+    // Producer and consumer positions on separate cache lines
+    char pad0[64];
+    _Atomic size_t enqueue_pos;
+    char pad1[64];
+    _Atomic size_t dequeue_pos;
+    char pad2[64];
+} Channel;
+
+typedef struct {
+    size_t size;
+    char data[];
+} BlobData;
+
+typedef struct {
+    BlobData* blob;  // NULL once moved into a message
+} LuaBlob;
+
+typedef struct {
+    Channel* channel;
+} LuaChannel;
+
+// Serialized values: [count:u32] then per value a tag byte and payload
+enum {
+    TAG_NIL = 'n',
+    TAG_FALSE = 'f',
+    TAG_TRUE = 't',
+    TAG_INT = 'i',
+    TAG_FLOAT = 'd',
+    TAG_STRING = 's',
+    TAG_TABLE = 'T',
+    TAG_CHANNEL = 'C',
+    TAG_BLOB = 'B'
+};
+
+typedef struct {
+    size_t size;
+    unsigned char data[];
+} Message;
+
+static void message_free(Message* msg);
+
+static Channel* channel_new(size_t capacity) {
+    size_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+
+    Channel* c = calloc(1, sizeof(Channel));
+    if (!c) return NULL;
+    c->cells = malloc(sizeof(ChannelCell) * cap);
+    if (!c->cells) {
+        free(c);
+        return NULL;
+    }
+    for (size_t i = 0; i < cap; i++) atomic_init(&c->cells[i].seq, i);
+    c->mask = cap - 1;
+    atomic_init(&c->refs, 1);
+    atomic_init(&c->closed, 0);
+    atomic_init(&c->enqueue_pos, 0);
+    atomic_init(&c->dequeue_pos, 0);
+    return c;
+}
+
+static void channel_retain(Channel* c) {
+    atomic_fetch_add_explicit(&c->refs, 1, memory_order_relaxed);
+}
+
+static int channel_try_push(Channel* c, void* data) {
+    size_t pos = atomic_load_explicit(&c->enqueue_pos, memory_order_relaxed);
+    ChannelCell* cell;
+    for (;;) {
+        cell = &c->cells[pos & c->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&c->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return 0;  // full
+        } else {
+            pos = atomic_load_explicit(&c->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->data = data;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+static void* channel_try_pop(Channel* c) {
+    size_t pos = atomic_load_explicit(&c->dequeue_pos, memory_order_relaxed);
+    ChannelCell* cell;
+    for (;;) {
+        cell = &c->cells[pos & c->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&c->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return NULL;  // empty
+        } else {
+            pos = atomic_load_explicit(&c->dequeue_pos, memory_order_relaxed);
+        }
+    }
+    void* data = cell->data;
+    atomic_store_explicit(&cell->seq, pos + c->mask + 1, memory_order_release);
+    return data;
+}
+
+static void channel_release(Channel* c) {
+    if (atomic_fetch_sub_explicit(&c->refs, 1, memory_order_acq_rel) != 1) return;
+    // Last reference: drop undelivered messages (they may hold other channels)
+    void* msg;
+    while ((msg = channel_try_pop(c)) != NULL) message_free(msg);
+    free(c->cells);
+    free(c);
+}
+
+// Waiting without locks
+
+static long long monotonic_ns(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount64() * 1000000LL;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// Backoff step: spin, then yield, then sleep up to 1ms
+static void backoff(int* round) {
+    int r = (*round)++;
+    if (r < 64) {
+        return;
+    } else if (r < 128) {
+#ifdef _WIN32
+        SwitchToThread();
+#else
+        sched_yield();
+#endif
+    } else {
+        long us = 50L << ((r - 128) / 16 < 5 ? (r - 128) / 16 : 5);  // 50us .. 1.6ms
+        if (us > 1000) us = 1000;
+#ifdef _WIN32
+        Sleep((DWORD)((us + 999) / 1000));
+#else
+        struct timespec ts = {0, us * 1000L};
+        nanosleep(&ts, NULL);
+#endif
+    }
+}
+
+// timeout < 0 waits forever; returns deadline in ns or -1
+static long long deadline_from(double timeout) {
+    if (timeout < 0) return -1;
+    return monotonic_ns() + (long long)(timeout * 1e9);
+}
+
+// A worker state keeps a pointer to its Worker's cancel flag in the registry;
+// collecting an unjoined worker sets it so blocking push/pop give up
+static const char cancel_key = 0;
+
+static _Atomic int* cancel_flag(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &cancel_key);
+    _Atomic int* flag = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return flag;
+}
+
+// Serialization
+
+static int is_blob(lua_State* L, int idx) {
+    return luaL_testudata(L, idx, BLOB_META) != NULL;
+}
+
+// Size of one scalar; raises a Lua error for unsupported values
+static size_t measure_scalar(lua_State* L, int idx, const char* where) {
+    switch (lua_type(L, idx)) {
+        case LUA_TNIL:
+        case LUA_TBOOLEAN:
+            return 1;
+        case LUA_TNUMBER:
+            return 1 + (lua_isinteger(L, idx) ? sizeof(lua_Integer) : sizeof(lua_Number));
+        case LUA_TSTRING: {
+            size_t len;
+            lua_tolstring(L, idx, &len);
+            return 1 + sizeof(size_t) + len;
+        }
+        case LUA_TUSERDATA:
+            if (luaL_testudata(L, idx, CHANNEL_META)) return 1 + sizeof(Channel*);
+            if (is_blob(L, idx)) {
+                LuaBlob* b = lua_touserdata(L, idx);
+                if (!b->blob) luaL_error(L, "cannot send a blob that was already sent");
+                return 1 + sizeof(BlobData*);
+            }
+            break;
+        default:
+            break;
+    }
+    return (size_t)luaL_error(L, "cannot send %s %s", luaL_typename(L, idx), where);
+}
+
+// blobs_idx is a table used as a set so one blob cannot be moved twice in a message
+static size_t measure_value(lua_State* L, int idx, int blobs_idx) {
+    idx = lua_absindex(L, idx);
+    if (is_blob(L, idx)) {
+        if (lua_rawgetp(L, blobs_idx, lua_touserdata(L, idx)) != LUA_TNIL) {
+            luaL_error(L, "the same blob appears twice in one message");
+        }
+        lua_pop(L, 1);
+        lua_pushboolean(L, 1);
+        lua_rawsetp(L, blobs_idx, lua_touserdata(L, idx));
+    }
+    if (!lua_istable(L, idx)) return measure_scalar(L, idx, "through a channel");
+
+    size_t size = 1 + sizeof(uint32_t);
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        if (lua_istable(L, -2) || lua_istable(L, -1)) luaL_error(L, "cannot send nested tables (only flat tables)");
+        if (is_blob(L, -2)) luaL_error(L, "cannot use a blob as a table key");
+        size += measure_scalar(L, -2, "as a table key");
+        size += measure_value(L, -1, blobs_idx);
+        lua_pop(L, 1);
+    }
+    return size;
+}
+
+static unsigned char* put(unsigned char* p, const void* src, size_t size) {
+    memcpy(p, src, size);
+    return p + size;
+}
+
+// Write one value; cannot fail (sizes were measured). Takes channel refs; blobs are
+// only moved by blobs_commit once the message is delivered.
+static unsigned char* write_value(lua_State* L, int idx, unsigned char* p) {
+    idx = lua_absindex(L, idx);
+    switch (lua_type(L, idx)) {
+        case LUA_TNIL:
+            *p++ = TAG_NIL;
+            break;
+        case LUA_TBOOLEAN:
+            *p++ = lua_toboolean(L, idx) ? TAG_TRUE : TAG_FALSE;
+            break;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, idx)) {
+                lua_Integer v = lua_tointeger(L, idx);
+                *p++ = TAG_INT;
+                p = put(p, &v, sizeof(v));
+            } else {
+                lua_Number v = lua_tonumber(L, idx);
+                *p++ = TAG_FLOAT;
+                p = put(p, &v, sizeof(v));
+            }
+            break;
+        case LUA_TSTRING: {
+            size_t len;
+            const char* s = lua_tolstring(L, idx, &len);
+            *p++ = TAG_STRING;
+            p = put(p, &len, sizeof(len));
+            p = put(p, s, len);
+            break;
+        }
+        case LUA_TTABLE: {
+            unsigned char* count_at = p + 1;
+            uint32_t count = 0;
+            *p++ = TAG_TABLE;
+            p += sizeof(uint32_t);
+            lua_pushnil(L);
+            while (lua_next(L, idx)) {
+                p = write_value(L, -2, p);
+                p = write_value(L, -1, p);
+                lua_pop(L, 1);
+                count++;
+            }
+            memcpy(count_at, &count, sizeof(count));
+            break;
+        }
+        default: {
+            LuaChannel* ch = luaL_testudata(L, idx, CHANNEL_META);
+            if (ch) {
+                channel_retain(ch->channel);
+                *p++ = TAG_CHANNEL;
+                p = put(p, &ch->channel, sizeof(Channel*));
+            } else {
+                LuaBlob* b = lua_touserdata(L, idx);
+                *p++ = TAG_BLOB;
+                p = put(p, &b->blob, sizeof(BlobData*));
+            }
+            break;
+        }
+    }
+    return p;
+}
+
+// Serialize stack values first..last into a new message; raises on unsupported values.
+// Leaves the set of blobs in the message on the stack: the caller ends with
+// blobs_commit (delivered) or message_discard + lua_pop (not delivered).
+static Message* message_build(lua_State* L, int first, int last) {
+    lua_newtable(L);  // blob set
+    int blobs_idx = lua_gettop(L);
+    size_t size = sizeof(uint32_t);
+    for (int i = first; i <= last; i++) size += measure_value(L, i, blobs_idx);
+
+    Message* msg = malloc(sizeof(Message) + size);
+    if (!msg) {
+        luaL_error(L, "not enough memory for message");
+        return NULL;
+    }
+    msg->size = size;
+    uint32_t count = (uint32_t)(last >= first ? last - first + 1 : 0);
+    unsigned char* p = put(msg->data, &count, sizeof(count));
+    for (int i = first; i <= last; i++) p = write_value(L, i, p);
+    return msg;
+}
+
+// The message now owns its blobs: empty the senders' handles and pop the blob set
+static void blobs_commit(lua_State* L) {
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pop(L, 1);
+        ((LuaBlob*)lua_touserdata(L, -1))->blob = NULL;  // moved
+    }
+    lua_pop(L, 1);
+}
+
+// message_build and blobs_commit in one step, for messages that are always delivered
+static Message* message_pack(lua_State* L, int first, int last) {
+    Message* msg = message_build(L, first, last);
+    blobs_commit(L);
+    return msg;
+}
+
+static Message* message_from_error(const char* text) {
+    size_t len = strlen(text);
+    Message* msg = malloc(sizeof(Message) + sizeof(uint32_t) + 1 + sizeof(size_t) + len);
+    if (!msg) return NULL;
+    uint32_t count = 1;
+    unsigned char* p = put(msg->data, &count, sizeof(count));
+    *p++ = TAG_STRING;
+    p = put(p, &len, sizeof(len));
+    put(p, text, len);
+    msg->size = (size_t)(p + len - msg->data);
+    return msg;
+}
+
+static void push_channel(lua_State* L, Channel* c);
+static void push_blob(lua_State* L, BlobData* blob);
+
+// Read one value; when L is NULL only releases channel refs and, if free_blobs, blobs
+static const unsigned char* read_value(lua_State* L, const unsigned char* p, int free_blobs) {
+    unsigned char tag = *p++;
+    switch (tag) {
+        case TAG_NIL:
+            if (L) lua_pushnil(L);
+            break;
+        case TAG_FALSE:
+        case TAG_TRUE:
+            if (L) lua_pushboolean(L, tag == TAG_TRUE);
+            break;
+        case TAG_INT: {
+            lua_Integer v;
+            memcpy(&v, p, sizeof(v));
+            p += sizeof(v);
+            if (L) lua_pushinteger(L, v);
+            break;
+        }
+        case TAG_FLOAT: {
+            lua_Number v;
+            memcpy(&v, p, sizeof(v));
+            p += sizeof(v);
+            if (L) lua_pushnumber(L, v);
+            break;
+        }
+        case TAG_STRING: {
+            size_t len;
+            memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if (L) lua_pushlstring(L, (const char*)p, len);
+            p += len;
+            break;
+        }
+        case TAG_TABLE: {
+            uint32_t count;
+            memcpy(&count, p, sizeof(count));
+            p += sizeof(count);
+            if (L) lua_createtable(L, 0, (int)count);
+            for (uint32_t i = 0; i < count; i++) {
+                p = read_value(L, p, free_blobs);
+                p = read_value(L, p, free_blobs);
+                if (L) lua_rawset(L, -3);
+            }
+            break;
+        }
+        case TAG_CHANNEL: {
+            Channel* c;
+            memcpy(&c, p, sizeof(c));
+            p += sizeof(c);
+            if (L) {
+                push_channel(L, c);  // takes over the message's reference
+            } else {
+                channel_release(c);
+            }
+            break;
+        }
+        case TAG_BLOB: {
+            BlobData* blob;
+            memcpy(&blob, p, sizeof(blob));
+            p += sizeof(blob);
+            if (L) {
+                push_blob(L, blob);
+            } else if (free_blobs) {
+                free(blob);
+            }
+            break;
+        }
+    }
+    return p;
+}
+
+// Push all values of msg and free it; returns the number of values
+static int message_unpack(lua_State* L, Message* msg) {
+    uint32_t count;
+    memcpy(&count, msg->data, sizeof(count));
+    luaL_checkstack(L, (int)count + 2, "too many values in message");
+    const unsigned char* p = msg->data + sizeof(count);
+    for (uint32_t i = 0; i < count; i++) p = read_value(L, p, 1);
+    free(msg);
+    return (int)count;
+}
+
+static void message_release(Message* msg, int free_blobs) {
+    uint32_t count;
+    memcpy(&count, msg->data, sizeof(count));
+    const unsigned char* p = msg->data + sizeof(count);
+    for (uint32_t i = 0; i < count; i++) p = read_value(NULL, p, free_blobs);
+    free(msg);
+}
+
+static void message_free(Message* msg) {
+    message_release(msg, 1);
+}
+
+// Drop an undelivered message from message_build; its blobs stay with the sender
+static void message_discard(Message* msg) {
+    message_release(msg, 0);
+}
+
+// Channel userdata
+
+static void push_channel(lua_State* L, Channel* c) {
+    LuaChannel* ch = lua_newuserdatauv(L, sizeof(LuaChannel), 0);
+    ch->channel = c;
+    luaL_setmetatable(L, CHANNEL_META);
+}
+
+static Channel* check_channel(lua_State* L, int idx) {
+    return ((LuaChannel*)luaL_checkudata(L, idx, CHANNEL_META))->channel;
+}
+
+// thread.channel([capacity])
+static int l_channel(lua_State* L) {
+    lua_Integer capacity = luaL_optinteger(L, 1, CHANNEL_DEFAULT_CAPACITY);
+    luaL_argcheck(L, capacity > 0 && capacity <= CHANNEL_MAX_CAPACITY, 1, "capacity out of range");
+    Channel* c = channel_new((size_t)capacity);
+    if (!c) return luaL_error(L, "not enough memory for channel");
+    push_channel(L, c);
+    return 1;
+}
+
+// ch:push(value [, timeout]) -> true | false, "timeout"
+static int l_channel_push(lua_State* L) {
+    Channel* c = check_channel(L, 1);
+    luaL_checkany(L, 2);
+    luaL_argcheck(L, !lua_isnil(L, 2), 2, "cannot push nil");
+    double timeout = luaL_optnumber(L, 3, -1);
+    if (atomic_load(&c->closed)) return luaL_error(L, "push on a closed channel");
+
+    Message* msg = message_build(L, 2, 2);
+    long long deadline = deadline_from(timeout);
+    _Atomic int* cancel = cancel_flag(L);
+    int round = 0;
+    while (!channel_try_push(c, msg)) {
+        if (cancel && atomic_load(cancel)) {
+            message_discard(msg);
+            return luaL_error(L, "worker cancelled");
+        }
+        if (atomic_load(&c->closed) || (deadline >= 0 && monotonic_ns() >= deadline)) {
+            message_discard(msg);
+            lua_pop(L, 1);
+            lua_pushboolean(L, 0);
+            lua_pushstring(L, atomic_load(&c->closed) ? "closed" : "timeout");
+            return 2;
+        }
+        backoff(&round);
+    }
+    blobs_commit(L);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// ch:pop([timeout]) -> value | nil, "timeout" | nil, "closed"
+static int l_channel_pop(lua_State* L) {
+    Channel* c = check_channel(L, 1);
+    double timeout = luaL_optnumber(L, 2, -1);
+    long long deadline = deadline_from(timeout);
+    _Atomic int* cancel = cancel_flag(L);
+    int round = 0;
+    for (;;) {
+        Message* msg = channel_try_pop(c);
+        if (msg) return message_unpack(L, msg);
+        // Check closed after a failed pop so messages pushed before close are still delivered
+        if (atomic_load(&c->closed)) {
+            msg = channel_try_pop(c);
+            if (msg) return message_unpack(L, msg);
+            lua_pushnil(L);
+            lua_pushstring(L, "closed");
+            return 2;
+        }
+        if (deadline >= 0 && monotonic_ns() >= deadline) {
+            lua_pushnil(L);
+            lua_pushstring(L, "timeout");
+            return 2;
+        }
+        if (cancel && atomic_load(cancel)) return luaL_error(L, "worker cancelled");
+        backoff(&round);
+    }
+}
+
+static int l_channel_trypush(lua_State* L) {
+    lua_settop(L, 2);
+    lua_pushnumber(L, 0);
+    return l_channel_push(L);
+}
+
+static int l_channel_trypop(lua_State* L) {
+    lua_settop(L, 1);
+    lua_pushnumber(L, 0);
+    return l_channel_pop(L);
+}
+
+static int l_channel_close(lua_State* L) {
+    atomic_store(&check_channel(L, 1)->closed, 1);
+    return 0;
+}
+
+// Approximate number of queued messages
+static int l_channel_count(lua_State* L) {
+    Channel* c = check_channel(L, 1);
+    size_t head = atomic_load_explicit(&c->enqueue_pos, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&c->dequeue_pos, memory_order_relaxed);
+    lua_pushinteger(L, head > tail ? (lua_Integer)(head - tail) : 0);
+    return 1;
+}
+
+static int l_channel_capacity(lua_State* L) {
+    lua_pushinteger(L, (lua_Integer)(check_channel(L, 1)->mask + 1));
+    return 1;
+}
+
+static int l_channel_gc(lua_State* L) {
+    LuaChannel* ch = luaL_checkudata(L, 1, CHANNEL_META);
+    if (ch->channel) channel_release(ch->channel);
+    ch->channel = NULL;
+    return 0;
+}
+
+static int l_channel_tostring(lua_State* L) {
+    Channel* c = check_channel(L, 1);
+    lua_pushfstring(L, "Channel(%p, capacity=%d%s)", (void*)c, (int)(c->mask + 1),
+                    atomic_load(&c->closed) ? ", closed" : "");
+    return 1;
+}
+
+// Blob userdata
+
+static void push_blob(lua_State* L, BlobData* blob) {
+    LuaBlob* b = lua_newuserdatauv(L, sizeof(LuaBlob), 0);
+    b->blob = blob;
+    luaL_setmetatable(L, BLOB_META);
+}
+
+// thread.blob(string)
+static int l_blob(lua_State* L) {
+    size_t len;
+    const char* s = luaL_checklstring(L, 1, &len);
+    BlobData* blob = malloc(sizeof(BlobData) + len);
+    if (!blob) return luaL_error(L, "not enough memory for blob");
+    blob->size = len;
+    memcpy(blob->data, s, len);
+    push_blob(L, blob);
+    return 1;
+}
+
+static int l_blob_len(lua_State* L) {
+    LuaBlob* b = luaL_checkudata(L, 1, BLOB_META);
+    lua_pushinteger(L, b->blob ? (lua_Integer)b->blob->size : 0);
+    return 1;
+}
+
+// blob:tostring() copies the bytes into a Lua string
+static int l_blob_tostring(lua_State* L) {
+    LuaBlob* b = luaL_checkudata(L, 1, BLOB_META);
+    if (!b->blob) return luaL_error(L, "blob was sent to another thread");
+    lua_pushlstring(L, b->blob->data, b->blob->size);
+    return 1;
+}
+
+static int l_blob_gc(lua_State* L) {
+    LuaBlob* b = luaL_checkudata(L, 1, BLOB_META);
+    free(b->blob);
+    b->blob = NULL;
+    return 0;
+}
+
+static int l_blob_name(lua_State* L) {
+    LuaBlob* b = luaL_checkudata(L, 1, BLOB_META);
+    if (b->blob) {
+        lua_pushfstring(L, "Blob(%d bytes)", (int)b->blob->size);
+    } else {
+        lua_pushliteral(L, "Blob(moved)");
+    }
+    return 1;
+}
+
+// Workers
+
+typedef struct {
+    char* code;
+    size_t code_len;
+    Message* args;
+    Message* result;  // [ok:boolean, values...]
+    _Atomic int done;
+    _Atomic int cancel;
+    int joined;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+} Worker;
+
+typedef struct {
+    Worker* worker;
+} LuaWorker;
+
+void thread_register(lua_State* L);
+int luaopen_thread(lua_State* L);
+
+// gc.c (the config is parsed once at startup, before any worker runs)
+extern const char* gc_apply(lua_State* L, char* out, size_t size);
+
+static int worker_pack_results(lua_State* L) {
+    Message** out = lua_touserdata(L, 1);
+    *out = message_pack(L, 2, lua_gettop(L));
+    return 0;
+}
+
+static void worker_run(Worker* w) {
+    lua_State* L = luaL_newstate();
+    if (!L) {
+        w->result = message_from_error("cannot create worker state");
+        return;
+    }
+    char gc_desc[128];
+    gc_apply(L, gc_desc, sizeof(gc_desc));  // same collector mode as the main state
+    lua_pushlightuserdata(L, (void*)&w->cancel);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &cancel_key);
+    luaL_openlibs(L);
+    thread_register(L);
+    // Channels and blobs in the arguments need the metatables, so open the module up front
+    luaL_requiref(L, "thread", luaopen_thread, 0);
+    lua_pop(L, 1);
+
+    int status = luaL_loadbufferx(L, w->code, w->code_len, "=(thread)", NULL);
+    if (status == LUA_OK) {
+        // load binds only the first upvalue; a dumped function may keep _ENV at another index
+        const char* name;
+        for (int i = 1; (name = lua_getupvalue(L, -1, i)) != NULL; i++) {
+            lua_pop(L, 1);
+            if (strcmp(name, "_ENV") == 0) {
+                lua_pushglobaltable(L);
+                lua_setupvalue(L, -2, i);
+            }
+        }
+        int nargs = message_unpack(L, w->args);
+        w->args = NULL;
+        status = lua_pcall(L, nargs, LUA_MULTRET, 0);
+    }
+
+    if (status != LUA_OK) {
+        const char* err = lua_tostring(L, -1);
+        w->result = message_from_error(err ? err : "error in worker");
+    } else {
+        // Pack true + results in protected mode: unsupported return values raise
+        int nres = lua_gettop(L);
+        lua_pushcfunction(L, worker_pack_results);
+        lua_insert(L, 1);
+        lua_pushlightuserdata(L, &w->result);
+        lua_insert(L, 2);
+        lua_pushboolean(L, 1);
+        lua_insert(L, 3);
+        if (lua_pcall(L, nres + 2, 0, 0) != LUA_OK) {
+            const char* err = lua_tostring(L, -1);
+            w->result = message_from_error(err ? err : "cannot return values from worker");
+        }
+    }
+    lua_close(L);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg) {
+    worker_run(arg);
+    atomic_store(&((Worker*)arg)->done, 1);
+    return 0;
+}
+#else
+static void* worker_main(void* arg) {
+    worker_run(arg);
+    atomic_store(&((Worker*)arg)->done, 1);
+    return NULL;
+}
+#endif
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t cap;
+} DumpBuffer;
+
+static int dump_writer(lua_State* L, const void* p, size_t size, void* ud) {
+    DumpBuffer* b = ud;
+    (void)L;
+    if (b->size + size > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->size + size) cap *= 2;
+        char* grown = realloc(b->data, cap);
+        if (!grown) return 1;
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->size, p, size);
+    b->size += size;
+    return 0;
+}
+
+// thread.spawn(code_or_function, ...) -> worker
+static int l_spawn(lua_State* L) {
+    int top = lua_gettop(L);
+    if (lua_isfunction(L, 1)) {
+        // Functions travel as bytecode: _ENV is rebound to the worker's globals,
+        // any other upvalue would arrive as a wrong value, so refuse it
+        luaL_argcheck(L, !lua_iscfunction(L, 1), 1, "cannot spawn a C function");
+        const char* name;
+        for (int i = 1; (name = lua_getupvalue(L, 1, i)) != NULL; i++) {
+            lua_pop(L, 1);
+            if (strcmp(name, "_ENV") != 0)
+                return luaL_argerror(L, 1, lua_pushfstring(L, "upvalue '%s' cannot cross to a worker; pass it as an argument", name));
+        }
+        DumpBuffer b = {NULL, 0, 0};
+        lua_pushvalue(L, 1);
+        int failed = lua_dump(L, dump_writer, &b, 0) != 0;
+        lua_pop(L, 1);
+        if (failed) {
+            free(b.data);
+            return luaL_error(L, "cannot dump function");
+        }
+        lua_pushlstring(L, b.data, b.size);
+        free(b.data);
+        lua_replace(L, 1);
+    } else {
+        luaL_checktype(L, 1, LUA_TSTRING);
+    }
+
+    size_t code_len;
+    const char* code = lua_tolstring(L, 1, &code_len);
+    Message* args = message_build(L, 2, top);
+    int blobs_idx = lua_gettop(L);
+
+    Worker* w = calloc(1, sizeof(Worker));
+    char* code_copy = malloc(code_len ? code_len : 1);
+    if (!w || !code_copy) {
+        free(w);
+        free(code_copy);
+        message_discard(args);
+        return luaL_error(L, "not enough memory for worker");
+    }
+    memcpy(code_copy, code, code_len);
+    w->code = code_copy;
+    w->code_len = code_len;
+    w->args = args;
+    atomic_init(&w->done, 0);
+    atomic_init(&w->cancel, 0);
+
+    // Create the userdata first so an error below cannot leak the worker
+    LuaWorker* lw = lua_newuserdatauv(L, sizeof(LuaWorker), 0);
+    lw->worker = NULL;
+    luaL_setmetatable(L, WORKER_META);
+
+#ifdef _WIN32
+    w->handle = CreateThread(NULL, 0, worker_main, w, 0, NULL);
+    int started = w->handle != NULL;
+#else
+    int started = pthread_create(&w->handle, NULL, worker_main, w) == 0;
+#endif
+    if (!started) {
+        message_discard(w->args);
+        free(w->code);
+        free(w);
+        return luaL_error(L, "cannot start worker thread");
+    }
+    lw->worker = w;
+    lua_pushvalue(L, blobs_idx);
+    blobs_commit(L);
+    return 1;
+}
+
+static void worker_join(Worker* w) {
+    if (w->joined) return;
+#ifdef _WIN32
+    WaitForSingleObject(w->handle, INFINITE);
+    CloseHandle(w->handle);
+#else
+    pthread_join(w->handle, NULL);
+#endif
+    w->joined = 1;
+}
+
+static Worker* check_worker(lua_State* L) {
+    LuaWorker* lw = luaL_checkudata(L, 1, WORKER_META);
+    if (!lw->worker) luaL_error(L, "invalid worker");
+    return lw->worker;
+}
+
+// w:join() -> true, results... | false, error
+static int l_worker_join(lua_State* L) {
+    Worker* w = check_worker(L);
+    worker_join(w);
+    if (!w->result) return luaL_error(L, "worker results were already collected");
+
+    Message* result = w->result;
+    w->result = NULL;
+    uint32_t count;
+    memcpy(&count, result->data, sizeof(count));
+    // Error results are a single string; success results start with true
+    int is_error = count == 1 && result->data[sizeof(count)] == TAG_STRING;
+    if (is_error) lua_pushboolean(L, 0);
+    return message_unpack(L, result) + (is_error ? 1 : 0);
+}
+
+static int l_worker_isrunning(lua_State* L) {
+    lua_pushboolean(L, !atomic_load(&check_worker(L)->done));
+    return 1;
+}
+
+// Unjoined workers are cancelled and joined on collection so no thread outlives
+// its handle; cancelling wakes a worker blocked on a channel nobody will close
+static int l_worker_gc(lua_State* L) {
+    LuaWorker* lw = luaL_checkudata(L, 1, WORKER_META);
+    Worker* w = lw->worker;
+    if (!w) return 0;
+    if (!w->joined) atomic_store(&w->cancel, 1);
+    worker_join(w);
+    if (w->args) message_free(w->args);
+    if (w->result) message_free(w->result);
+    free(w->code);
+    free(w);
+    lw->worker = NULL;
+    return 0;
+}
+
+static int l_worker_tostring(lua_State* L) {
+    Worker* w = check_worker(L);
+    lua_pushfstring(L, "Worker(%p, %s)", (void*)w, atomic_load(&w->done) ? "done" : "running");
+    return 1;
+}
+
+// thread.cores() -> number of online CPUs
+static int l_cores(lua_State* L) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    lua_pushinteger(L, (lua_Integer)info.dwNumberOfProcessors);
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    lua_pushinteger(L, n > 0 ? n : 1);
+#endif
+    return 1;
+}
+
+// Module
+
+static const luaL_Reg channel_meta[] = {
+    {"push", l_channel_push},
+    {"pop", l_channel_pop},
+    {"trypush", l_channel_trypush},
+    {"trypop", l_channel_trypop},
+    {"close", l_channel_close},
+    {"count", l_channel_count},
+    {"capacity", l_channel_capacity},
+    {"__gc", l_channel_gc},
+    {"__tostring", l_channel_tostring},
+    {NULL, NULL}};
+
+static const luaL_Reg blob_meta[] = {
+    {"tostring", l_blob_tostring},
+    {"size", l_blob_len},
+    {"__len", l_blob_len},
+    {"__gc", l_blob_gc},
+    {"__tostring", l_blob_name},
+    {NULL, NULL}};
+
+static const luaL_Reg worker_meta[] = {
+    {"join", l_worker_join},
+    {"isRunning", l_worker_isrunning},
+    {"__gc", l_worker_gc},
+    {"__tostring", l_worker_tostring},
+    {NULL, NULL}};
+
+static const luaL_Reg thread_lib[] = {
+    {"spawn", l_spawn},
+    {"channel", l_channel},
+    {"blob", l_blob},
+    {"cores", l_cores},
+    {NULL, NULL}};
+
+static void create_meta(lua_State* L, const char* name, const luaL_Reg* methods) {
+    luaL_newmetatable(L, name);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, methods, 0);
+    lua_pop(L, 1);
+}
+
+int luaopen_thread(lua_State* L) {
+    create_meta(L, CHANNEL_META, channel_meta);
+    create_meta(L, BLOB_META, blob_meta);
+    create_meta(L, WORKER_META, worker_meta);
+    luaL_newlib(L, thread_lib);
+    return 1;
+}
+
+// Make require("thread") available in L (main state and every worker)
+void thread_register(lua_State* L) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+    lua_pushcfunction(L, luaopen_thread);
+    lua_setfield(L, -2, "thread");
+    lua_pop(L, 1);
+}
@@ -0,0 +1,204 @@
+/*
+ * trace.c - Startup tracing for lua_loader (--trace-startup)
+ *
+ * Records complete events ("ph":"X") with a nanosecond monotonic clock and
+ * writes them in Chrome trace format, viewable in chrome://tracing or
+ * https://ui.perfetto.dev.
+ *
+ * Startup phases are marked by main.c with trace_phase(): each call closes
+ * the span that began at the previous mark. require() is wrapped so every
+ * module shows up as "require NAME", with "load NAME" (searcher: path probe
+ * plus dlopen or compile) and "init NAME" (running luaopen_* or the chunk)
+ * nested inside it. Requires of already loaded modules are not recorded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+typedef struct {
+    char* name;
+    const char* cat;
+    long long start;  // ns since trace_start
+    long long end;
+} TraceEvent;
+
+static int g_tracing = 0;
+static long long g_origin = 0;
+static long long g_last_mark = 0;
+static TraceEvent* g_events = NULL;
+static size_t g_count = 0;
+static size_t g_cap = 0;
+
+static long long trace_clock_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    long long seconds = counter.QuadPart / freq.QuadPart;
+    long long rest = counter.QuadPart % freq.QuadPart;
+    return seconds * 1000000000LL + rest * 1000000000LL / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+static long long trace_now(void) {
+    return trace_clock_ns() - g_origin;
+}
+
+static void trace_add(const char* prefix, const char* name, const char* cat, long long start, long long end) {
+    if (g_count == g_cap) {
+        size_t cap = g_cap ? g_cap * 2 : 256;
+        TraceEvent* grown = realloc(g_events, cap * sizeof(TraceEvent));
+        if (!grown) return;
+        g_events = grown;
+        g_cap = cap;
+    }
+    size_t len = strlen(prefix) + strlen(name) + 1;
+    char* copy = malloc(len);
+    if (!copy) return;
+    snprintf(copy, len, "%s%s", prefix, name);
+    TraceEvent* e = &g_events[g_count++];
+    e->name = copy;
+    e->cat = cat;
+    e->start = start;
+    e->end = end;
+}
+
+// Start the clock; main calls this right after parsing the options
+void trace_start(void) {
+    g_origin = trace_clock_ns();
+    g_last_mark = 0;
+    g_tracing = 1;
+}
+
+// Record the span from the previous mark to now as phase 'name'
+void trace_phase(const char* name) {
+    if (!g_tracing) return;
+    long long now = trace_now();
+    trace_add("", name, "startup", g_last_mark, now);
+    g_last_mark = now;
+}
+
+// Move the mark without recording (time that belongs to no phase)
+void trace_skip(void) {
+    if (g_tracing) g_last_mark = trace_now();
+}
+
+// Module initializer returned by a searcher, timed as "init NAME"
+static int traced_loader(lua_State* L) {
+    const char* name = luaL_optstring(L, 1, "?");
+    long long start = trace_now();
+    int base = lua_gettop(L);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, base, LUA_MULTRET);
+    trace_add("init ", name, "require", start, trace_now());
+    return lua_gettop(L);
+}
+
+// Searcher wrapper: times the search, wraps the loader it finds
+static int traced_searcher(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    long long start = trace_now();
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_pushvalue(L, 1);
+    lua_call(L, 1, 2);
+    if (lua_isfunction(L, -2)) {
+        trace_add("load ", name, "require", start, trace_now());
+        lua_pushvalue(L, -2);
+        lua_pushcclosure(L, traced_loader, 1);
+        lua_replace(L, -3);
+    }
+    return 2;
+}
+
+static int traced_require(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    int loaded = lua_getfield(L, -1, name) != LUA_TNIL;
+    lua_pop(L, 2);
+
+    long long start = trace_now();
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_pushvalue(L, 1);
+    lua_call(L, 1, 2);
+    if (!loaded) trace_add("require ", name, "require", start, trace_now());
+    return 2;
+}
+
+// Wrap require and package.searchers in L; call after every searcher is installed
+void trace_install(lua_State* L) {
+    if (!g_tracing) return;
+    lua_getglobal(L, "package");
+    if (lua_getfield(L, -1, "searchers") == LUA_TTABLE) {
+        lua_Integer n = luaL_len(L, -1);
+        for (lua_Integer i = 1; i <= n; i++) {
+            lua_rawgeti(L, -1, i);
+            lua_pushcclosure(L, traced_searcher, 1);
+            lua_rawseti(L, -2, i);
+        }
+    }
+    lua_pop(L, 2);
+
+    lua_getglobal(L, "require");
+    lua_pushcclosure(L, traced_require, 1);
+    lua_setglobal(L, "require");
+}
+
+static void write_json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+            fputc(*s, out);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// Write the Chrome trace and print a one-line summary
+void trace_stop(const char* path) {
+    if (!g_tracing) return;
+    g_tracing = 0;
+
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        printf("Error: cannot write startup trace to '%s'\n", path);
+    } else {
+        fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"lua_loader\"}}");
+        for (size_t i = 0; i < g_count; i++) {
+            TraceEvent* e = &g_events[i];
+            fprintf(out, ",\n{\"name\":");
+            write_json_string(out, e->name);
+            fprintf(out, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}", e->cat,
+                    (double)e->start / 1000.0, (double)(e->end - e->start) / 1000.0);
+        }
+        fprintf(out, "\n]}\n");
+        fclose(out);
+        printf("Startup trace written to %s (%zu events)\n", path, g_count);
+    }
+
+    for (size_t i = 0; i < g_count; i++) free(g_events[i].name);
+    free(g_events);
+    g_events = NULL;
+    g_count = g_cap = 0;
+}
@@ -11,6 +11,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "srglue.h"
+#include "srlz.h"
+#include "lua.h"
+#include "lauxlib.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 static const char* progname="srglue";
 
@@ -20,6 +30,12 @@ static void cannot(const char* what, const char* name)
  exit(EXIT_FAILURE);
 }
 
+static void fatal(const char* message, const char* name)
+{
+ fprintf(stderr,"%s: %s %s\n",progname,message,name);
+ exit(EXIT_FAILURE);
+}
+
 static FILE* open(const char* name, const char* mode, const char* outname)
 {
  if (outname!=NULL && strcmp(name,outname)==0)
@@ -53,24 +69,370 @@ static long copy(FILE* in, const char* name, FILE* out, const char* outname)
  return size;
 }
 
+/* one bundle input */
+typedef struct {
+ char* name;
+ const char* path;
+ uint32_t flags;
+ char* data;
+ size_t size;
+ size_t rawsize;	/* size before --compress */
+} Input;
+
+static char* slurp(const char* name, const char* outname, size_t* size)
+{
+ FILE* f=open(name,"rb",outname);
+ long n;
+ char* data;
+ if (fseek(f,0,SEEK_END)!=0) cannot("seek",name);
+ n=ftell(f);
+ if (n<0 || fseek(f,0,SEEK_SET)!=0) cannot("seek",name);
+ data=malloc(n>0 ? (size_t)n : 1);
+ if (data==NULL) cannot("read",name);
+ if (n>0 && fread(data,(size_t)n,1,f)!=1) cannot("read",name);
+ fclose(f);
+ *size=(size_t)n;
+ return data;
+}
+
+static int ends_with(const char* s, const char* suffix)
+{
+ size_t n=strlen(s), m=strlen(suffix);
+ return n>=m && strcmp(s+n-m,suffix)==0;
+}
+
+static int is_native(const char* s)
+{
+ return ends_with(s,".so") || ends_with(s,".dll");
+}
+
+/*
+* "name=path" or "path"; modules get "dir/mod.lua" -> "dir.mod", "dir/mod.so"
+* too, "dir/init.lua" -> "dir"; leading "./" and "../" are dropped
+*/
+static void parse_input(Input* in, const char* arg, uint32_t flags)
+{
+ const char* eq=strchr(arg,'=');
+ size_t n;
+ if (eq!=NULL)
+ {
+  n=eq-arg;
+  in->path=eq+1;
+ }
+ else
+ {
+  in->path=arg;
+  if (flags==BUNDLE_MODULE || flags==BUNDLE_NATIVE)
+  {
+   char* p;
+   while (strncmp(arg,"./",2)==0 || strncmp(arg,".\\",2)==0 || strncmp(arg,"../",3)==0 || strncmp(arg,"..\\",3)==0)
+    arg+= arg[1]=='.' ? 3 : 2;			/* "../lib/foo.lua" is "lib.foo" */
+   n=strlen(arg);
+   if (ends_with(arg,".lua") || ends_with(arg,".dll")) n-=4;
+   else if (ends_with(arg,".so")) n-=3;
+   in->name=malloc(n+1);
+   if (in->name==NULL) cannot("allocate",arg);
+   memcpy(in->name,arg,n); in->name[n]=0;
+   for (p=in->name; *p; p++) if (*p=='/' || *p=='\\') *p='.';
+   n=strlen(in->name);				/* "pkg/init.lua" is "pkg", as ?/init.lua */
+   if (flags==BUNDLE_MODULE && n>5 && strcmp(in->name+n-5,".init")==0) in->name[n-5]=0;
+   if (in->name[0]==0 || in->name[0]=='.' || strstr(in->name,"..")!=NULL)
+    fatal("cannot name module (use name=path):",in->path);
+   in->flags=flags;
+   return;
+  }
+  n=strlen(arg);
+ }
+ if (n==0) fatal("empty name in",arg);
+ in->name=malloc(n+1);
+ if (in->name==NULL) cannot("allocate",arg);
+ memcpy(in->name,arg,n); in->name[n]=0;
+ in->flags=flags;
+}
+
+/* --compile: tag + bytecode + source (empty with --no-source) */
+typedef struct { char* data; size_t size, cap; } Buffer;
+
+static int writer(lua_State* L, const void* p, size_t n, void* ud)
+{
+ Buffer* b=ud;
+ (void)L;
+ if (b->size+n>b->cap)
+ {
+  size_t cap=b->cap ? b->cap : 4096;
+  char* data;
+  while (cap<b->size+n) cap*=2;
+  data=realloc(b->data,cap);
+  if (data==NULL) return 1;
+  b->data=data; b->cap=cap;
+ }
+ memcpy(b->data+b->size,p,n);
+ b->size+=n;
+ return 0;
+}
+
+static void compile(lua_State* L, Input* in, int strip, int keep_source)
+{
+ Buffer b={NULL,0,0};
+ BundleCode tag;
+ const char* source=in->data;
+ size_t size=in->size;
+ if (size>0 && *source=='#')			/* skip #! line, keep its newline */
+  while (size>0 && *source!='\n') { source++; size--; }
+ lua_pushfstring(L,"@%s",in->name);
+ if (luaL_loadbuffer(L,source,size,lua_tostring(L,-1))!=LUA_OK)
+  fatal("cannot compile",lua_tostring(L,-1));
+ memset(&tag,0,sizeof(tag));
+ memcpy(tag.sig,CODESIG,CODELEN);
+ tag.intsize=sizeof(lua_Integer);
+ tag.numsize=sizeof(lua_Number);
+ tag.version=LUA_VERSION_NUM;
+ tag.stripped=strip;
+ if (writer(L,&tag,sizeof(tag),&b)!=0 || lua_dump(L,writer,&b,strip)!=0) cannot("compile",in->path);
+ tag.codesize=b.size-sizeof(tag);
+ memcpy(b.data,&tag,sizeof(tag));
+ if (keep_source && writer(L,in->data,in->size,&b)!=0) cannot("compile",in->path);
+ lua_pop(L,2);
+ free(in->data);
+ in->data=b.data;
+ in->size=b.size;
+ in->flags|=BUNDLE_BYTECODE;
+}
+
+/*
+* --compress: each entry is compressed on its own so srlua can unpack only
+* what it uses; entries are spread over one thread per core
+*/
+#define LZ_MINSAVE(n)	((n)/16)	/* keep raw unless this much is saved */
+
+typedef struct {
+ Input* inputs;
+ int count, next;
+#ifdef _WIN32
+ CRITICAL_SECTION lock;
+#else
+ pthread_mutex_t lock;
+#endif
+} Compressor;
+
+static int next_input(Compressor* c)
+{
+ int i;
+#ifdef _WIN32
+ EnterCriticalSection(&c->lock);
+ i=c->next++;
+ LeaveCriticalSection(&c->lock);
+#else
+ pthread_mutex_lock(&c->lock);
+ i=c->next++;
+ pthread_mutex_unlock(&c->lock);
+#endif
+ return i<c->count ? i : -1;
+}
+
+static void compress_input(Input* in)
+{
+ size_t cap=in->size-LZ_MINSAVE(in->size), n;
+ char* data;
+ if (in->size<64) return;
+ data=malloc(cap);
+ if (data==NULL) return;				/* stays raw */
+ n=lz_compress(in->data,in->size,data,cap);
+ if (n==0) { free(data); return; }
+ free(in->data);
+ in->data=data;
+ in->size=n;
+ in->flags|=BUNDLE_LZ;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI compress_worker(LPVOID ud)
+#else
+static void* compress_worker(void* ud)
+#endif
+{
+ Compressor* c=ud;
+ int i;
+ while ((i=next_input(c))>=0) compress_input(&c->inputs[i]);
+ return 0;
+}
+
+static int cores(void)
+{
+#ifdef _WIN32
+ SYSTEM_INFO info;
+ GetSystemInfo(&info);
+ return (int)info.dwNumberOfProcessors;
+#else
+ long n=sysconf(_SC_NPROCESSORS_ONLN);
+ return n>0 ? (int)n : 1;
+#endif
+}
+
+static void compress_all(Input* inputs, int count)
+{
+ Compressor c;
+ int nthreads=cores(), started=0, i;
+#ifdef _WIN32
+ HANDLE* threads;
+#else
+ pthread_t* threads;
+#endif
+ if (nthreads>count) nthreads=count;
+ c.inputs=inputs; c.count=count; c.next=0;
+ threads=calloc(nthreads>0 ? nthreads : 1,sizeof(*threads));
+#ifdef _WIN32
+ InitializeCriticalSection(&c.lock);
+ for (i=1; threads!=NULL && i<nthreads; i++)
+  if ((threads[started]=CreateThread(NULL,0,compress_worker,&c,0,NULL))!=NULL) started++;
+ compress_worker(&c);				/* this thread is one of the workers */
+ for (i=0; i<started; i++) { WaitForSingleObject(threads[i],INFINITE); CloseHandle(threads[i]); }
+ DeleteCriticalSection(&c.lock);
+#else
+ pthread_mutex_init(&c.lock,NULL);
+ for (i=1; threads!=NULL && i<nthreads; i++)
+  if (pthread_create(&threads[started],NULL,compress_worker,&c)==0) started++;
+ compress_worker(&c);				/* this thread is one of the workers */
+ for (i=0; i<started; i++) pthread_join(threads[i],NULL);
+ pthread_mutex_destroy(&c.lock);
+#endif
+ free(threads);
+}
+
+static int compare_inputs(const void* a, const void* b)
+{
+ return strcmp(((const Input*)a)->name,((const Input*)b)->name);
+}
+
+static void put(const void* p, size_t n, FILE* out, const char* outname)
+{
+ if (n>0 && fwrite(p,n,1,out)!=1) cannot("write",outname);
+}
+
+/* header, sorted table of contents, names, data */
+static long write_bundle(Input* inputs, int count, FILE* out, const char* outname)
+{
+ Bundle b;
+ BundleEntry* toc=calloc(count,sizeof(BundleEntry));
+ uint64_t offset;
+ uint32_t names=0;
+ int i;
+ if (toc==NULL) cannot("allocate",outname);
+ qsort(inputs,count,sizeof(Input),compare_inputs);
+ memset(&b,0,sizeof(b));
+ memcpy(b.sig,BUNDLESIG,BUNDLELEN);
+ b.version=BUNDLEVERSION;
+ b.count=count;
+ b.main=BUNDLENONE;
+ for (i=0; i<count; i++)
+ {
+  if (i>0 && strcmp(inputs[i].name,inputs[i-1].name)==0) fatal("duplicate name",inputs[i].name);
+  if (inputs[i].flags & BUNDLE_MAIN) b.main=i;
+  toc[i].name=names;
+  toc[i].namelen=strlen(inputs[i].name);
+  names+=toc[i].namelen+1;
+ }
+ b.names=names;
+ offset=sizeof(b)+(uint64_t)count*sizeof(BundleEntry)+names;
+ for (i=0; i<count; i++)
+ {
+  toc[i].flags=inputs[i].flags;
+  toc[i].offset=offset;
+  toc[i].size=inputs[i].size;
+  toc[i].rawsize=inputs[i].rawsize;
+  offset+=inputs[i].size;
+ }
+ put(&b,sizeof(b),out,outname);
+ put(toc,count*sizeof(BundleEntry),out,outname);
+ for (i=0; i<count; i++) put(inputs[i].name,toc[i].namelen+1,out,outname);
+ for (i=0; i<count; i++) put(inputs[i].data,inputs[i].size,out,outname);
+ free(toc);
+ return (long)offset;
+}
+
+static void usage(void)
+{
+ fprintf(stderr,
+ "usage: %s [options] in.exe main.lua out.exe [input ...]\n"
+ "options:\n"
+ "  --compile     store Lua inputs as bytecode (source kept as fallback)\n"
+ "  --strip       with --compile, drop debug information\n"
+ "  --no-source   with --compile, do not keep the source\n"
+ "  --compress    compress entries that shrink, unpacked by srlua on use\n"
+ "inputs:\n"
+ "  mod.lua | dir/mod.lua     module, required as \"mod\" or \"dir.mod\"\n"
+ "  dir/init.lua              module, required as \"dir\"\n"
+ "  name=file.lua             module with an explicit name\n"
+ "  -a file | -a name=file    asset, read with bundle.read(name)\n"
+ "  mod.so | name=file.dll    C module, loaded by require without extracting it\n"
+ "anything else that does not end in .lua is an asset\n",
+ progname);
+ exit(EXIT_FAILURE);
+}
+
 int main(int argc, char* argv[])
 {
+ int compile_lua=0, strip=0, keep_source=1, compress=0;
  if (argv[0]!=NULL && *argv[0]!=0) progname=argv[0];
- if (argc!=4)
+ while (argc>1 && strncmp(argv[1],"--",2)==0)
+ {
+  if (strcmp(argv[1],"--compile")==0) compile_lua=1;
+  else if (strcmp(argv[1],"--strip")==0) strip=1;
+  else if (strcmp(argv[1],"--no-source")==0) keep_source=0;
+  else if (strcmp(argv[1],"--compress")==0) compress=1;
+  else usage();
+  argv++; argc--;
+ }
+ if (argc<4)
  {
-  fprintf(stderr,"usage: %s in.exe in.lua out.exe\n",progname);
+  usage();
   return 1;
  }
  else
  {
-  FILE* in1=open(argv[1],"rb",argv[3]);
-  FILE* in2=open(argv[2],"rb",argv[3]);
-  FILE* out=open(argv[3],"wb",NULL);
+  const char* outname=argv[3];
+  FILE* in1=open(argv[1],"rb",outname);
+  FILE* out;
+  Input* inputs=calloc(argc,sizeof(Input));
+  int count=0, i;
   Glue t={GLUESIG,0,0};
-  t.size1=copy(in1,argv[1],out,argv[3]);
-  t.size2=copy(in2,argv[2],out,argv[3]);
-  if (fwrite(&t,sizeof(t),1,out)!=1) cannot("write",argv[3]);
-  if (fclose(out)!=0) cannot("close",argv[3]);
+  if (inputs==NULL) cannot("allocate",outname);
+  parse_input(&inputs[count],argv[2],BUNDLE_MAIN);
+  inputs[count].data=slurp(inputs[count].path,outname,&inputs[count].size);
+  count++;
+  for (i=4; i<argc; i++)
+  {
+   uint32_t flags=BUNDLE_MODULE;
+   const char* arg=argv[i];
+   if (strcmp(arg,"-a")==0)
+   {
+    if (++i==argc) usage();
+    arg=argv[i];
+    flags=BUNDLE_ASSET;
+   }
+   else if (is_native(arg))
+    flags=BUNDLE_NATIVE;
+   else if (!ends_with(arg,".lua"))
+    flags=BUNDLE_ASSET;
+   parse_input(&inputs[count],arg,flags);
+   inputs[count].data=slurp(inputs[count].path,outname,&inputs[count].size);
+   count++;
+  }
+  if (compile_lua)
+  {
+   lua_State* L=luaL_newstate();
+   if (L==NULL) cannot("create Lua state for",outname);
+   for (i=0; i<count; i++)
+    if (inputs[i].flags & (BUNDLE_MAIN|BUNDLE_MODULE)) compile(L,&inputs[i],strip,keep_source);
+   lua_close(L);
+  }
+  for (i=0; i<count; i++) inputs[i].rawsize=inputs[i].size;
+  if (compress) compress_all(inputs,count);
+  out=open(outname,"wb",NULL);
+  t.size1=copy(in1,argv[1],out,outname);
+  t.size2=write_bundle(inputs,count,out,outname);
+  if (fwrite(&t,sizeof(t),1,out)!=1) cannot("write",outname);
+  if (fclose(out)!=0) cannot("close",outname);
   return 0;
  }
 }
@@ -6,7 +6,77 @@
 * This code is hereby placed in the public domain and also under the MIT license
 */
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define GLUESIG	"%%srglue"
 #define GLUELEN	(sizeof(GLUESIG)-1)
 
 typedef struct { char sig[GLUELEN]; long size1, size2; } Glue;
+
+/*
+* bundle payload: header, table of contents sorted by name, names, data.
+* Offsets are relative to the start of the payload. A payload that does not
+* start with BUNDLESIG is a plain Lua program (old srglue).
+*/
+
+#define BUNDLESIG	"%%srbundle"
+#define BUNDLELEN	(sizeof(BUNDLESIG)-1)
+#define BUNDLEVERSION	1
+#define BUNDLENONE	0xffffffffu
+
+#define BUNDLE_MAIN	1	/* the program */
+#define BUNDLE_MODULE	2	/* found by require */
+#define BUNDLE_ASSET	4	/* data, read with bundle.read */
+#define BUNDLE_BYTECODE	8	/* BundleCode tag, bytecode, then source (may be empty) */
+#define BUNDLE_LZ	16	/* stored data is srlz-compressed; rawsize is the unpacked size */
+#define BUNDLE_NATIVE	32	/* C module (shared object), found by require */
+
+typedef struct {
+ char sig[BUNDLELEN];
+ uint32_t version;
+ uint32_t count;		/* entries in the table of contents */
+ uint32_t main;		/* index of the program or BUNDLENONE */
+ uint32_t names;		/* size of the names block */
+} Bundle;
+
+typedef struct {
+ uint32_t name, namelen;	/* name in the names block */
+ uint32_t flags, reserved;
+ uint64_t offset, size;		/* stored data */
+ uint64_t rawsize;		/* size once unpacked */
+} BundleEntry;
+
+/*
+* precompiled entries (srglue --compile) start with this tag; srlua loads
+* the bytecode only if the tag matches its own Lua and uses the source
+* otherwise
+*/
+
+#define CODESIG	"%%srbc"
+#define CODELEN	(sizeof(CODESIG)-1)
+
+typedef struct {
+ char sig[CODELEN];
+ uint8_t intsize, numsize;	/* sizeof(lua_Integer), sizeof(lua_Number) */
+ uint32_t version;		/* LUA_VERSION_NUM */
+ uint32_t stripped;		/* compiled without debug info */
+ uint64_t codesize;		/* bytecode size; the source follows */
+} BundleCode;
+
+/*
+* srlua publishes the bundle to C modules as a light userdata in the
+* registry under BUNDLEAPI, so they can use entries in place without going
+* through Lua strings. Both functions are thread-safe.
+*/
+
+#define BUNDLEAPI	"srlua.bundle"
+#define BUNDLEAPIVERSION	1
+
+typedef struct {
+ int version;			/* BUNDLEAPIVERSION */
+ /* stored data of entry 'name' and its unpacked size; 0 if there is none */
+ int (*find)(const char* name, size_t len, const void** data, size_t* size, size_t* rawsize, int* packed);
+ /* unpacks a packed entry into rawsize bytes at out; 0 on success */
+ int (*unpack)(const void* data, size_t size, void* out, size_t rawsize);
+} BundleApi;
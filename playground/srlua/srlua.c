@@ -6,16 +6,34 @@
 * This code is hereby placed in the public domain and also under the MIT license
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		/* clock_gettime and memfd_create under -std=c99 */
+#endif
+
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "srglue.h"
+#include "srlz.h"
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #if LUA_VERSION_NUM <= 501
 
 #define lua_load(L,r,d,n,m)	(lua_load)(L,r,d,n)
@@ -36,6 +54,98 @@ static void traceback(lua_State *L, const char *message)
 
 static const char* progname="srlua";
 
+/*
+* startup tracing: SRLUA_TRACE_STARTUP=file writes the startup phases and
+* each require as complete events in Chrome trace format; it is written at
+* exit, so fatal errors and os.exit still leave a trace
+*/
+
+#define TRACE_ENV	"SRLUA_TRACE_STARTUP"
+#define TRACE_MAX	512
+
+typedef struct { char name[64]; long long start, end; } TraceEvent;
+
+static TraceEvent trace_events[TRACE_MAX];
+static int trace_count=0;
+static const char* trace_path=NULL;
+static long long trace_origin=0, trace_mark=0;
+
+static long long trace_clock(void)
+{
+#ifdef _WIN32
+ static LARGE_INTEGER freq;
+ LARGE_INTEGER counter;
+ if (freq.QuadPart==0) QueryPerformanceFrequency(&freq);
+ QueryPerformanceCounter(&counter);
+ return counter.QuadPart/freq.QuadPart*1000000000LL
+	+ counter.QuadPart%freq.QuadPart*1000000000LL/freq.QuadPart;
+#else
+ struct timespec ts;
+ clock_gettime(CLOCK_MONOTONIC,&ts);
+ return (long long)ts.tv_sec*1000000000LL+ts.tv_nsec;
+#endif
+}
+
+static long long trace_now(void)
+{
+ return trace_clock()-trace_origin;
+}
+
+static void trace_add(const char* prefix, const char* name, long long start)
+{
+ TraceEvent* e;
+ if (trace_path==NULL || trace_count==TRACE_MAX) return;
+ e=&trace_events[trace_count++];
+ snprintf(e->name,sizeof(e->name),"%s%s",prefix,name);
+ e->start=start;
+ e->end=trace_now();
+}
+
+static void trace_phase(const char* name)
+{
+ if (trace_path==NULL) return;
+ trace_add("",name,trace_mark);
+ trace_mark=trace_events[trace_count-1].end;
+}
+
+static int traced_require(lua_State *L)
+{
+ const char* name=luaL_checkstring(L,1);
+ long long start=trace_now();
+ int loaded;
+ lua_getfield(L,LUA_REGISTRYINDEX,LUA_LOADED_TABLE);
+ loaded=lua_getfield(L,-1,name)!=LUA_TNIL;
+ lua_pop(L,2);
+ lua_pushvalue(L,lua_upvalueindex(1));
+ lua_pushvalue(L,1);
+ lua_call(L,1,2);
+ if (!loaded) trace_add("require ",name,start);
+ return 2;
+}
+
+static void trace_write(void)
+{
+ FILE* f;
+ int i;
+ if (trace_path==NULL) return;
+ f=fopen(trace_path,"w");
+ if (f==NULL) { fprintf(stderr,"%s: cannot write %s\n",progname,trace_path); return; }
+ fprintf(f,"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+ fprintf(f,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"srlua\"}}");
+ for (i=0; i<trace_count; i++)
+ {
+  const char* p;
+  fprintf(f,",\n{\"name\":\"");
+  for (p=trace_events[i].name; *p; p++)
+   if (*p=='"' || *p=='\\') fprintf(f,"\\%c",*p);
+   else if ((unsigned char)*p>=0x20) fputc(*p,f);
+  fprintf(f,"\",\"cat\":\"startup\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+	trace_events[i].start/1000.0,(trace_events[i].end-trace_events[i].start)/1000.0);
+ }
+ fprintf(f,"\n]}\n");
+ fclose(f);
+}
+
 static void fatal(const char* message)
 {
  fprintf(stderr,"%s: %s\n",progname,message);
@@ -49,37 +159,546 @@ static void cannot(lua_State *L, const char* what, const char* name)
  fatal(message);
 }
 
-typedef struct { FILE *f; size_t size; char buff[512]; } State;
+/*
+* the executable is mapped read-only and lua_load reads the program straight
+* from the mapping in a single chunk, so nothing is copied
+*/
+
+typedef struct { const char *base; size_t size; } Map;
+
+static Map self;
+
+#ifdef _WIN32
+static HANDLE self_mapping=NULL;
+#endif
+
+static void map_self(lua_State *L, const char *name)
+{
+#ifdef _WIN32
+ LARGE_INTEGER size;
+ HANDLE file=CreateFileA(name,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,
+	FILE_ATTRIBUTE_NORMAL,NULL);
+ if (file==INVALID_HANDLE_VALUE) cannot(L,"open",name);
+ if (!GetFileSizeEx(file,&size)) cannot(L,"read",name);
+ self_mapping=CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+ CloseHandle(file);
+ if (self_mapping==NULL) cannot(L,"map",name);
+ self.base=MapViewOfFile(self_mapping,FILE_MAP_READ,0,0,0);
+ if (self.base==NULL) cannot(L,"map",name);
+ self.size=(size_t)size.QuadPart;
+#else
+ struct stat st;
+ void *p;
+ int fd=open(name,O_RDONLY);
+ if (fd<0) cannot(L,"open",name);
+ if (fstat(fd,&st)!=0) cannot(L,"stat",name);
+ p=mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+ close(fd);
+ if (p==MAP_FAILED) cannot(L,"map",name);
+ self.base=p;
+ self.size=(size_t)st.st_size;
+#endif
+}
+
+static void unmap_self(void)
+{
+ if (self.base==NULL) return;
+#ifdef _WIN32
+ UnmapViewOfFile(self.base);
+ CloseHandle(self_mapping);
+#else
+ munmap((void*)self.base,self.size);
+#endif
+ self.base=NULL;
+}
+
+typedef struct { const char *p; size_t size; } State;
 
 static const char *myget(lua_State *L, void *data, size_t *size)
 {
  State* s=data;
- size_t n;
+ const char *p=s->p;
  (void)L;
- n=(sizeof(s->buff)<=s->size)? sizeof(s->buff) : s->size;
- n=fread(s->buff,1,n,s->f);
- s->size-=n;
- *size=n;
- return (n>0) ? s->buff : NULL;
+ *size=s->size;
+ s->p=NULL; s->size=0;
+ return p;
+}
+
+/*
+* bundles (srglue with several inputs): the table of contents is sorted by
+* name, so require does a binary search in the mapping and compiles only
+* the modules that are actually required
+*/
+
+static const char *payload=NULL;
+static size_t payload_size=0;
+static Bundle bundle;
+static const char *bundle_names=NULL;
+
+static int is_bundle(void)
+{
+ return bundle_names!=NULL;
+}
+
+static void bundle_entry(uint32_t i, BundleEntry *e)
+{
+ memcpy(e,payload+sizeof(Bundle)+i*sizeof(BundleEntry),sizeof(*e));	/* may be unaligned */
+}
+
+static void open_bundle(lua_State *L, const char *name)
+{
+ uint32_t i;
+ size_t toc;
+ if (payload_size<sizeof(Bundle) || memcmp(payload,BUNDLESIG,BUNDLELEN)!=0) return;
+ memcpy(&bundle,payload,sizeof(bundle));
+ if (bundle.version!=BUNDLEVERSION) fatal(lua_pushfstring(L,"%s: unsupported bundle version",name));
+ toc=sizeof(Bundle)+(size_t)bundle.count*sizeof(BundleEntry);
+ if (bundle.count>payload_size/sizeof(BundleEntry) || toc+bundle.names>payload_size)
+  cannot(L,"find a Lua program in",name);
+ bundle_names=payload+toc;
+ for (i=0; i<bundle.count; i++)
+ {
+  BundleEntry e;
+  bundle_entry(i,&e);
+  if (e.name+(uint64_t)e.namelen>=bundle.names || e.offset>payload_size || e.size>payload_size-e.offset)
+   cannot(L,"find a Lua program in",name);
+  if (bundle_names[e.name+e.namelen]!=0 || memchr(bundle_names+e.name,0,e.namelen)!=NULL)
+   cannot(L,"find a Lua program in",name);	/* names are used as C strings */
+ }
+}
+
+/* index of entry 'name' with one of 'flags', or -1 */
+static int bundle_find(const char *name, size_t len, uint32_t flags)
+{
+ int lo=0, hi=(int)bundle.count-1;
+ while (lo<=hi)
+ {
+  int mid=lo+(hi-lo)/2;
+  BundleEntry e;
+  int c;
+  bundle_entry(mid,&e);
+  c=memcmp(name,bundle_names+e.name,len<e.namelen ? len : e.namelen);
+  if (c==0) c=(len>e.namelen)-(len<e.namelen);
+  if (c==0) return (e.flags & flags) ? mid : -1;
+  if (c<0) hi=mid-1; else lo=mid+1;
+ }
+ return -1;
+}
+
+static int load_chunk(lua_State *L, const char *p, size_t size, const char *chunkname, const char *mode)
+{
+ State S;
+ S.p=p; S.size=size;
+ if (S.size>0 && *S.p=='#')			/* skip #! line, keep its newline */
+  while (S.size>0 && *S.p!='\n') { S.p++; S.size--; }
+ return lua_load(L,myget,&S,chunkname,mode);
+}
+
+/*
+* compressed entries (srglue --compress) are unpacked when used, into one
+* arena that is reused by the next entry; callers copy what they keep and
+* hand the data back with entry_release. Lua may run finalizers while the
+* data is in use (lua_load reads it while parsing), and those may unpack
+* other entries, so the arena is marked busy and nested uses get a buffer
+* of their own
+*/
+
+static char *arena=NULL;
+static size_t arena_size=0;
+static int arena_busy=0;
+
+/* done with data from entry_data */
+static void entry_release(const BundleEntry *e, const char *p)
+{
+ if (!(e->flags & BUNDLE_LZ) || p==NULL) return;
+ if (p==arena) arena_busy=0; else free((void*)p);
+}
+
+/* unpacked data of an entry, or NULL with an error message pushed */
+static const char *entry_data(lua_State *L, const BundleEntry *e, size_t *size)
+{
+ const char *p=payload+e->offset;
+ char *out;
+ *size=(size_t)e->size;
+ if (!(e->flags & BUNDLE_LZ)) return p;
+ if (e->rawsize>(size_t)-1) goto corrupt;
+ if (arena_busy)
+  out=malloc(e->rawsize>0 ? (size_t)e->rawsize : 1);
+ else
+ {
+  if (e->rawsize>arena_size)
+  {
+   char *grown=realloc(arena,(size_t)e->rawsize);
+   if (grown!=NULL) { arena=grown; arena_size=(size_t)e->rawsize; }
+  }
+  out=e->rawsize<=arena_size ? arena : NULL;
+ }
+ if (out==NULL)
+ {
+  lua_pushfstring(L,"%s: not enough memory to unpack",bundle_names+e->name);
+  return NULL;
+ }
+ if (out==arena) arena_busy=1;
+ if (lz_decompress(p,(size_t)e->size,out,(size_t)e->rawsize)!=0)
+ {
+  entry_release(e,out);
+  goto corrupt;
+ }
+ *size=(size_t)e->rawsize;
+ return out;
+corrupt:
+ lua_pushfstring(L,"%s: corrupt compressed entry",bundle_names+e->name);
+ return NULL;
+}
+
+/* source part of unpacked entry data (empty for bytecode glued with --no-source) */
+static const char *entry_source(const BundleEntry *e, const char *p, size_t *size)
+{
+ BundleCode tag;
+ size_t n=*size;
+ if (!(e->flags & BUNDLE_BYTECODE)) return p;
+ *size=0;
+ if (n<sizeof(tag)) return p;
+ memcpy(&tag,p,sizeof(tag));
+ if (tag.codesize>n-sizeof(tag)) return p;
+ *size=(size_t)(n-sizeof(tag)-tag.codesize);
+ return p+sizeof(tag)+tag.codesize;
+}
+
+/* precompiled entries: the bytecode if it was made by this Lua, else the source */
+static int load_bytecode(lua_State *L, const BundleEntry *e, const char *p, size_t n, const char *chunkname)
+{
+ const char *source;
+ size_t size=n;
+ BundleCode tag;
+ if (n>=sizeof(tag))
+ {
+  memcpy(&tag,p,sizeof(tag));
+  if (memcmp(tag.sig,CODESIG,CODELEN)==0 && tag.version==LUA_VERSION_NUM
+	&& tag.intsize==sizeof(lua_Integer) && tag.numsize==sizeof(lua_Number)
+	&& tag.codesize<=n-sizeof(tag))
+  {
+   if (load_chunk(L,p+sizeof(tag),(size_t)tag.codesize,chunkname,"b")==0) return 0;
+   lua_pop(L,1);
+  }
+ }
+ source=entry_source(e,p,&size);
+ if (size==0)
+ {
+  lua_pushfstring(L,"%s: bytecode does not match %s and no source was glued",chunkname+1,LUA_VERSION);
+  return LUA_ERRSYNTAX;
+ }
+ return load_chunk(L,source,size,chunkname,"t");
+}
+
+static int load_entry(lua_State *L, int i)
+{
+ BundleEntry e;
+ const char *p;
+ size_t size;
+ int status;
+ bundle_entry(i,&e);
+ lua_pushfstring(L,"@%s",bundle_names+e.name);
+ p=entry_data(L,&e,&size);
+ if (p==NULL) return 0;
+ if (e.flags & BUNDLE_BYTECODE)
+  status=load_bytecode(L,&e,p,size,lua_tostring(L,-1));
+ else
+  status=load_chunk(L,p,size,lua_tostring(L,-1),NULL);
+ entry_release(&e,p);
+ if (status!=0) return 0;
+ lua_remove(L,-2);
+ return 1;
+}
+
+static int bundle_searcher(lua_State *L)
+{
+ size_t len;
+ const char *name=luaL_checklstring(L,1,&len);
+ int i=bundle_find(name,len,BUNDLE_MODULE);
+ if (i<0)
+ {
+  lua_pushfstring(L,"no module '%s' in bundle",name);
+  return 1;
+ }
+ if (!load_entry(L,i))
+  return luaL_error(L,"error loading module '%s' from bundle:\n\t%s",name,lua_tostring(L,-1));
+ lua_pushfstring(L,"bundle:%s",name);
+ return 2;
+}
+
+/* bundle.read(name) -> contents of an asset (or module source), or nil */
+static int bundle_read(lua_State *L)
+{
+ size_t len, size;
+ const char *name=luaL_checklstring(L,1,&len);
+ int i=is_bundle() ? bundle_find(name,len,BUNDLE_ASSET|BUNDLE_MODULE) : -1;
+ const char *data, *p;
+ BundleEntry e;
+ luaL_Buffer b;
+ if (i<0) { lua_pushnil(L); return 1; }
+ bundle_entry(i,&e);
+ data=entry_data(L,&e,&size);
+ if (data==NULL) lua_error(L);
+ p=entry_source(&e,data,&size);
+ if (size==0 && (e.flags & BUNDLE_BYTECODE)) lua_pushnil(L);
+ else
+ {
+  char *copy=luaL_buffinitsize(L,&b,size);		/* may run finalizers */
+  memcpy(copy,p,size);
+  entry_release(&e,data);
+  luaL_pushresultsize(&b,size);
+  return 1;
+ }
+ entry_release(&e,data);
+ return 1;
+}
+
+/* bundle.list() -> { name = "main" | "module" | "asset" } */
+static int bundle_list(lua_State *L)
+{
+ uint32_t i;
+ lua_createtable(L,0,is_bundle() ? bundle.count : 0);
+ for (i=0; is_bundle() && i<bundle.count; i++)
+ {
+  BundleEntry e;
+  bundle_entry(i,&e);
+  lua_pushstring(L,(e.flags & BUNDLE_MAIN) ? "main" : (e.flags & BUNDLE_MODULE) ? "module"
+	: (e.flags & BUNDLE_NATIVE) ? "native" : "asset");
+  lua_setfield(L,-2,bundle_names+e.name);
+ }
+ return 1;
+}
+
+static int luaopen_bundle(lua_State *L)
+{
+ static const luaL_Reg funcs[]={
+  {"read",bundle_read},
+  {"list",bundle_list},
+  {NULL,NULL}
+ };
+ luaL_newlib(L,funcs);
+ return 1;
+}
+
+/*
+* C modules glued as shared objects: dlopen needs a path, so on Linux the
+* entry is copied into a memfd and opened as /proc/self/fd/N; elsewhere, or
+* if that fails, it is written once to a cache directory under a name that
+* includes the hash of the entry, and later runs open the cached file
+*/
+
+#ifdef _WIN32
+#define NATIVE_EXT	".dll"
+#else
+#define NATIVE_EXT	".so"
+#endif
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+static int native_memfd(lua_State *L, const char *name, const char *p, size_t size)
+{
+ int fd=memfd_create(name,MFD_CLOEXEC);
+ if (fd<0) return 0;
+ while (size>0)
+ {
+  ssize_t n=write(fd,p,size);
+  if (n<0 && errno==EINTR) continue;
+  if (n<=0) { close(fd); return 0; }
+  p+=n; size-=(size_t)n;
+ }
+ /* fd stays open: its path must not be reused while the library is loaded */
+ lua_pushfstring(L,"/proc/self/fd/%d",fd);
+ return 1;
+}
+#endif
+
+static const char *native_cache_dir(lua_State *L)
+{
+ const char *dir=getenv("SRLUA_CACHE");
+ if (dir!=NULL && *dir!=0) return lua_pushstring(L,dir);
+#ifdef _WIN32
+ dir=getenv("LOCALAPPDATA");
+ if (dir==NULL) dir=getenv("TEMP");
+ if (dir==NULL) return NULL;
+ _mkdir(dir);
+ return lua_pushfstring(L,"%s\\srlua",dir);
+#else
+ dir=getenv("XDG_CACHE_HOME");
+ if (dir!=NULL && *dir!=0)
+ {
+  mkdir(dir,0700);
+  return lua_pushfstring(L,"%s/srlua",dir);
+ }
+ dir=getenv("HOME");
+ if (dir==NULL || *dir==0) return NULL;
+ lua_pushfstring(L,"%s/.cache",dir);
+ mkdir(lua_tostring(L,-1),0700);
+ lua_pop(L,1);
+ return lua_pushfstring(L,"%s/.cache/srlua",dir);
+#endif
+}
+
+static int native_cache(lua_State *L, const BundleEntry *e, const char *name)
+{
+ const unsigned char *p=(const unsigned char*)payload+e->offset;
+ const char *dir, *path, *tmp, *data;
+ uint64_t h=14695981039346656037u;	/* FNV-1a of the stored bytes */
+ char hash[17];
+ size_t i, size;
+ struct stat st;
+ FILE *f;
+ int ok;
+ for (i=0; i<e->size; i++) { h^=p[i]; h*=1099511628211u; }
+ snprintf(hash,sizeof(hash),"%08x%08x",(unsigned)(h>>32),(unsigned)(h & 0xffffffffu));
+ dir=native_cache_dir(L);
+ if (dir==NULL) return 0;
+#ifdef _WIN32
+ _mkdir(dir);
+#else
+ mkdir(dir,0700);
+#endif
+ path=lua_pushfstring(L,"%s/%s-%s" NATIVE_EXT,dir,hash,name);
+ lua_remove(L,-2);
+ if (stat(path,&st)==0 && (uint64_t)st.st_size==e->rawsize) return 1;
+ data=entry_data(L,e,&size);
+ if (data==NULL) { lua_pop(L,2); return 0; }
+#ifdef _WIN32
+ tmp=lua_pushfstring(L,"%s.%d",path,(int)_getpid());
+#else
+ tmp=lua_pushfstring(L,"%s.%d",path,(int)getpid());
+#endif
+ f=fopen(tmp,"wb");				/* write, then rename into place */
+ if (f==NULL) { entry_release(e,data); lua_pop(L,2); return 0; }
+ ok=fwrite(data,1,size,f)==size;
+ entry_release(e,data);
+ ok=fclose(f)==0 && ok;
+#ifdef _WIN32
+ if (ok) remove(path);
+#endif
+ ok=ok && rename(tmp,path)==0;
+ if (!ok) remove(tmp);
+ lua_pop(L,ok ? 1 : 2);
+ return ok;
+}
+
+/* pushes a path dlopen can use for entry e */
+static int native_path(lua_State *L, const BundleEntry *e, const char *name)
+{
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+ size_t size;
+ const char *data=entry_data(L,e,&size);
+ int ok;
+ if (data==NULL) lua_error(L);
+ ok=native_memfd(L,name,data,size);
+ entry_release(e,data);
+ if (ok) return 1;
+#endif
+ return native_cache(L,e,name);
+}
+
+static int native_searcher(lua_State *L)
+{
+ size_t len;
+ const char *name=luaL_checklstring(L,1,&len);
+ const char *mark=strchr(name,'-');
+ int i=bundle_find(name,len,BUNDLE_NATIVE);
+ BundleEntry e;
+ if (i<0)
+ {
+  lua_pushfstring(L,"no C module '%s' in bundle",name);
+  return 1;
+ }
+ bundle_entry(i,&e);
+ if (!native_path(L,&e,name)) return luaL_error(L,"cannot extract C module '%s' from bundle",name);
+ /* as in Lua: "a-b" tries luaopen_a, then luaopen_b */
+ lua_pushvalue(L,lua_upvalueindex(1));		/* package.loadlib */
+ lua_pushvalue(L,-2);
+ lua_pushstring(L,"luaopen_");
+ if (mark!=NULL) lua_pushlstring(L,name,(size_t)(mark-name)); else lua_pushstring(L,name);
+ luaL_gsub(L,lua_tostring(L,-1),".","_");
+ lua_remove(L,-2);
+ lua_concat(L,2);
+ lua_call(L,2,3);
+ if (mark!=NULL && lua_isnil(L,-3) && lua_isstring(L,-1) && strcmp(lua_tostring(L,-1),"init")==0)
+ {
+  lua_pop(L,3);
+  lua_pushvalue(L,lua_upvalueindex(1));
+  lua_pushvalue(L,-2);
+  lua_pushstring(L,"luaopen_");
+  luaL_gsub(L,mark+1,".","_");
+  lua_concat(L,2);
+  lua_call(L,2,3);
+ }
+ lua_pop(L,1);
+ if (lua_isnil(L,-2))
+  return luaL_error(L,"error loading module '%s' from bundle:\n\t%s",name,lua_tostring(L,-1));
+ lua_pop(L,1);
+ lua_insert(L,-2);				/* loader, path */
+ return 2;
+}
+
+/* BundleApi for C modules: entries are used in place in the mapping */
+static int api_find(const char *name, size_t len, const void **data, size_t *size, size_t *rawsize, int *packed)
+{
+ BundleEntry e;
+ int i=bundle_find(name,len,BUNDLE_MAIN|BUNDLE_MODULE|BUNDLE_ASSET);
+ if (i<0) return 0;
+ bundle_entry(i,&e);
+ *data=payload+e.offset;
+ *size=(size_t)e.size;
+ *rawsize=(size_t)e.rawsize;
+ *packed=(e.flags & BUNDLE_LZ)!=0;
+ return 1;
+}
+
+static const BundleApi bundle_api={BUNDLEAPIVERSION,api_find,lz_decompress};
+
+/* put the bundle searchers (Lua, then C) right after the preload searcher */
+static void install_searcher(lua_State *L)
+{
+ lua_Integer i, n;
+ lua_getglobal(L,"package");
+ lua_getfield(L,-1,"searchers");
+ n=luaL_len(L,-1);
+ for (i=n; i>=2; i--)
+ {
+  lua_rawgeti(L,-1,i);
+  lua_rawseti(L,-2,i+2);
+ }
+ lua_pushcfunction(L,bundle_searcher);
+ lua_rawseti(L,-2,2);
+ lua_getfield(L,-2,"loadlib");
+ lua_pushcclosure(L,native_searcher,1);
+ lua_rawseti(L,-2,3);
+ lua_pop(L,2);
 }
 
 static void load(lua_State *L, const char *name)
 {
  Glue t;
- State S;
- FILE *f=fopen(name,"rb");
- int c;
- if (f==NULL) cannot(L,"open",name);
- if (fseek(f,-(long)sizeof(t),SEEK_END)!=0) cannot(L,"seek",name);
- if (fread(&t,sizeof(t),1,f)!=1) cannot(L,"read",name);
+ map_self(L,name);
+ if (self.size<sizeof(t)) cannot(L,"find a Lua program in",name);
+ memcpy(&t,self.base+self.size-sizeof(t),sizeof(t));
  if (memcmp(t.sig,GLUESIG,GLUELEN)!=0) cannot(L,"find a Lua program in",name);
- if (fseek(f,t.size1,SEEK_SET)!=0) cannot(L,"seek",name);
- S.f=f; S.size=t.size2;
- c=getc(f);
- if (c=='#') while (--S.size>0 && c!='\n') c=getc(f);
- ungetc(c,f);
- if (lua_load(L,myget,&S,"=",NULL)!=0) fatal(lua_tostring(L,-1));
- fclose(f);
+ if (t.size1<0 || t.size2<0 || (size_t)t.size1+(size_t)t.size2>self.size-sizeof(t))
+  cannot(L,"find a Lua program in",name);
+ payload=self.base+t.size1;
+ payload_size=t.size2;
+ luaL_getsubtable(L,LUA_REGISTRYINDEX,LUA_PRELOAD_TABLE);
+ lua_pushcfunction(L,luaopen_bundle);
+ lua_setfield(L,-2,"bundle");
+ lua_pop(L,1);
+ open_bundle(L,name);
+ if (!is_bundle())
+ {
+  if (load_chunk(L,payload,payload_size,"=",NULL)!=0) fatal(lua_tostring(L,-1));
+  return;
+ }
+ if (bundle.main==BUNDLENONE || bundle.main>=bundle.count) cannot(L,"find a Lua program in",name);
+ install_searcher(L);
+ lua_pushlightuserdata(L,(void*)&bundle_api);
+ lua_setfield(L,LUA_REGISTRYINDEX,BUNDLEAPI);
+ if (!load_entry(L,bundle.main)) fatal(lua_tostring(L,-1));
 }
 
 static int pmain(lua_State *L)
@@ -88,7 +707,15 @@ static int pmain(lua_State *L)
  char** argv=lua_touserdata(L,2);
  int i;
  luaL_openlibs(L);
+ trace_phase("luaL_openlibs");
+ if (trace_path!=NULL)
+ {
+  lua_getglobal(L,"require");
+  lua_pushcclosure(L,traced_require,1);
+  lua_setglobal(L,"require");
+ }
  load(L,argv[0]);
+ trace_phase("load program");
  lua_createtable(L,argc,0);
  for (i=0; i<argc; i++)
  {
@@ -102,6 +729,7 @@ static int pmain(lua_State *L)
   lua_pushstring(L,argv[i]);
  }
  lua_call(L,argc-1,0);
+ trace_phase("run program");
  return 0;
 }
 
@@ -122,13 +750,21 @@ int main(int argc, char *argv[])
  lua_State *L;
  if (argv[0]==NULL) fatal("cannot locate this executable");
  progname=argv[0];
+ trace_path=getenv(TRACE_ENV);
+ if (trace_path!=NULL && *trace_path==0) trace_path=NULL;
+ trace_origin=trace_clock();
+ if (trace_path!=NULL) atexit(trace_write);
  L=luaL_newstate();
  if (L==NULL) fatal("cannot create state: not enough memory");
+ trace_phase("lua_newstate");
  lua_pushcfunction(L,msghandler);
  lua_pushcfunction(L,&pmain);
  lua_pushinteger(L,argc);
  lua_pushlightuserdata(L,argv);
  if (lua_pcall(L,2,0,1)!=0) fatal(lua_tostring(L,-1));
  lua_close(L);
+ unmap_self();
+ free(arena);
+ trace_phase("lua_close");
  return EXIT_SUCCESS;
 }
@@ -0,0 +1,146 @@
+/*
+* srlz.c
+* byte-oriented LZ codec for srlua bundles (LZ4-style sequences)
+* This code is hereby placed in the public domain and also under the MIT license
+*
+* A block is a list of sequences: a token byte (literal length in the high
+* nibble, match length minus 4 in the low one, 15 meaning "more bytes
+* follow, 255 at a time"), the literals, a 2-byte little-endian offset and
+* the extra match length. The last sequence has literals only. Decoding is
+* bounds-checked and runs at memory speed.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "srlz.h"
+
+#define MINMATCH	4
+#define HASHBITS	14
+#define MAXOFFSET	65535
+#define LASTLITERALS	5	/* the block always ends with literals */
+#define MFLIMIT		12	/* no match may start this close to the end */
+
+static uint32_t read32(const unsigned char* p)
+{
+ uint32_t v;
+ memcpy(&v,p,sizeof(v));
+ return v;
+}
+
+static uint32_t hash(uint32_t v)
+{
+ return (v*2654435761u)>>(32-HASHBITS);
+}
+
+/* writes a length extension; returns the new output position or 0 if full */
+static size_t put_length(unsigned char* out, size_t op, size_t cap, size_t len)
+{
+ for (; len>=255; len-=255)
+ {
+  if (op>=cap) return 0;
+  out[op++]=255;
+ }
+ if (op>=cap) return 0;
+ out[op++]=(unsigned char)len;
+ return op;
+}
+
+static size_t put_sequence(unsigned char* out, size_t op, size_t cap,
+	const unsigned char* literals, size_t nlit, size_t offset, size_t mlen)
+{
+ size_t token=op++;
+ if (op>cap) return 0;
+ out[token]=(unsigned char)(((nlit<15 ? nlit : 15)<<4) | (mlen==0 ? 0 : (mlen-MINMATCH<15 ? mlen-MINMATCH : 15)));
+ if (nlit>=15 && (op=put_length(out,op,cap,nlit-15))==0) return 0;
+ if (op+nlit>cap) return 0;
+ memcpy(out+op,literals,nlit);
+ op+=nlit;
+ if (mlen==0) return op;
+ if (op+2>cap) return 0;
+ out[op++]=(unsigned char)(offset & 0xff);
+ out[op++]=(unsigned char)(offset>>8);
+ if (mlen-MINMATCH>=15 && (op=put_length(out,op,cap,mlen-MINMATCH-15))==0) return 0;
+ return op;
+}
+
+size_t lz_compress(const void* src, size_t n, void* dst, size_t cap)
+{
+ const unsigned char* in=src;
+ unsigned char* out=dst;
+ uint32_t table[1<<HASHBITS];
+ size_t ip=0, anchor=0, op=0;
+ memset(table,0,sizeof(table));
+ if (n>MFLIMIT)
+ {
+  size_t limit=n-MFLIMIT, matchlimit=n-LASTLITERALS;
+  while (ip<limit)
+  {
+   uint32_t h=hash(read32(in+ip));
+   size_t ref=table[h];
+   table[h]=(uint32_t)ip+1;
+   if (ref>0 && ip-(ref-1)<=MAXOFFSET && read32(in+ref-1)==read32(in+ip))
+   {
+    size_t len=MINMATCH;
+    ref--;
+    while (ip+len<matchlimit && in[ref+len]==in[ip+len]) len++;
+    op=put_sequence(out,op,cap,in+anchor,ip-anchor,ip-ref,len);
+    if (op==0) return 0;
+    ip+=len;
+    anchor=ip;
+   }
+   else
+    ip+=1+((ip-anchor)>>6);		/* skip faster through incompressible data */
+  }
+ }
+ op=put_sequence(out,op,cap,in+anchor,n-anchor,0,0);
+ return op;
+}
+
+/* reads a length extension; returns -1 past the end of the input */
+static int get_length(const unsigned char* in, size_t n, size_t* ip, size_t* len)
+{
+ unsigned char b;
+ do
+ {
+  if (*ip>=n) return -1;
+  b=in[(*ip)++];
+  *len+=b;
+ } while (b==255);
+ return 0;
+}
+
+int lz_decompress(const void* src, size_t n, void* dst, size_t rawsize)
+{
+ const unsigned char* in=src;
+ unsigned char* out=dst;
+ size_t ip=0, op=0;
+ for (;;)
+ {
+  size_t nlit, mlen, offset;
+  unsigned char token;
+  if (ip>=n) return -1;
+  token=in[ip++];
+  nlit=token>>4;
+  if (nlit==15 && get_length(in,n,&ip,&nlit)!=0) return -1;
+  if (nlit>n-ip || nlit>rawsize-op) return -1;
+  memcpy(out+op,in+ip,nlit);
+  ip+=nlit;
+  op+=nlit;
+  if (ip==n) return op==rawsize ? 0 : -1;
+  if (n-ip<2) return -1;
+  offset=in[ip] | (in[ip+1]<<8);
+  ip+=2;
+  mlen=(token & 15);
+  if (mlen==15 && get_length(in,n,&ip,&mlen)!=0) return -1;
+  mlen+=MINMATCH;
+  if (offset==0 || offset>op || mlen>rawsize-op) return -1;
+  if (offset>=mlen)
+   memcpy(out+op,out+op-offset,mlen);
+  else
+  {
+   size_t i;					/* overlapping: repeat the pattern */
+   for (i=0; i<mlen; i++) out[op+i]=out[op-offset+i];
+  }
+  op+=mlen;
+ }
+}
@@ -0,0 +1,16 @@
+/*
+* srlz.h
+* byte-oriented LZ codec for srlua bundles (LZ4-style sequences)
+* This code is hereby placed in the public domain and also under the MIT license
+*/
+
+#include <stddef.h>
+
+/* worst-case compressed size of n bytes */
+#define LZ_BOUND(n)	((n)+(n)/255+16)
+
+/* compress n bytes into out (at most cap bytes); returns the size or 0 if it does not fit */
+size_t lz_compress(const void* in, size_t n, void* out, size_t cap);
+
+/* decompress exactly rawsize bytes; returns 0 on success, -1 on corrupt input */
+int lz_decompress(const void* in, size_t n, void* out, size_t rawsize);